@@ -0,0 +1,492 @@
+/*
+ * ipfs-bench.cc
+ * End-to-end throughput and latency benchmark for the IPFS backend.
+ *
+ * Generates a synthetic AtomSpace, and then times the major
+ * BackingStore operations against either a real IPFS daemon, or
+ * against the in-process mock daemon. Results are written as json,
+ * one record per operation, with ops/sec and latency percentiles.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <opencog/atoms/base/Atom.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/atom_types/atom_types.h>
+#include <opencog/atoms/truthvalue/SimpleTruthValue.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/persist/ipfs/IPFSAtomStorage.h>
+#include <opencog/persist/ipfs/mock/MockIPFSDaemon.h>
+
+using namespace opencog;
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig
+{
+	std::string uri;            // Empty means "use the mock daemon".
+	std::string output = "ipfs-bench.json";
+	std::string only;           // Comma-separated list of benchmarks.
+	size_t num_nodes = 1000;
+	size_t num_links = 1000;
+	size_t arity = 2;
+	size_t num_hubs = 4;
+	size_t hub_degree = 100;
+	size_t value_size = 0;      // Number of floats per FloatValue.
+	size_t num_ops = 200;       // Ops for the per-op benchmarks.
+	unsigned int seed = 42;
+	size_t num_daemons = 1;     // Mock daemons to split the AtomSpace over.
+	MockIPFSConfig mock;
+};
+
+/// Timing results for one operation.
+struct BenchResult
+{
+	std::string name;
+	size_t ops = 0;
+	double seconds = 0.0;
+	std::vector<double> usecs;  // Per-op latencies, if measured.
+
+	double percentile(double q)
+	{
+		if (0 == usecs.size()) return 0.0;
+		std::sort(usecs.begin(), usecs.end());
+		size_t idx = std::min(usecs.size() - 1, (size_t) (q * usecs.size()));
+		return usecs[idx];
+	}
+
+	ipfs::Json to_json(void)
+	{
+		ipfs::Json j;
+		j["name"] = name;
+		j["ops"] = ops;
+		j["seconds"] = seconds;
+		j["ops_per_sec"] = (0.0 < seconds) ? ops / seconds : 0.0;
+		if (0 < usecs.size())
+		{
+			j["p50_usec"] = percentile(0.50);
+			j["p99_usec"] = percentile(0.99);
+			j["p999_usec"] = percentile(0.999);
+			j["max_usec"] = usecs.back();
+		}
+		return j;
+	}
+};
+
+/* ================================================================ */
+
+class Bench
+{
+	private:
+		BenchConfig _cfg;
+		std::mt19937 _rng;
+		std::vector<MockIPFSDaemon*> _mocks;
+		std::string _uri;
+
+		AtomSpace _as;
+		HandleSeq _nodes;
+		HandleSeq _links;
+		HandleSeq _hubs;
+		Handle _key;
+
+		std::vector<BenchResult> _results;
+
+		bool wanted(const std::string&);
+		Handle random_node(void);
+		ValuePtr make_value(void);
+		void time_each(BenchResult&, const HandleSeq&,
+		               const std::function<void(const Handle&)>&);
+		HandleSeq sample(const HandleSeq&, size_t);
+
+	public:
+		Bench(const BenchConfig&);
+		~Bench();
+
+		void generate(void);
+		void run(void);
+		void report(void);
+};
+
+Bench::Bench(const BenchConfig& cfg) :
+	_cfg(cfg), _rng(cfg.seed)
+{
+	_uri = cfg.uri;
+	if (0 == _uri.size())
+	{
+		// With several daemons, the AtomSpace is split across them.
+		std::string hosts;
+		for (size_t i = 0; i < cfg.num_daemons; i++)
+		{
+			MockIPFSConfig mcfg(cfg.mock);
+			mcfg.seed += i;
+			if (0 < mcfg.port) mcfg.port += i;
+			MockIPFSDaemon* mock = new MockIPFSDaemon(mcfg);
+			mock->start();
+			_mocks.push_back(mock);
+			if (0 < i) hosts += ",";
+			hosts += "localhost:" + std::to_string(mock->get_port());
+		}
+		_uri = "ipfs://" + hosts + "/atomspace-bench-" +
+		       std::to_string(getpid());
+	}
+	_key = createNode(PREDICATE_NODE, "*-bench-key-*");
+}
+
+Bench::~Bench()
+{
+	for (MockIPFSDaemon* mock : _mocks) delete mock;
+}
+
+bool Bench::wanted(const std::string& name)
+{
+	if (0 == _cfg.only.size()) return true;
+	std::string list = "," + _cfg.only + ",";
+	return std::string::npos != list.find("," + name + ",");
+}
+
+Handle Bench::random_node(void)
+{
+	return _nodes[std::uniform_int_distribution<size_t>(0, _nodes.size()-1)(_rng)];
+}
+
+ValuePtr Bench::make_value(void)
+{
+	std::vector<double> fv(_cfg.value_size);
+	std::uniform_real_distribution<double> dist(-1.0, 1.0);
+	for (double& f : fv) f = dist(_rng);
+	return createFloatValue(fv);
+}
+
+HandleSeq Bench::sample(const HandleSeq& from, size_t n)
+{
+	HandleSeq out(from);
+	std::shuffle(out.begin(), out.end(), _rng);
+	if (n < out.size()) out.resize(n);
+	return out;
+}
+
+/// Generate the synthetic AtomSpace: plain nodes, links of the given
+/// arity over random nodes, and a few hub nodes, each appearing in
+/// the outgoing set of `hub_degree` links.
+void Bench::generate(void)
+{
+	std::uniform_real_distribution<double> tvdist(0.0, 1.0);
+	for (size_t i = 0; i < _cfg.num_nodes; i++)
+	{
+		Handle h = _as.add_node(CONCEPT_NODE, "bench node " + std::to_string(i));
+		h->setTruthValue(SimpleTruthValue::createTV(tvdist(_rng), tvdist(_rng)));
+		if (0 < _cfg.value_size) h->setValue(_key, make_value());
+		_nodes.push_back(h);
+	}
+
+	for (size_t i = 0; i < _cfg.num_links; i++)
+	{
+		HandleSeq oset;
+		for (size_t j = 0; j < _cfg.arity; j++)
+			oset.push_back(random_node());
+		Handle h = _as.add_link(LIST_LINK, oset);
+		if (0 < _cfg.value_size) h->setValue(_key, make_value());
+		_links.push_back(h);
+	}
+
+	for (size_t i = 0; i < _cfg.num_hubs; i++)
+	{
+		Handle hub = _as.add_node(CONCEPT_NODE, "bench hub " + std::to_string(i));
+		_hubs.push_back(hub);
+		for (size_t j = 0; j < _cfg.hub_degree; j++)
+			_links.push_back(_as.add_link(INHERITANCE_LINK,
+			                              HandleSeq({hub, random_node()})));
+	}
+}
+
+/// Time `fn` on each of the handles, one at a time.
+void Bench::time_each(BenchResult& res, const HandleSeq& hs,
+                      const std::function<void(const Handle&)>& fn)
+{
+	auto start = Clock::now();
+	for (const Handle& h : hs)
+	{
+		auto t0 = Clock::now();
+		fn(h);
+		res.usecs.push_back(std::chrono::duration<double, std::micro>(
+			Clock::now() - t0).count());
+	}
+	res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	res.ops = hs.size();
+	fprintf(stderr, "ipfs-bench: %-16s %8zu ops %10.1f ops/sec  p50=%.0f p99=%.0f usec\n",
+	        res.name.c_str(), res.ops, res.ops / res.seconds,
+	        res.percentile(0.5), res.percentile(0.99));
+	_results.push_back(res);
+}
+
+void Bench::run(void)
+{
+	IPFSAtomStorage* store = new IPFSAtomStorage(_uri);
+
+	// Synchronous single-atom stores, of links with everything under
+	// them. This also populates the AtomSpace for what follows.
+	if (wanted("storeAtom"))
+	{
+		BenchResult res;
+		res.name = "storeAtom";
+		time_each(res, sample(_links, _cfg.num_ops),
+			[&](const Handle& h) { store->storeAtom(h, true); });
+	}
+
+	// Bulk store of everything.
+	std::string cid;
+	{
+		BenchResult res;
+		res.name = "storeAtomSpace";
+		auto start = Clock::now();
+		store->storeAtomSpace(_as.get_atomtable());
+		res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		res.ops = _as.get_size();
+		cid = store->get_ipfs_cid();
+		if (wanted("storeAtomSpace"))
+		{
+			fprintf(stderr, "ipfs-bench: %-16s %8zu atoms %10.1f atoms/sec\n",
+			        res.name.c_str(), res.ops, res.ops / res.seconds);
+			_results.push_back(res);
+		}
+	}
+
+	if (wanted("load_atomspace"))
+	{
+		BenchResult res;
+		res.name = "load_atomspace";
+		AtomSpace las;
+		auto start = Clock::now();
+		store->load_atomspace(&las, cid);
+		res.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		res.ops = las.get_size();
+		fprintf(stderr, "ipfs-bench: %-16s %8zu atoms %10.1f atoms/sec\n",
+		        res.name.c_str(), res.ops, res.ops / res.seconds);
+		_results.push_back(res);
+	}
+
+	if (wanted("getNode"))
+	{
+		BenchResult res;
+		res.name = "getNode";
+		time_each(res, sample(_nodes, _cfg.num_ops), [&](const Handle& h) {
+			store->getNode(h->get_type(), h->get_name().c_str()); });
+	}
+
+	if (wanted("getIncomingSet"))
+	{
+		BenchResult res;
+		res.name = "getIncomingSet";
+		HandleSeq targets(_hubs);
+		HandleSeq more(sample(_nodes, _cfg.num_ops));
+		targets.insert(targets.end(), more.begin(), more.end());
+		time_each(res, targets, [&](const Handle& h) {
+			AtomSpace tas;
+			store->getIncomingSet(tas.get_atomtable(), h); });
+	}
+
+	if (wanted("loadType"))
+	{
+		BenchResult res;
+		res.name = "loadType";
+		HandleSeq proto({_nodes[0]});
+		if (0 < _links.size()) proto.push_back(_links[0]);
+		time_each(res, proto, [&](const Handle& h) {
+			AtomSpace tas;
+			store->loadType(tas.get_atomtable(), h->get_type()); });
+	}
+
+	if (wanted("valueUpdate"))
+	{
+		BenchResult res;
+		res.name = "valueUpdate";
+		std::uniform_real_distribution<double> tvdist(0.0, 1.0);
+		time_each(res, sample(_nodes, _cfg.num_ops), [&](const Handle& h) {
+			if (0 < _cfg.value_size) h->setValue(_key, make_value());
+			else h->setTruthValue(SimpleTruthValue::createTV(
+				tvdist(_rng), tvdist(_rng)));
+			store->storeAtom(h, true); });
+	}
+
+	if (wanted("removeAtom"))
+	{
+		// Links don't have incoming sets, so this is a plain,
+		// non-recursive removal.
+		BenchResult res;
+		res.name = "removeAtom";
+		time_each(res, sample(_links, _cfg.num_ops), [&](const Handle& h) {
+			store->removeAtom(h, false); });
+	}
+
+	if (wanted("removeHub") and 0 < _hubs.size())
+	{
+		BenchResult res;
+		res.name = "removeHub";
+		time_each(res, HandleSeq({_hubs.back()}), [&](const Handle& h) {
+			store->removeAtom(h, true); });
+	}
+
+	delete store;
+}
+
+void Bench::report(void)
+{
+	ipfs::Json jcfg;
+	jcfg["uri"] = _cfg.uri.size() ? _cfg.uri : "mock";
+	jcfg["nodes"] = _cfg.num_nodes;
+	jcfg["links"] = _cfg.num_links;
+	jcfg["arity"] = _cfg.arity;
+	jcfg["hubs"] = _cfg.num_hubs;
+	jcfg["hub_degree"] = _cfg.hub_degree;
+	jcfg["value_size"] = _cfg.value_size;
+	jcfg["ops"] = _cfg.num_ops;
+	jcfg["seed"] = _cfg.seed;
+	if (0 < _mocks.size())
+	{
+		jcfg["daemons"] = _mocks.size();
+		jcfg["mock_latency_usec"] = _cfg.mock.latency_usec;
+		jcfg["mock_jitter_usec"] = _cfg.mock.jitter_usec;
+		jcfg["mock_failure_rate"] = _cfg.mock.failure_rate;
+	}
+
+	ipfs::Json jres = ipfs::Json::array();
+	for (BenchResult& res : _results)
+		jres.push_back(res.to_json());
+
+	ipfs::Json out;
+	out["config"] = jcfg;
+	out["results"] = jres;
+	if (0 < _mocks.size())
+	{
+		// Totals over all of the daemons, and then each one's share.
+		size_t requests = 0, bytes_in = 0, bytes_out = 0;
+		ipfs::Json each = ipfs::Json::array();
+		for (MockIPFSDaemon* mock : _mocks)
+		{
+			requests += mock->_num_requests;
+			bytes_in += mock->_bytes_in;
+			bytes_out += mock->_bytes_out;
+			each.push_back({{"requests", (size_t) mock->_num_requests},
+			                {"bytes_in", (size_t) mock->_bytes_in},
+			                {"bytes_out", (size_t) mock->_bytes_out}});
+		}
+		out["daemon"] = {{"requests", requests},
+		                 {"bytes_in", bytes_in},
+		                 {"bytes_out", bytes_out}};
+		if (1 < _mocks.size()) out["daemons"] = each;
+	}
+
+	if ("-" == _cfg.output)
+	{
+		std::cout << out.dump(2) << std::endl;
+		return;
+	}
+	std::ofstream ofs(_cfg.output);
+	ofs << out.dump(2) << std::endl;
+	fprintf(stderr, "ipfs-bench: results written to %s\n", _cfg.output.c_str());
+}
+
+/* ================================================================ */
+
+static void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -u, --uri URI          Use this IPFS daemon and key; default is\n"
+		"                         to run against the in-process mock daemon.\n"
+		"  -o, --output FILE      Write json results to FILE (- for stdout).\n"
+		"  -b, --only LIST        Comma-separated list of benchmarks to run:\n"
+		"                         storeAtom,storeAtomSpace,load_atomspace,\n"
+		"                         getNode,getIncomingSet,loadType,\n"
+		"                         valueUpdate,removeAtom,removeHub\n"
+		"  -n, --nodes N          Number of nodes (default 1000).\n"
+		"  -k, --links N          Number of plain links (default 1000).\n"
+		"  -a, --arity N          Arity of plain links (default 2).\n"
+		"  -H, --hubs N           Number of hub nodes (default 4).\n"
+		"  -d, --hub-degree N     Incoming-set size of each hub (default 100).\n"
+		"  -v, --value-size N     Floats per FloatValue; 0 for TV only.\n"
+		"  -p, --ops N            Ops per per-op benchmark (default 200).\n"
+		"  -s, --seed N           Random seed (default 42).\n"
+		"  -l, --latency USEC     Mock daemon per-request latency.\n"
+		"  -j, --jitter USEC      Mock daemon random extra latency.\n"
+		"  -f, --fail RATE        Mock daemon failure rate.\n"
+		"  -D, --daemons N        Split the AtomSpace across N mock daemons\n"
+		"                         (default 1).\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+	static struct option long_opts[] = {
+		{"uri", required_argument, 0, 'u'},
+		{"output", required_argument, 0, 'o'},
+		{"only", required_argument, 0, 'b'},
+		{"nodes", required_argument, 0, 'n'},
+		{"links", required_argument, 0, 'k'},
+		{"arity", required_argument, 0, 'a'},
+		{"hubs", required_argument, 0, 'H'},
+		{"hub-degree", required_argument, 0, 'd'},
+		{"value-size", required_argument, 0, 'v'},
+		{"ops", required_argument, 0, 'p'},
+		{"seed", required_argument, 0, 's'},
+		{"latency", required_argument, 0, 'l'},
+		{"jitter", required_argument, 0, 'j'},
+		{"fail", required_argument, 0, 'f'},
+		{"daemons", required_argument, 0, 'D'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	BenchConfig cfg;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "u:o:b:n:k:a:H:d:v:p:s:l:j:f:D:h",
+	                          long_opts, nullptr)) != -1)
+	{
+		switch (opt)
+		{
+			case 'u': cfg.uri = optarg; break;
+			case 'o': cfg.output = optarg; break;
+			case 'b': cfg.only = optarg; break;
+			case 'n': cfg.num_nodes = atol(optarg); break;
+			case 'k': cfg.num_links = atol(optarg); break;
+			case 'a': cfg.arity = atol(optarg); break;
+			case 'H': cfg.num_hubs = atol(optarg); break;
+			case 'd': cfg.hub_degree = atol(optarg); break;
+			case 'v': cfg.value_size = atol(optarg); break;
+			case 'p': cfg.num_ops = atol(optarg); break;
+			case 's': cfg.seed = atoi(optarg); break;
+			case 'l': cfg.mock.latency_usec = atoi(optarg); break;
+			case 'j': cfg.mock.jitter_usec = atoi(optarg); break;
+			case 'f': cfg.mock.failure_rate = atof(optarg); break;
+			case 'D': cfg.num_daemons = atol(optarg); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (0 == cfg.num_nodes or 0 == cfg.arity or 0 == cfg.num_daemons)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	cfg.mock.seed = cfg.seed;
+
+	Bench bench(cfg);
+	bench.generate();
+	bench.run();
+	bench.report();
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * IPFSAsync.cc
+ * Future-returning versions of the fetch and store calls.
+ *
+ * The blocking calls tie up the calling thread for a whole round-trip
+ * to the daemon. The calls here return at once, with a std::future.
+ * Fetches are run by a small, fixed pool of threads, started on first
+ * use; any number of them may be outstanding, and they wait their
+ * turn in a queue. Stores go into the write queue, exactly as an
+ * asynchronous `storeAtom()` does, and their futures are made ready
+ * by the writer that stores them; no thread waits on them at all.
+ *
+ * The daemon client is blocking, so each fetch in progress still
+ * occupies one pool thread; the pool size bounds how many fetches are
+ * in flight at once, not how many are outstanding.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <opencog/atomspace/AtomSpace.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+
+/// Queue a job for the pool, starting the pool, if need be.
+void IPFSAtomStorage::submit_job(std::function<void(void)> job)
+{
+	{
+		std::lock_guard<std::mutex> lck(_job_mutex);
+		if (_jobs_stop)
+			throw RuntimeException(TRACE_INFO,
+				"Cannot queue a job: %s is closing", _uri.c_str());
+		_jobs.push_back(std::move(job));
+		while (_job_threads.size() < _async_threads)
+			_job_threads.push_back(std::thread(&job_thread, this));
+	}
+	_num_jobs_submitted++;
+	_job_cv.notify_one();
+}
+
+/// Run jobs until told to stop, and the queue is empty.
+void IPFSAtomStorage::job_thread(IPFSAtomStorage* self)
+{
+	while (true)
+	{
+		std::function<void(void)> job;
+		{
+			std::unique_lock<std::mutex> lck(self->_job_mutex);
+			self->_job_cv.wait(lck, [&] {
+				return self->_jobs_stop or 0 < self->_jobs.size(); });
+			if (0 == self->_jobs.size()) return;
+			job = std::move(self->_jobs.front());
+			self->_jobs.pop_front();
+		}
+
+		// Jobs are packaged tasks; their exceptions go to the future.
+		job();
+		self->_num_jobs_done++;
+	}
+}
+
+/// Finish the queued jobs, and stop the pool.
+void IPFSAtomStorage::stop_jobs(void)
+{
+	{
+		std::lock_guard<std::mutex> lck(_job_mutex);
+		_jobs_stop = true;
+	}
+	_job_cv.notify_all();
+	for (std::thread& t : _job_threads) t.join();
+	_job_threads.clear();
+}
+
+/// Run `fn` in the pool, returning its result through a future.
+template<typename T>
+std::future<T> IPFSAtomStorage::run_async(std::function<T(void)> fn)
+{
+	auto task = std::make_shared<std::packaged_task<T(void)>>(std::move(fn));
+	std::future<T> fut = task->get_future();
+	submit_job([task](void) { (*task)(); });
+	return fut;
+}
+
+/* ================================================================ */
+
+/// The future version of `fetch_atom()`.
+std::future<Handle> IPFSAtomStorage::fetch_atom_async(const std::string& cid)
+{
+	return run_async<Handle>([this, cid](void) { return fetch_atom(cid); });
+}
+
+/// The future version of `getNode()` and `getLink()`. The future holds
+/// the Atom, with its Values, or the undefined handle, if the Atom is
+/// not in the AtomSpace.
+std::future<Handle> IPFSAtomStorage::get_atom_async(const Handle& h)
+{
+	return run_async<Handle>([this, h](void) {
+		if (h->is_node())
+			return getNode(h->get_type(), h->get_name().c_str());
+		return getLink(h->get_type(), h->getOutgoingSet());
+	});
+}
+
+/// The future version of `getIncomingSet()`.
+std::future<HandleSeq> IPFSAtomStorage::get_incoming_async(const Handle& h)
+{
+	return run_async<HandleSeq>([this, h](void) {
+		return fetch_incoming_set(h); });
+}
+
+/// Queue the Atom for storage, in the calling thread's lane, exactly
+/// as `storeAtom(h)` does. The future becomes ready once the Atom and
+/// its Values have been stored; if the store fails, it holds the
+/// error. (The error is also reported by the next blocking call, as
+/// with any other asynchronous store.)
+std::future<void> IPFSAtomStorage::store_atom_async(const Handle& h)
+{
+	std::promise<void> done;
+	std::future<void> fut = done.get_future();
+	enqueue_store(h, _thread_lane, &done);
+	return fut;
+}
+
+/* ============================= END OF FILE ================= */
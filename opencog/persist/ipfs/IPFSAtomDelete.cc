@@ -2,6 +2,21 @@
  * IPFSAtomDelete.cc
  * Deletion of individual atoms.
  *
+ * A recursive delete is done as a batch. First, the full set of Atoms
+ * to be removed (the Atom, and everything that holds it, recursively)
+ * is worked out. Then the incoming set of each surviving Atom that
+ * some doomed Link points at is edited, once, no matter how many of
+ * its holders are going away. Finally, the AtomSpace directory is
+ * edited, dropping every doomed entry, and re-pointing the entries of
+ * the edited survivors. Deleting a hub with many holders thus costs
+ * one `dag put` per surviving neighbor, plus one directory get and
+ * put, instead of a patch per Atom. Getting and putting the directory
+ * moves all of it, though; small batches, such as the removal of a
+ * single Atom, are cheaper as a few patches, and are done that way.
+ *
+ * The caches are only updated once the directory has been edited;
+ * if that fails, they are left to agree with the old directory.
+ *
  * Copyright (c) 2017,2019 Linas Vepstas <linas@linas.org>
  * SPDX-License-Identifier: AGPL-3.0-or-later
  */
@@ -10,6 +25,7 @@
 
 #include <opencog/atoms/base/Atom.h>
 #include <opencog/atomspace/AtomSpace.h>
+#include <opencog/util/Logger.h>
 
 #include "IPFSAtomStorage.h"
 
@@ -22,110 +38,319 @@ using namespace opencog;
 ///
 void IPFSAtomStorage::removeAtom(const Handle& h, bool recursive)
 {
-	// Synchronize. The atom that we are deleting might be sitting
-	// in the store queue.
-	flushStoreQueue();
+	check_writable("remove atoms");
 
-	ipfs::Json jatom;
-	{
-		std::lock_guard<std::mutex> lck(_json_mutex);
-		const auto& ptr = _json_map.find(h);
-		// If might be not found, because it had never been
-		// stored before. This is not an error.
-		if (_json_map.end() == ptr) return;
+	TraceSpan span(_tracer, "removeAtom", "atom", h);
+
+	// Synchronize. The atom that we are deleting, or something
+	// holding it, might be sitting in the store queue. Other atoms
+	// in the queue don't matter.
+	fence(h);
+
+	_num_atom_removes++;
+
+	Removal rm;
+	if (not removal_closure(h, recursive, rm)) return;
 
-		jatom = ptr->second;
+	// Edit the incoming sets of the survivors, then drop everything
+	// in one go.
+	strip_incoming(rm);
+	try
+	{
+		rewrite_directory(rm);
+	}
+	catch (...)
+	{
+		// The survivors were put anew, but the directory still points
+		// at their old blocks; forget the new ones.
+		{
+			std::lock_guard<std::mutex> lck(_json_mutex);
+			for (const Handle& atom : rm.stripped) _json_map.erase(atom);
+		}
+		std::lock_guard<std::mutex> lck(_atom_cid_mutex);
+		for (const Handle& atom : rm.stripped) _atom_cid_map.erase(atom);
+		throw;
 	}
+	forget_removed(rm);
+
+	_num_atom_deletes += rm.doomed.size();
+}
+
+/// Find the Atom, and, if recursive, everything that holds it,
+/// directly or indirectly. Return false if the Atom was never stored,
+/// or if it has a non-empty incoming set, and the delete is not
+/// recursive.
+bool IPFSAtomStorage::removal_closure(const Handle& h, bool recursive,
+                                      Removal& rm)
+{
+	TraceSpan span(_tracer, "removal_closure", "atom", h);
 
-	auto pinc = jatom.find("incoming");
-	if (jatom.end() != pinc)
+	HandleSeq& doomed = rm.doomed;
+	doomed.push_back(h);
+	rm.gone.insert(h);
+
+	// Breadth-first; the list grows as holders are found.
+	for (size_t i = 0; i < doomed.size(); i++)
 	{
-		auto iset = *pinc; // iset = jatom["incoming"];
+		Handle atom(doomed[i]);
+		ipfs::Json jatom;
+		{
+			std::lock_guard<std::mutex> lck(_json_mutex);
+			const auto& ptr = _json_map.find(atom);
+			if (_json_map.end() != ptr) jatom = ptr->second;
+		}
+
+		// It might be not found, because it had never been
+		// stored before. This is not an error.
+		if (jatom.is_null())
+		{
+			if (0 == i) return false;
+			jatom = get_atom_json(atom);
+		}
+
+		auto pinc = jatom.find("incoming");
+		if (jatom.end() == pinc) continue;
 
 		// Fail if a non-trivial incoming set.
-		if (not recursive and 0 < iset.size()) return;
+		if (not recursive and 0 < pinc->size()) return false;
 
-		// We're recursive; so recurse.
-		for (auto guid: iset)
+		for (const std::string& guid : incoming_guids(*pinc))
 		{
 			// Given only the GUID of the atom, get the handle.
-			// Use the cache, if possible.
-			Handle hin;
+			// Use the cache, if possible. The holder might have been
+			// stored by some other process, so the GUID is kept; it
+			// might not be in the GUID map.
+			Handle hin(guid_to_atom(guid));
+			if (rm.gone.insert(hin).second)
 			{
-				std::lock_guard<std::mutex> lck(_inv_mutex);
-				auto inp = _guid_inv_map.find(guid);
-				if (_guid_inv_map.end() == inp)
-				{
-std::cout << "Quasi-error: expected to find atom but did not!" << std::endl;
-					hin = fetch_atom(guid);
-				}
-				else
-				{
-					hin = inp->second;
-				}
+				doomed.push_back(hin);
+				rm.guids.emplace(hin, guid);
 			}
-			removeAtom(hin, true);
 		}
 	}
+	return true;
+}
+
+/// Remove the doomed Links from the incoming sets of the Atoms that
+/// they hold, which are not themselves doomed. Each such survivor is
+/// rewritten once; its new CID is placed in `rm.relink`, keyed by its
+/// directory entry name.
+void IPFSAtomStorage::strip_incoming(Removal& rm)
+{
+	TraceSpan span(_tracer, "strip_incoming", "atom");
+
+	// Collect the holders to strip, per survivor.
+	std::map<Handle, std::set<std::string>> strip;
+	for (const Handle& h : rm.doomed)
+	{
+		if (not h->is_link()) continue;
+
+		// Only the Atom being removed can be missing here; it was
+		// found in the JSON cache, so it was stored, or fetched, by
+		// this instance.
+		auto pguid = rm.guids.find(h);
+		std::string acid = (rm.guids.end() != pguid) ?
+			pguid->second : get_atom_guid(h);
+		for (const Handle& hoth : h->getOutgoingSet())
+			if (0 == rm.gone.count(hoth))
+				strip[hoth].insert(acid);
+	}
 
-	// Remove this atom from the incoming sets of those that
-	// it contains.
-	if (h->is_link())
+	for (const auto& pr : strip)
 	{
-		std::string acid;
+		const Handle& atom = pr.first;
+
+		// Twiddle the incoming set, working out of the cache if
+		// possible. The edit must be atomic, since there may be
+		// other threads racing with us.
+		ipfs::Json jatom;
 		{
-			std::lock_guard<std::mutex> lck(_guid_mutex);
-			auto pcid = _guid_map.find(h);
-			if (_guid_map.end() == pcid)
+			std::lock_guard<std::mutex> lck(_json_mutex);
+			auto patom = _json_map.find(atom);
+			if (_json_map.end() == patom)
+				jatom = get_atom_json(atom);
+			else
+				jatom = patom->second; // jatom = _json_map[atom];
+
+			auto pinco = jatom.find("incoming");
+			if (jatom.end() == pinco)
 				throw RuntimeException(TRACE_INFO,
-					"Error: missing CID for %s", h->to_string().c_str());
-			acid = pcid->second; // acid = _guid_map[h];
+					"Error: Atom is missing incoming set! WTF!?\n");
+
+			// Convert an old-style incoming set, while we're here.
+			ipfs::Json inco = typed_incoming(*pinco);
+			ipfs::Json kept = ipfs::Json::object();
+			for (auto bucket = inco.begin(); bucket != inco.end(); bucket++)
+			{
+				ipfs::Json guids = ipfs::Json::array();
+				for (const ipfs::Json& guid : bucket.value())
+					if (0 == pr.second.count(guid.get<std::string>()))
+						guids.push_back(guid);
+				if (0 < guids.size()) kept[bucket.key()] = guids;
+			}
+			if (0 < kept.size())
+				jatom["incoming"] = kept;
+			else
+				jatom.erase("incoming");
+			_json_map[atom] = jatom;
+		}
+
+		std::string label(encodeAtomToStr(atom));
+		std::string atoid = dag_put(jatom, atom_shard(label));
+		rm.stripped.push_back(atom);
+		rm.relink[label] = atoid;
+		{
+			// As in update_atom_in_atomspace(): if we've linked it
+			// before, it's already in the directory.
+			std::lock_guard<std::mutex> lck(_atom_cid_mutex);
+			auto pcid = _atom_cid_map.find(atom);
+			if (_atom_cid_map.end() == pcid)
+			{
+				rm.fresh.insert(label);
+				_atom_cid_map.emplace(atom, IPFSCid(atoid));
+			}
+			else pcid->second = IPFSCid(atoid);
+		}
+	}
+}
+
+/// Drop the doomed Atoms from the AtomSpace directory, re-pointing
+/// the entries of the edited survivors at their new CIDs.
+void IPFSAtomStorage::rewrite_directory(const Removal& rm)
+{
+	TraceSpan span(_tracer, "rewrite_directory", "atom");
+
+	std::set<std::string> names;
+	for (const Handle& h : rm.doomed)
+		names.insert(encodeAtomToStr(h));
+
+	if (not sharded())
+	{
+		// The directory must not change between the get and the put;
+		// all other edits also hold this lock.
+		std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
+		_atomspace_cid = rewrite_links(_atomspace_cid, 0, names,
+		                               rm.relink, rm.fresh);
+	}
+	else
+	{
+		// Each shard's directory is rewritten under its own lock,
+		// dropping and re-pointing just the entries that it holds.
+		std::vector<std::set<std::string>> snames(_shards.size());
+		std::vector<std::map<std::string, std::string>> srelink(_shards.size());
+		for (const std::string& name : names)
+			snames[atom_shard(name)].insert(name);
+		for (const auto& pr : rm.relink)
+			srelink[atom_shard(pr.first)].insert(pr);
+
+		for (size_t s = 0; s < _shards.size(); s++)
+		{
+			if (0 == snames[s].size() and 0 == srelink[s].size()) continue;
+			Shard& sh = *_shards[s];
+			std::lock_guard<std::mutex> lck(sh.dir_mutex);
+			sh.dir_cid = rewrite_links(sh.dir_cid, s, snames[s], srelink[s],
+			                           rm.fresh);
 		}
-		for (const Handle& hoth: h->getOutgoingSet())
-			remove_incoming_of(hoth, acid);
+		_root_stale = true;
 	}
 
-	// Drop the atom from out caches
+	logger().debug("Removed %zu atoms\n", names.size());
+}
+
+/// Drop the removed Atoms from the caches. Only once the directory
+/// no longer lists them; until then, they are still there.
+void IPFSAtomStorage::forget_removed(const Removal& rm)
+{
 	{
 		std::lock_guard<std::mutex> lck(_json_mutex);
-		_json_map.erase(h);
+		for (const Handle& h : rm.doomed) _json_map.erase(h);
 	}
+	forget_stored_values(rm.doomed);
 	{
 		std::lock_guard<std::mutex> lck(_guid_mutex);
-		_guid_map.erase(h);
+		for (const Handle& h : rm.doomed) _guid_map.erase(h);
+	}
+	std::lock_guard<std::mutex> lck(_atom_cid_mutex);
+	for (const Handle& h : rm.doomed) _atom_cid_map.erase(h);
+}
+
+// Batches of up to this many directory edits are made as patches,
+// which send only the names and CIDs; bigger ones get and put the
+// whole directory, once.
+#define PATCH_BATCH 32
+
+/// Edit the directory `dir_cid`, on `shard`, dropping the entries in
+/// `names`, and re-pointing the entries in `relink` at their new CIDs,
+/// and update the filter to match. Return the CID of the new
+/// directory. Called with the lock on the directory held. The entries
+/// in `fresh` are known not to be linked yet.
+std::string IPFSAtomStorage::rewrite_links(const std::string& dir_cid,
+                       size_t shard,
+                       const std::set<std::string>& names,
+                       const std::map<std::string, std::string>& relink,
+                       const std::set<std::string>& fresh)
+{
+	if (names.size() + relink.size() <= PATCH_BATCH)
+	{
+		// Removing a link that is not there fails, leaving the
+		// directory as it was.
+		std::string new_dir = dir_cid;
+		for (const std::string& name : names)
+			new_dir = patch_rm_link(new_dir, name, shard);
+		for (const auto& pr : relink)
+			new_dir = patch_add_link(new_dir, pr.first, pr.second, shard);
+
+		for (const std::string& name : names)
+			filter_remove(name);
+		for (const auto& pr : relink)
+			if (fresh.count(pr.first)) filter_add(pr.first);
+		return new_dir;
 	}
 
-	// Now actually remove.
-	std::string new_as_id;
-	ipfs::Client* conn = conn_pool.pop();
+	ipfs::Json dir = object_get(dir_cid, shard);
+
+	ipfs::Json links = ipfs::Json::array();
+	std::set<std::string> relinked;
+	size_t removed = 0;
+	for (ipfs::Json& lnk : dir["Links"])
 	{
-		std::string name = h->to_short_string();
-		try
+		std::string name = lnk["Name"];
+		if (names.count(name))
 		{
-			// Update the cid under a lock, as atomspace modifications
-			// can occur from multiple threads.  It's not actually the
-			// cid that matters, its the patch itself.
-			std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
-			conn->ObjectPatchRmLink(_atomspace_cid, name, &new_as_id);
-			_atomspace_cid = new_as_id;
+			removed++;
+			continue;
 		}
-		catch (const std::exception& ex)
+		auto prl = relink.find(name);
+		if (relink.end() != prl)
 		{
-			std::cout << "Error: Atomspace " << _atomspace_cid
-			          << " does not contain " << name << std::endl;
-
-			conn_pool.push(conn);
-			throw RuntimeException(TRACE_INFO,
-				"Error: Atomspace did not contain atom; how did that happen?\n");
+			lnk["Hash"] = prl->second;
+			relinked.insert(name);
 		}
-		std::cout << "Atomspace after removal of " << name
-		          << " is " << _atomspace_cid << std::endl;
+		links.push_back(lnk);
 	}
-	conn_pool.push(conn);
 
-	// Bug with stats: should not increment on recursion.
-	_num_atom_deletes++;
-	_num_atom_removes++;
+	if (removed != names.size())
+		throw RuntimeException(TRACE_INFO,
+			"Error: Atomspace %s is missing %zu of the %zu atoms being removed",
+			dir_cid.c_str(), names.size() - removed, names.size());
+
+	// A survivor that was never linked into the directory gets
+	// an entry now, as update_atom_in_atomspace() would have made.
+	for (const auto& pr : relink)
+		if (0 == relinked.count(pr.first))
+			links.push_back({{"Name", pr.first}, {"Hash", pr.second},
+			                 {"Size", 0}});
+
+	dir["Links"] = links;
+	std::string new_dir = object_put(dir, shard);
+
+	for (const std::string& name : names)
+		filter_remove(name);
+	for (const auto& pr : relink)
+		if (0 == relinked.count(pr.first))
+			filter_add(pr.first);
+
+	return new_dir;
 }
 
 /* ============================= END OF FILE ================= */
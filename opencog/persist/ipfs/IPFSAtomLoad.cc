@@ -9,6 +9,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <map>
+#include <set>
+#include <thread>
+
 #include <opencog/atoms/base/Atom.h>
 #include <opencog/atoms/atom_types/NameServer.h>
 #include <opencog/atoms/base/Link.h>
@@ -19,24 +23,135 @@
 
 using namespace opencog;
 
+// Most threads used by fetchAtoms(), per daemon; they share the
+// connection pool with everything else.
+#define NUM_FETCH_THREADS 8
+
+// fetchAtoms() reads the whole AtomSpace directory only for batches
+// of at least one Atom in this many.
+#define LIST_FRACTION 10
+
 /* ================================================================ */
 
+/// Outgoing sets hold either bare GUIDs, or IPLD links to them.
+static const std::string& outgoing_guid(const ipfs::Json& jout)
+{
+	if (jout.is_string()) return jout.get_ref<const std::string&>();
+	return jout["/"].get_ref<const std::string&>();
+}
+
 /// Fetch the indicated atom from the IPFS CID.
 /// This will return the raw JSON representation.
 ipfs::Json IPFSAtomStorage::fetch_atom_dag(const std::string& cid)
 {
 	rethrow();
 
+	TraceSpan span(_tracer, "fetch_atom_dag", "atom", cid);
+	if (_read_only) return snapshot_fetch(cid);
+
+	// Blocks never change; any AtomSpace on this daemon might have
+	// fetched this one already.
 	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagGet(cid, &dag);
-	conn_pool.push(conn);
+	if (_shared->get_block(cid, dag))
+	{
+		_num_shared_block_hits++;
+		return dag;
+	}
+	_num_shared_block_misses++;
+
+	dag = dag_get(cid);
 	_num_get_atoms++;
+	_shared->put_block(cid, dag);
 
 	// std::cout << "Fetched the DAG:" << dag.dump(2) << std::endl;
 	return dag;
 }
 
+/// Fetch many blocks, concurrently.
+void IPFSAtomStorage::fetch_atom_dags(const std::vector<std::string>& cids,
+                                      std::vector<ipfs::Json>& dags)
+{
+	dags.resize(cids.size());
+	fetch_concurrently(cids.size(), [&](size_t j) {
+		dags[j] = fetch_atom_dag(cids[j]); });
+}
+
+/// Call `fetch(j)` for each `j` below `n`, concurrently. The daemon
+/// calls share the connection pool with everything else. The first
+/// error, if any, is thrown once all of the calls are done.
+void IPFSAtomStorage::fetch_concurrently(size_t n,
+                        const std::function<void(size_t)>& fetch)
+{
+	std::vector<std::exception_ptr> errs(n);
+	std::atomic<size_t> next(0);
+	auto worker = [&](void)
+	{
+		for (size_t j = next++; j < n; j = next++)
+		{
+			try
+			{
+				fetch(j);
+			}
+			catch (...)
+			{
+				errs[j] = std::current_exception();
+			}
+		}
+	};
+
+	size_t nthreads = std::min(n, NUM_FETCH_THREADS * _shards.size());
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < nthreads; t++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (std::thread& t : threads) t.join();
+
+	for (const std::exception_ptr& ep : errs)
+		if (ep) std::rethrow_exception(ep);
+}
+
+/// Pull the entire outgoing closure of the Atom into the block cache,
+/// one level at a time, with all of the blocks on a level fetched
+/// concurrently. Decoding the Atom afterwards needs no further trips
+/// to the daemon; without this, each Atom in the closure would be
+/// fetched in turn. Atoms that are already known are not descended.
+void IPFSAtomStorage::prefetch_outgoing(const ipfs::Json& dag)
+{
+	auto pout = dag.find("outgoing");
+	if (dag.end() == pout) return;
+
+	TraceSpan span(_tracer, "prefetch_outgoing", "bulk");
+	_num_closure_prefetches++;
+
+	std::set<std::string> seen;
+	std::vector<std::string> level;
+	auto add_level = [&](const ipfs::Json& oset)
+	{
+		for (const ipfs::Json& jout : oset)
+		{
+			const std::string& guid = outgoing_guid(jout);
+			if (0 < _shared->get_name(IPFSCid(guid)).size()) continue;
+			if (seen.insert(guid).second) level.push_back(guid);
+		}
+	};
+	add_level(*pout);
+
+	while (0 < level.size())
+	{
+		_num_closure_rounds++;
+		_num_closure_blocks += level.size();
+		std::vector<ipfs::Json> dags;
+		fetch_atom_dags(level, dags);
+
+		level.clear();
+		for (const ipfs::Json& child : dags)
+		{
+			auto cpout = child.find("outgoing");
+			if (child.end() != cpout) add_level(*cpout);
+		}
+	}
+}
+
 /* ================================================================ */
 
 /// Fetch the indicated atom from the IPFS CID.
@@ -44,6 +159,13 @@ ipfs::Json IPFSAtomStorage::fetch_atom_dag(const std::string& cid)
 Handle IPFSAtomStorage::fetch_atom(const std::string& cid)
 {
 	ipfs::Json dag(fetch_atom_dag(cid));
+	prefetch_outgoing(dag);
+	return decode_atom_dag(dag);
+}
+
+/// Decode a fetched block, values and all.
+Handle IPFSAtomStorage::decode_atom_dag(const ipfs::Json& dag)
+{
 	Handle h(decodeJSONAtom(dag));
 	get_atom_values(h, dag);
 
@@ -79,27 +201,33 @@ Handle IPFSAtomStorage::decodeJSONAtom(const ipfs::Json& atom)
 	// for the atom (i.e. the atom without values on it) and
 	// never the CID (the atom with values on it).
 	HandleSeq oset;
-	for (const std::string& guid: atom["outgoing"])
-	{
-		// This is multi-threaded; access under a lock
-		std::unique_lock<std::mutex> lck(_inv_mutex);
-		auto hiter = _guid_inv_map.find(guid);
-		lck.unlock();
-		if (_guid_inv_map.end() == hiter)
-		{
-			Handle hout(fetch_atom(guid));
-			oset.push_back(hout);
-			std::lock_guard<std::mutex> lck(_inv_mutex);
-			_guid_inv_map.insert({guid, hout});
-		}
-		else
-			oset.push_back(hiter->second);
-	}
+	for (const ipfs::Json& jout: atom["outgoing"])
+		oset.push_back(guid_to_atom(outgoing_guid(jout)));
 
 	_num_got_links ++;
 	return createLink(oset, t);
 }
 
+/// Return the Atom with the given GUID; fetch it, if no AtomSpace on
+/// this daemon has seen it yet. Otherwise, it is made from its name.
+Handle IPFSAtomStorage::guid_to_atom(const std::string& guid)
+{
+	IPFSCid gcid(guid);
+	std::string label(_shared->get_name(gcid));
+	if (0 < label.size()) return decodeStrAtom(label);
+
+	Handle h;
+	// Called while decoding; the closure has been prefetched already.
+	// The block itself says how its outgoing set is written.
+	ipfs::Json dag(fetch_atom_dag(guid));
+	h = decode_atom_dag(dag);
+	auto pout = dag.find("outgoing");
+	bool links = dag.end() != pout and 0 < pout->size() and
+		pout->front().is_object();
+	_shared->record_guid(encodeAtomToStr(h), links, gcid);
+	return h;
+}
+
 /// Convert a scheme expression into a C++ Atom.
 /// For example: `(Concept "foobar")`  or
 /// `(Evaluation (Predicate "blort") (List (Concept "foo") (Concept "bar")))`
@@ -166,15 +294,17 @@ std::string IPFSAtomStorage::encodeValueToStr(const ValuePtr& v)
 		// form of the value, as compared to SimpleTruthValue, which
 		// only prints 6 digits and breaks the unit tests.
 		FloatValuePtr fv(FloatValueCast(v));
-		return fv->FloatValue::to_string();
+		return compress_value(fv->FloatValue::to_string());
 	}
-	return v->to_short_string();
+	return compress_value(v->to_short_string());
 }
 
 /* ================================================================ */
 
 Handle IPFSAtomStorage::do_fetch_atom(Handle &h)
 {
+	TraceSpan span(_tracer, "do_fetch_atom", "atom", h);
+
 	ipfs::Json dag = get_atom_json(h);
 
 	if (0 == dag.size())
@@ -194,14 +324,150 @@ Handle IPFSAtomStorage::getNode(Type t, const char * str)
 {
 	rethrow();
 	Handle h(createNode(t, str));
-	return do_fetch_atom(h);
+
+	// Nothing is pending on a snapshot, and its directory is exact.
+	if (_read_only) return do_fetch_atom(h);
+
+	// A store still in the queue is newer than anything in IPFS.
+	Handle hp(pending_lookup(h));
+	if (hp)
+	{
+		_num_overlay_hits++;
+		return hp;
+	}
+	return filtered_fetch(h);
 }
 
 Handle IPFSAtomStorage::getLink(Type t, const HandleSeq& hs)
 {
 	rethrow();
 	Handle h(createLink(hs, t));
-	return do_fetch_atom(h);
+	if (_read_only) return do_fetch_atom(h);
+
+	Handle hp(pending_lookup(h));
+	if (hp)
+	{
+		_num_overlay_hits++;
+		return hp;
+	}
+	return filtered_fetch(h);
+}
+
+/* ================================================================ */
+
+/**
+ * Fetch many Atoms at once, along with their Values. Return a list of
+ * the same length as `hs`: each entry is the (local) Atom, with its
+ * Values filled in, or the undefined handle if it is not in the
+ * AtomSpace.
+ *
+ * Duplicates are fetched only once. Atoms with stores still pending
+ * are answered from the overlay, and those ruled out by the membership
+ * filter are skipped. The rest are fetched concurrently. For a small
+ * batch, each is fetched by its path in the AtomSpace directory; the
+ * daemon resolves the name, and returns the block, in one call. A big
+ * batch finds all of the CIDs with a single read of the directory
+ * (or, for a read-only snapshot, in the table of it), and then
+ * fetches the blocks by CID, through the block cache.
+ */
+HandleSeq IPFSAtomStorage::fetchAtoms(const HandleSeq& hs)
+{
+	rethrow();
+
+	TraceSpan span(_tracer, "fetchAtoms", "bulk");
+	_num_multi_gets++;
+
+	HandleSeq result(hs.size());
+	std::map<std::string, std::vector<size_t>> todo;
+	for (size_t i = 0; i < hs.size(); i++)
+	{
+		const Handle& h = hs[i];
+		if (not _read_only)
+		{
+			Handle hp(pending_lookup(h));
+			if (hp)
+			{
+				_num_overlay_hits++;
+				result[i] = hp;
+				continue;
+			}
+			if (not filter_may_contain(h))
+			{
+				_num_filter_negatives++;
+				continue;
+			}
+		}
+		todo[encodeAtomToStr(h)].push_back(i);
+	}
+	if (0 == todo.size()) return result;
+
+	// The positions in `hs` of each Atom fetched, and its block.
+	std::vector<const std::vector<size_t>*> jobs;
+	std::vector<ipfs::Json> dags;
+	if (not _read_only and resolve_by_path(todo.size()))
+	{
+		// Atoms that are not in the AtomSpace come back empty.
+		for (const auto& pr : todo) jobs.push_back(&pr.second);
+		dags.resize(jobs.size());
+		fetch_concurrently(jobs.size(), [&](size_t j) {
+			dags[j] = get_atom_json(hs[jobs[j]->front()]); });
+	}
+	else
+	{
+		std::vector<std::string> cids;
+		if (_read_only)
+		{
+			for (const auto& pr : todo)
+			{
+				auto it = _snapshot_names.find(pr.first);
+				if (_snapshot_names.end() == it) continue;
+				cids.push_back(it->second->cid);
+				jobs.push_back(&pr.second);
+			}
+		}
+		else
+		{
+			// Resolve all of the names at once.
+			ipfs::Json links = atomspace_links(atomspace_root());
+
+			for (const ipfs::Json& lnk : links)
+			{
+				auto it = todo.find(lnk["Name"]);
+				if (todo.end() == it) continue;
+				cids.push_back(lnk["Cid"]["/"]);
+				jobs.push_back(&it->second);
+			}
+		}
+		fetch_atom_dags(cids, dags);
+	}
+
+	// Fill in the values, on every copy that was asked for.
+	size_t found = 0;
+	for (size_t j = 0; j < jobs.size(); j++)
+	{
+		if (0 == dags[j].size()) continue;
+		found++;
+		for (size_t i : *jobs[j])
+		{
+			Handle h(hs[i]);
+			get_atom_values(h, dags[j]);
+			result[i] = h;
+		}
+	}
+	_num_multi_get_atoms += found;
+	if (_filter_valid) _num_filter_false_positives += todo.size() - found;
+	return result;
+}
+
+/// Whether a batch of `n` Atoms should be fetched by path, rather
+/// than by reading the whole directory. The directory is as big as
+/// the filter says; if there is no filter, it might be any size, so
+/// paths it is.
+bool IPFSAtomStorage::resolve_by_path(size_t n)
+{
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	if (not _filter_valid) return true;
+	return n * LIST_FRACTION < _filter.size();
 }
 
 /* ============================= END OF FILE ================= */
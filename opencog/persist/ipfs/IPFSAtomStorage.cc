@@ -19,6 +19,7 @@
 #include <chrono>
 #include <thread>
 
+#include <opencog/util/Logger.h>
 #include <opencog/atomspace/AtomSpace.h>
 
 #include "IPFSAtomStorage.h"
@@ -28,6 +29,12 @@ using namespace opencog;
 // Number of write-back queues
 #define NUM_WB_QUEUES 6
 
+// Of those, the number serving the bulk lane. The rest serve the
+// interactive lane, so that bulk stores always have writers of their
+// own; they also borrow the interactive writers that are idle (see
+// `queue_store()`), so a bulk-only workload still uses them all.
+#define NUM_BULK_QUEUES 2
+
 /* ================================================================ */
 // Constructors
 
@@ -36,57 +43,94 @@ void IPFSAtomStorage::init(const char * uri)
 	tvpred = createNode(PREDICATE_NODE, "*-TruthValueKey-*");
 
 	_uri = uri;
+	_async_open = false;
+	_value_blocks = false;
+	_async_threads = 4;
+	_jobs_stop = false;
+	_next_bulk_id = 1;
+	_ipld_links = false;
+	_compress_threshold = 0;
+	_compress_level = 3;
+	_key_type = "rsa";
+	_key_size = 2048;
+	_key_ready = true;
+	_key_exception = nullptr;
+	_key_msec = 0;
+	_wal_enabled = false;
+	_wal_fd = -1;
+	_ckpt_enabled = false;
+	_ckpt_fd = -1;
+	_ckpt_interval = 10000;
+	_ckpt_atoms = 0;
+	_ckpt_last = 0;
+	_qbytes_enabled = false;
+	_filter_valid = false;
+	_filter_stale = false;
+	_read_only = false;
+	_snapshot_size = 0;
+	_snapshot_cached = 0;
+	_queued_bytes = 0;
+	_qbytes_high = 0;
+	_qbytes_low = 0;
 
 #define URIX_LEN (sizeof("ipfs://") - 1)  // Should be 7
 	if (strncmp(uri, "ipfs://", URIX_LEN))
 		throw IOException(TRACE_INFO, "Unknown URI '%s'\n", uri);
 
+	// Options come after a question mark, as in
+	//    ipfs:///atomspace-key?async=1&keytype=ed25519
+	std::string base(uri);
+	size_t qmark = base.find('?');
+	if (std::string::npos != qmark)
+	{
+		parse_open_options(base.substr(qmark+1));
+		base.resize(qmark);
+		uri = base.c_str();
+	}
+
 	// We expect the URI to be for the form
 	//    ipfs:///atomspace-key
 	//    ipfs://hostname/atomspace-key
 	//    ipfs://hostname:port/atomspace-key
+	//    ipfs://host1:port1,host2:port2,.../atomspace-key
 	// where the key will be used to publish the IPNS for the atomspace.
-	// Read-only access to AtomSpaces is also supported. These have two
-	// forms: with IPFS and IPNS:
+	// With several daemons, the AtomSpace is split across all of them;
+	// see IPFSShard.cc. Read-only access to AtomSpaces is also
+	// supported. These have two forms: with IPFS and IPNS:
 	//    ipfs:///ipfs/Qm...
 	//    ipfs:///ipns/Qm...
 
-	_port = 5001;
+	std::string endpoints;
 	if ('/' == uri[URIX_LEN])
 	{
-		_hostname = "localhost";
 		_keyname = &uri[URIX_LEN+1];
 	}
 	else
 	{
 		const char* start = &uri[URIX_LEN];
-		_hostname = start;
-		char* p = strchr((char *)start, '/');
+		const char* p = strchr(start, '/');
 		if (nullptr == p)
 			throw IOException(TRACE_INFO, "Bad URI format '%s'\n", uri);
 		size_t len = p - start;
-		_hostname.resize(len);
+		endpoints.assign(start, len);
 		_keyname = &uri[len+URIX_LEN+1];
 
 		// Keys are not allowed to have trailing slashes.
+		// (The /ipfs/ and /ipns/ forms are handled below.)
 		size_t pos = _keyname.find('/');
-		if (pos != std::string::npos) _keyname.resize(pos);
-
-		// Search for a port, if present.
-		p = strchr((char *)start, ':');
-		if (p)
-		{
-			_port = atoi(p+1);
-			size_t len = p - start;
-			_hostname.resize(len);
-		}
+		if (pos != std::string::npos and
+		    _keyname.compare(0, 5, "ipfs/") and
+		    _keyname.compare(0, 5, "ipns/"))
+			_keyname.resize(pos);
 	}
 
 	// If the "key" is actually an IPFS or IPNS CID...
+	// An IPFS CID names an immutable snapshot.
 	if (std::string::npos != _keyname.find("ipfs/"))
 	{
 		_atomspace_cid = &_keyname[sizeof("ipfs/")-1];
 		_keyname.clear();
+		_read_only = true;
 	}
 	else
 	if (std::string::npos != _keyname.find("ipns/"))
@@ -110,68 +154,69 @@ void IPFSAtomStorage::init(const char * uri)
 	if (std::string::npos != end)
 		_key_cid.resize(end+1);
 
-	// Create pool of IPFS server connections.
+	// Add our share of IPFS server connections to the pool used
+	// by everyone talking to each daemon.
 	_initial_conn_pool_size = NUM_OMP_THREADS + NUM_WB_QUEUES;
-	for (int i=0; i<_initial_conn_pool_size; i++)
-	{
-		ipfs::Client* conn = new ipfs::Client(_hostname, _port);
-		conn_pool.push(conn);
-	}
+	attach_shards(endpoints);
+	_interactive_writers = (NUM_WB_QUEUES - NUM_BULK_QUEUES) * _shards.size();
 
 	bulk_load = false;
 	bulk_store = false;
 	clear_stats();
 
-	// Create the IPNS key under which we will publish,
-	// if it does not yet exist.
 	_publish_keep_going = false;
-	if (0 < _keyname.size())
+	_publish_pending = false;
+	_publish_lifetime = "4h";
+	_publish_ttl = "4h";
+	_publish_interval = std::chrono::milliseconds(0);
+
+	// If anything below throws, the constructor unwinds; the threads
+	// must not be left joinable, and the connections lent to the pool
+	// must be given back.
+	try
 	{
-		// Brute force search for keys.
-		ipfs::Json key_list;
-		ipfs::Client clnt(_hostname, _port);
-		clnt.KeyList(&key_list);
-		for (const auto& item : key_list)
+		// Initialize a new AtomSpace, but only if
+		// we're not already working with one.
+		if (_read_only) open_snapshot();
+		else if (0 == _atomspace_cid.size()) kill_data();
+		else rebuild_filter();
+
+		// Create the IPNS key under which we will publish,
+		// if it does not yet exist.
+		if (0 < _keyname.size())
 		{
-			std::string kame = item["Name"];
-			if (0 == kame.compare(_keyname))
+			if (_async_open)
 			{
-				_key_cid = item["Id"];
-				break;
+				_key_ready = false;
+				_key_finder = std::thread(key_finder_thread, this);
 			}
+			else find_or_make_key();
+
+			// We run IPNS publication in it's own thread, because it's so
+			// horridly slow.  As of this writing, either 60 sec or 90 sec.
+			// This is a well-known problem, see
+			// https://github.com/ipfs/go-ipfs/issues/3860
+			// The thread waits on a predicate, so no notifications are
+			// lost, even if it has not started running yet.
+			_publish_keep_going = true;
+			_publisher = std::thread(publish_thread, this);
 		}
-		if (0 < _key_cid.size())
-		{
-			std::cout << "Found existing AtomSpace key: /ipns/"
-			          << _key_cid << std::endl;
-		}
-		else
-		{
-			// Not found; make a new one, by default.
-			clnt.KeyGen(_keyname, "rsa", 2048, &_key_cid);
-			std::cout << "Generated AtomSpace key: /ipns/"
-			          << _key_cid << std::endl;
-		}
-
-		// We run IPNS publication in it's own thread, because it's so
-		// horridly slow.  As of this writing, either 60 sec or 90 sec.
-		// This is a well-known problem, see
-		// https://github.com/ipfs/go-ipfs/issues/3860
-		_publish_keep_going = true;
-		std::thread publisher(publish_thread, this);
-		publisher.detach();
-		// std::this_thread::yield();
-		// std::this_thread::sleep_for(50ms);
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
 	}
-
-	// Initialize a new AtomSpace, but only if
-	// we're not already working with one.
-	if (0 == _atomspace_cid.size()) kill_data();
+	catch (...)
+	{
+		stop_threads();
+		detach_shards();
+		throw;
+	}
 }
 
+// Writers are added for each daemon that the AtomSpace is split
+// across, since each can take patches independently of the others.
 IPFSAtomStorage::IPFSAtomStorage(std::string uri) :
-	_write_queue(this, &IPFSAtomStorage::vdo_store_atom, NUM_WB_QUEUES),
+	_write_queue(this, &IPFSAtomStorage::vdo_store_interactive,
+	             (NUM_WB_QUEUES - NUM_BULK_QUEUES) * num_endpoints(uri)),
+	_bulk_queue(this, &IPFSAtomStorage::vdo_store_bulk,
+	            NUM_BULK_QUEUES * num_endpoints(uri)),
 	_async_write_queue_exception(nullptr)
 {
 	init(uri.c_str());
@@ -179,16 +224,40 @@ IPFSAtomStorage::IPFSAtomStorage(std::string uri) :
 
 IPFSAtomStorage::~IPFSAtomStorage()
 {
+	stop_bulk_jobs();
+	close_checkpoint();
+	stop_jobs();
+	close_wal();
 	flushStoreQueue();
+	stop_threads();
+	detach_shards();
+	close_snapshot();
+}
 
-	_publish_keep_going = false;
-	_publish_cv.notify_one();
+/// Stop the key finder and the publisher.
+void IPFSAtomStorage::stop_threads(void)
+{
+	// Let a key generation in progress finish; the daemon would
+	// make the key anyway.
+	if (_key_finder.joinable()) _key_finder.join();
 
-	while (not conn_pool.is_empty())
+	// If a publication is in progress, this will wait for it to
+	// finish; the publisher thread must not outlive this object.
 	{
-		ipfs::Client* conn = conn_pool.pop();
-		delete conn;
+		std::lock_guard<std::mutex> lck(_publish_mutex);
+		_publish_keep_going = false;
 	}
+	_publish_cv.notify_one();
+	if (_publisher.joinable()) _publisher.join();
+}
+
+/// Give back the connections lent to the pool of each daemon.
+void IPFSAtomStorage::detach_shards(void)
+{
+	for (const auto& sh : _shards)
+		sh->shared->detach(_initial_conn_pool_size);
+	_shards.clear();
+	_shared.reset();
 }
 
 /**
@@ -205,7 +274,7 @@ bool IPFSAtomStorage::connected(void)
  */
 std::string IPFSAtomStorage::get_ipfs_cid(void)
 {
-	return "/ipfs/" + _atomspace_cid;
+	return "/ipfs/" + atomspace_root();
 }
 
 /**
@@ -213,25 +282,185 @@ std::string IPFSAtomStorage::get_ipfs_cid(void)
  */
 std::string IPFSAtomStorage::get_ipns_key(void)
 {
+	wait_for_key();
 	return "/ipns/" + _key_cid;
 }
 
+/* ================================================================ */
+
+/// Parse the options in the query part of the URI: `&`-separated
+/// `name=value` pairs.
+///    async=1          Find or make the IPNS key in the background.
+///    keytype=ed25519  Type of key to generate; rsa or ed25519.
+///                     An ed25519 key is much faster to generate.
+///    keysize=2048     Size of a generated RSA key, in bits.
+///    values=blocks    Put each Value in a block of its own; the
+///                     default, values=inline, puts them in the Atom.
+///    async_threads=4  Threads that run the `*_async()` fetches.
+///    outgoing=links   Write outgoing sets as IPLD links; the default,
+///                     outgoing=guids, writes bare GUID strings.
+///    compress=1024    Compress Values of this many bytes or more.
+///                     Off by default, so that what is stored does
+///                     not depend on whether zstd was found at build
+///                     time; readers built without it can't expand.
+///    level=3          The zstd compression level.
+void IPFSAtomStorage::parse_open_options(const std::string& query)
+{
+	size_t start = 0;
+	while (start < query.size())
+	{
+		size_t end = query.find('&', start);
+		if (std::string::npos == end) end = query.size();
+		std::string opt = query.substr(start, end - start);
+		start = end + 1;
+		if (0 == opt.size()) continue;
+
+		std::string name = opt;
+		std::string value;
+		size_t eq = opt.find('=');
+		if (std::string::npos != eq)
+		{
+			name = opt.substr(0, eq);
+			value = opt.substr(eq+1);
+		}
+
+		if ("async" == name)
+			_async_open = (0 == value.size() or "1" == value or
+			               "true" == value or "yes" == value);
+		else if ("keytype" == name)
+		{
+			if ("rsa" != value and "ed25519" != value)
+				throw IOException(TRACE_INFO,
+					"Unsupported key type '%s'\n", value.c_str());
+			_key_type = value;
+		}
+		else if ("keysize" == name)
+			_key_size = atoi(value.c_str());
+		else if ("values" == name)
+		{
+			if ("blocks" != value and "inline" != value)
+				throw IOException(TRACE_INFO,
+					"Unsupported value layout '%s'\n", value.c_str());
+			_value_blocks = ("blocks" == value);
+		}
+		else if ("async_threads" == name)
+		{
+			int n = atoi(value.c_str());
+			_async_threads = (0 < n) ? n : 1;
+		}
+		else if ("outgoing" == name)
+		{
+			if ("links" != value and "guids" != value)
+				throw IOException(TRACE_INFO,
+					"Unsupported outgoing-set encoding '%s'\n", value.c_str());
+			_ipld_links = ("links" == value);
+		}
+		else if ("compress" == name)
+		{
+			_compress_threshold = atol(value.c_str());
+			if (0 < _compress_threshold and not have_compression())
+			{
+				logger().warn("Built without zstd; Values won't be compressed\n");
+				_compress_threshold = 0;
+			}
+		}
+		else if ("level" == name)
+			_compress_level = atoi(value.c_str());
+		else
+			throw IOException(TRACE_INFO,
+				"Unknown URI option '%s'\n", name.c_str());
+	}
+}
+
+/// Look for the IPNS key, by name; make it, if it's not found.
+void IPFSAtomStorage::find_or_make_key(void)
+{
+	TraceSpan span(_tracer, "find_or_make_key", "bulk", _keyname);
+	auto start = std::chrono::steady_clock::now();
+
+	// Brute force search for keys.
+	std::string key_cid;
+	ipfs::Json keys = key_list();
+	for (const auto& item : keys)
+	{
+		std::string kame = item["Name"];
+		if (0 == kame.compare(_keyname))
+		{
+			key_cid = item["Id"];
+			break;
+		}
+	}
+	if (0 < key_cid.size())
+	{
+		std::cout << "Found existing AtomSpace key: /ipns/"
+		          << key_cid << std::endl;
+	}
+	else
+	{
+		// Not found; make a new one, by default.
+		key_cid = key_gen(_keyname, _key_type, _key_size);
+		std::cout << "Generated AtomSpace key: /ipns/"
+		          << key_cid << std::endl;
+	}
+
+	std::lock_guard<std::mutex> lck(_key_mutex);
+	_key_cid = key_cid;
+	_key_msec = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+void IPFSAtomStorage::key_finder_thread(IPFSAtomStorage* self)
+{
+	std::exception_ptr eptr = nullptr;
+	try
+	{
+		self->find_or_make_key();
+	}
+	catch (...)
+	{
+		eptr = std::current_exception();
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(self->_key_mutex);
+		self->_key_exception = eptr;
+		self->_key_ready = true;
+	}
+	self->_key_cv.notify_all();
+}
+
+/// Wait until the IPNS key is known. If it could not be found or
+/// made, throw the error; every time, since there is no key.
+void IPFSAtomStorage::wait_for_key(void)
+{
+	std::unique_lock<std::mutex> lck(_key_mutex);
+	if (not _key_ready)
+	{
+		_num_key_waits++;
+		_key_cv.wait(lck, [this] { return _key_ready; });
+	}
+	if (_key_exception) std::rethrow_exception(_key_exception);
+}
+
+/* ================================================================ */
+
 /**
  * Use IPNS to find the latest IPFS cid for this AtomSpace.
  */
 void IPFSAtomStorage::resolve_atomspace(void)
 {
+	wait_for_key();
 	if (0 == _key_cid.size()) return;
 
 	// Caution: as of this writing, name resolution takes
 	// exactly 60 seconds. This is a bug; see
 	// https://github.com/ipfs/go-ipfs/issues/3860
 	// for details.
-	std::string ipfs_path;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->NameResolve(_key_cid, &ipfs_path);
-	conn_pool.push(conn);
-	_atomspace_cid = ipfs_path;
+	{
+		std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
+		set_atomspace_root(name_resolve(_key_cid));
+	}
+	invalidate_filter();
 }
 
 /**
@@ -242,9 +471,14 @@ void IPFSAtomStorage::resolve_atomspace(void)
  */
 std::string IPFSAtomStorage::get_atom_guid(const Handle& h)
 {
-	if (guid_not_yet_stored(h)) do_store_atom(h);
+	// Finding the GUID stores the Atom, if it's not been stored.
+	if (guid_not_yet_stored(h))
+	{
+		check_writable("store atoms");
+		do_store_atom(h);
+	}
 	std::lock_guard<std::mutex> lck(_guid_mutex);
-	return _guid_map.find(h)->second;
+	return _guid_map.find(h)->second.to_string();
 }
 
 /**
@@ -253,15 +487,16 @@ std::string IPFSAtomStorage::get_atom_guid(const Handle& h)
  */
 ipfs::Json IPFSAtomStorage::get_atom_json(const Handle& atom)
 {
+	if (_read_only) return snapshot_atom_json(atom);
+
 	// Build the name
-	std::string path = _atomspace_cid + "/" + atom->to_short_string();
+	std::string path = atom_path(atom);
 
 	// std::cout << "Query path = " << path << std::endl;
 	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
 	try
 	{
-		conn->DagGet(path, &dag);
+		dag = dag_get(path);
 	}
 	catch (const std::exception& ex)
 	{
@@ -269,7 +504,6 @@ ipfs::Json IPFSAtomStorage::get_atom_json(const Handle& atom)
 		// recorded in IPFS. That's a normal situation, just
 		// ignore the error.
 	}
-	conn_pool.push(conn);
 	return dag;
 }
 
@@ -280,37 +514,99 @@ ipfs::Json IPFSAtomStorage::get_atom_json(const Handle& atom)
  * horridly slow.  As of this writing, either 60 sec or 90 sec.
  * This is a well-known problem, see
  * https://github.com/ipfs/go-ipfs/issues/3860
+ *
+ * Requests are debounced: if a publication is already pending, this
+ * request is folded into it. The publisher always publishes whatever
+ * the AtomSpace CID is at the time that it gets around to it.
  */
 void IPFSAtomStorage::publish_atomspace(void)
 {
-	if (0 == _key_cid.size()) return;
+	// The key might still be in the making; the publisher waits.
+	if (0 == _keyname.size() and 0 == _key_cid.size()) return;
+
+	_num_publish_requests++;
+	{
+		std::lock_guard<std::mutex> lck(_publish_mutex);
+		if (_publish_pending) _num_publish_skips++;
+		_publish_pending = true;
+	}
 	_publish_cv.notify_one();
 }
 
+/**
+ * Set the IPNS record lifetime and TTL, and the minimum interval
+ * between successive publications.  The lifetime and TTL are
+ * duration strings, as understood by `ipfs name publish`, e.g.
+ * "4h" or "30s".  Publication requests that arrive during the
+ * minimum interval are collapsed into one.
+ */
+void IPFSAtomStorage::set_publish_options(const std::string& lifetime,
+                                          const std::string& ttl,
+                                          int min_interval_secs)
+{
+	std::lock_guard<std::mutex> lck(_publish_mutex);
+	if (0 < lifetime.size()) _publish_lifetime = lifetime;
+	if (0 < ttl.size()) _publish_ttl = ttl;
+	if (0 <= min_interval_secs)
+		_publish_interval = std::chrono::seconds(min_interval_secs);
+}
+
 void IPFSAtomStorage::publish_thread(IPFSAtomStorage* self)
 {
 	ipfs::Client clnt(self->_hostname, self->_port);
-	std::mutex mtx;
-	while (self->_publish_keep_going)
+	std::unique_lock<std::mutex> lock(self->_publish_mutex);
+	while (true)
 	{
-		std::unique_lock<std::mutex> lock(mtx);
-		self->_publish_cv.wait(lock);
+		self->_publish_cv.wait(lock, [self] {
+			return self->_publish_pending or not self->_publish_keep_going; });
 
 		// Last time out, just quit.
 		if (not self->_publish_keep_going) break;
+		self->_publish_pending = false;
 
-		std::cout << "Publishing AtomSpace CID: "
-		          << self->_atomspace_cid << std::endl;
+		ipfs::Json options = {{"lifetime", self->_publish_lifetime},
+		                      {"ttl", self->_publish_ttl}};
+		std::chrono::milliseconds interval = self->_publish_interval;
 
-		// XXX hack alert -- lifetime set to 4 hours, it should be
-		// infinity or something.... the TTL is 30 seconds, but should
-		// be shorter or user-configurable .. set both with scheme bindings.
+		// Don't hold the lock while talking to the daemon; that would
+		// block the callers of publish_atomspace() for a minute or
+		// more. Even computing the root is an RPC when sharded, and
+		// waits on the directory patches when not.
+		lock.unlock();
+
+		// Publish the latest CID, not the one that was current when
+		// the request was made.
+		std::string cid;
 		try
 		{
-			std::string name;
-			ipfs::Json options = {{"lifetime", "4h"}, {"ttl", "4h"}};
-			clnt.NamePublish(self->_atomspace_cid,
-			                 self->_keyname, options, &name);
+			cid = self->atomspace_root();
+		}
+		catch (const std::exception& ex)
+		{
+			std::cerr << "Failed to put AtomSpace directory: "
+			          << ex.what() << std::endl;
+			lock.lock();
+			self->_num_publish_fails++;
+			continue;
+		}
+
+		lock.lock();
+		if (0 == cid.compare(self->_last_published_cid))
+		{
+			self->_num_publish_skips++;
+			continue;
+		}
+		lock.unlock();
+
+		std::cout << "Publishing AtomSpace CID: " << cid << std::endl;
+
+		auto start = std::chrono::steady_clock::now();
+		bool ok = true;
+		try
+		{
+			self->wait_for_key();
+			std::string name =
+				self->name_publish(clnt, cid, self->_keyname, options);
 			std::cout << "Published AtomSpace: " << name << std::endl;
 		}
 		catch (const std::exception& ex)
@@ -321,34 +617,76 @@ void IPFSAtomStorage::publish_thread(IPFSAtomStorage* self)
 			// that!  So WTF ... another IPNS bug.
 			std::cerr << "Failed to publish AtomSpace IPNS entry: "
 			          << ex.what() << std::endl;
+			ok = false;
+		}
+		size_t msec = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		lock.lock();
+
+		if (ok)
+		{
+			self->_last_published_cid = cid;
+			self->_num_publishes++;
+			self->_publish_msec += msec;
+			if (self->_publish_slowest_msec < msec)
+				self->_publish_slowest_msec = msec;
 		}
+		else
+			self->_num_publish_fails++;
+
+		// Debounce. Requests arriving during the interval are
+		// collapsed into a single publication, after it expires.
+		if (0 < interval.count())
+			self->_publish_cv.wait_for(lock, interval, [self] {
+				return not self->_publish_keep_going; });
 	}
 }
 
 void IPFSAtomStorage::update_atom_in_atomspace(const Handle& h,
                                                const std::string& cid)
 {
+	TraceSpan span(_tracer, "update_atom_in_atomspace", "atom", h);
+
 	std::string label(encodeAtomToStr(h));
 
-	// XXX FIXME ... this leaks pool entries, if ipfs ever throws.
-	// We can't just catch, we need to rethrow, too.
-	std::string new_as_id;
-	ipfs::Client* conn = conn_pool.pop();
+	// If we've linked it before, it's already in the filter. (If it
+	// was linked before we opened the AtomSpace, it gets added twice;
+	// that only costs the occasional false positive, later.)
+	bool known;
+	{
+		std::lock_guard<std::mutex> lck(_atom_cid_mutex);
+		known = _atom_cid_map.end() != _atom_cid_map.find(h);
+	}
+
+	if (sharded())
+	{
+		// Only the Atom's own shard is patched; the others are
+		// free to take patches at the same time.
+		size_t s = atom_shard(label);
+		Shard& sh = *_shards[s];
+		{
+			std::lock_guard<std::mutex> lck(sh.dir_mutex);
+			sh.dir_cid = patch_add_link(sh.dir_cid, label, cid, s);
+			if (not known) filter_add(label);
+		}
+		sh.links++;
+		_root_stale = true;
+	}
+	else
 	{
 		// Update the cid under a lock, as this method can
 		// be called from multiple threads.  It's not actually
 		// the cid that matters, its the patch itself.
 		std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
-		conn->ObjectPatchAddLink(_atomspace_cid, label, cid, &new_as_id);
-		_atomspace_cid = new_as_id;
+		_atomspace_cid = patch_add_link(_atomspace_cid, label, cid);
+		if (not known) filter_add(label);
 	}
-	conn_pool.push(conn);
 
 	{
 		// Store the current cid for this atom; this is the cid
 		// of the atom that has values attached to it.
 		std::lock_guard<std::mutex> lck(_atom_cid_mutex);
-		_atom_cid_map[h] = cid;
+		_atom_cid_map[h] = IPFSCid(cid);
 	}
 }
 
@@ -390,12 +728,36 @@ void IPFSAtomStorage::rethrow(void)
 void IPFSAtomStorage::flushStoreQueue()
 {
 	rethrow();
+
+	TraceSpan span(_tracer, "flushStoreQueue", "queue");
+
+	// Wait for the write-ahead log to commit everything logged so
+	// far. If the committer is stuck on an error, report it, and
+	// let the committer try again.
+	if (_wal_enabled)
+	{
+		std::unique_lock<std::mutex> lck(_wal_mutex);
+		wal_wait_committed(lck);
+		if (_wal_stalled)
+		{
+			_wal_stalled = false;
+			lck.unlock();
+			_wal_cv.notify_all();
+			rethrow();
+			throw IOException(TRACE_INFO,
+				"Unable to commit write-ahead log %s", _wal_path.c_str());
+		}
+	}
+
 	_write_queue.barrier();
+	_bulk_queue.barrier();
 	rethrow();
 }
 
 void IPFSAtomStorage::barrier()
 {
+	TraceSpan span(_tracer, "barrier", "queue");
+
 	flushStoreQueue();
 	// publish();
 }
@@ -427,23 +789,18 @@ void IPFSAtomStorage::unregisterWith(AtomSpace* as)
  */
 void IPFSAtomStorage::kill_data(void)
 {
+	check_writable("clear the AtomSpace");
 	rethrow();
 
 	_guid_map.clear();
 	_atom_cid_map.clear();
-	_guid_inv_map.clear();
 	_json_map.clear();
+	forget_stored_values(HandleSeq());
 
 	std::string text = "AtomSpace " + _uri;
-	ipfs::Json result;
-
-	ipfs::Client* conn = conn_pool.pop();
-	conn->FilesAdd({{"AtomSpace",
-		ipfs::http::FileUpload::Type::kFileContents,
-		text}}, &result);
-	conn_pool.push(conn);
-
-	_atomspace_cid = result[0]["hash"];
+	if (sharded()) make_shard_dirs(text);
+	else _atomspace_cid = files_add("AtomSpace", text);
+	clear_filter();
 
 	// Special case for TruthValues - must always have this atom.
 	do_store_single_atom(tvpred);
@@ -454,22 +811,90 @@ void IPFSAtomStorage::kill_data(void)
 void IPFSAtomStorage::set_hilo_watermarks(int hi, int lo)
 {
 	_write_queue.set_watermarks(hi, lo);
+	_bulk_queue.set_watermarks(hi, lo);
+}
+
+/// Set the byte watermarks for the write queue. Writers stall when
+/// more than `hi` bytes (estimated, encoded size of the Atoms and
+/// their Values) are queued, and resume when the queue drains down
+/// to `lo` bytes. This is in addition to the Atom-count watermarks.
+/// Setting `hi` to zero turns byte accounting off.
+void IPFSAtomStorage::set_byte_watermarks(size_t hi, size_t lo)
+{
+	{
+		std::lock_guard<std::mutex> lck(_qbytes_mutex);
+		if (hi < lo) lo = hi;
+		_qbytes_high = hi;
+		_qbytes_low = lo;
+		_qbytes_enabled = (0 < hi);
+		if (not _qbytes_enabled)
+		{
+			_qbytes_map.clear();
+			_queued_bytes = 0;
+		}
+	}
+	_qbytes_cv.notify_all();
 }
 
 void IPFSAtomStorage::set_stall_writers(bool stall)
 {
 	_write_queue.stall(stall);
+	_bulk_queue.stall(stall);
 }
 
 void IPFSAtomStorage::clear_stats(void)
 {
+	std::lock_guard<std::mutex> lck(_stats_mutex);
 	_stats_time = time(0);
 	_load_count = 0;
 	_store_count = 0;
 	_valuation_stores = 0;
 	_value_stores = 0;
 
+	_num_shard_misses = 0;
+	for (const auto& sh : _shards)
+	{
+		sh->calls = 0;
+		sh->links = 0;
+	}
+
+	_num_publish_requests = 0;
+	_num_publishes = 0;
+	_num_publish_skips = 0;
+	_num_publish_fails = 0;
+	_num_key_waits = 0;
+	_publish_msec = 0;
+	_publish_slowest_msec = 0;
+
 	_write_queue.clear_stats();
+	_bulk_queue.clear_stats();
+	_num_bulk_borrows = 0;
+	for (int i = 0; i < LANE_NUM; i++)
+	{
+		_lane_stats[i].queue_wait.reset();
+		_lane_stats[i].store_time.reset();
+	}
+
+	_wal_appends = 0;
+	_wal_batches = 0;
+	_wal_committed = 0;
+	_wal_replayed = 0;
+	_ckpt_resumed = 0;
+	_ckpt_skipped = 0;
+	_ckpt_writes = 0;
+	_wal_failures = 0;
+	_wal_commit_latency.reset();
+
+	_qbytes_stalls = 0;
+	_qbytes_stall_time.reset();
+	{
+		std::lock_guard<std::mutex> lck(_qbytes_mutex);
+		_queued_bytes_peak = _queued_bytes;
+	}
+
+	for (int i = 0; i < RPC_NUM; i++)
+		_rpc_stats[i].reset();
+	_conn_wait.reset();
 
 	_num_get_atoms = 0;
 	_num_got_nodes = 0;
@@ -480,13 +905,68 @@ void IPFSAtomStorage::clear_stats(void)
 	_num_link_inserts = 0;
 	_num_atom_removes = 0;
 	_num_atom_deletes = 0;
+	_num_incoming_upgrades = 0;
+	_num_multi_gets = 0;
+	_num_jobs_submitted = 0;
+	_num_jobs_done = 0;
+	_num_multi_get_atoms = 0;
+	_num_closure_prefetches = 0;
+	_num_closure_rounds = 0;
+	_num_closure_blocks = 0;
+	_num_filter_negatives = 0;
+	_num_filter_false_positives = 0;
+	_num_filter_rebuilds = 0;
+	_num_snapshot_hits = 0;
+	_num_snapshot_misses = 0;
+	_num_shared_block_hits = 0;
+	_num_shared_block_misses = 0;
+	_num_shared_guid_hits = 0;
+	_num_value_blocks_put = 0;
+	_num_value_blocks_reused = 0;
+	_num_value_blocks_fetched = 0;
+	_num_values_unchanged = 0;
+	_num_compressed = 0;
+	_num_compress_skips = 0;
+	_num_expanded = 0;
+	_compress_bytes_in = 0;
+	_compress_bytes_out = 0;
+	_compress_usec = 0;
+	_expand_usec = 0;
+
+	_num_overlay_hits = 0;
+	_num_fences = 0;
+	_num_fence_waits = 0;
+	_fence_wait.reset();
+}
+
+/// Start recording trace spans, discarding any recorded earlier.
+/// At most `max_events` spans are kept.
+void IPFSAtomStorage::start_trace(size_t max_events)
+{
+	_tracer.start(max_events);
+}
+
+void IPFSAtomStorage::stop_trace(void)
+{
+	_tracer.stop();
+}
+
+/// Write the recorded spans to a file, in the Chrome trace-event
+/// format. View it with chrome://tracing or https://ui.perfetto.dev
+void IPFSAtomStorage::dump_trace(const std::string& filename)
+{
+	_tracer.dump(filename);
 }
 
 void IPFSAtomStorage::print_stats(void)
 {
 	printf("ipfs-stats: Currently open URI: %s\n", _uri.c_str());
-	printf("ipfs-stats: IPNS name: /ipns/%s\n", _key_cid.c_str());
-	printf("ipfs-stats: curr CID : /ipfs/%s\n", _atomspace_cid.c_str());
+	{
+		std::lock_guard<std::mutex> lck(_key_mutex);
+		printf("ipfs-stats: IPNS name: /ipns/%s\n",
+		       _key_ready ? _key_cid.c_str() : "(not yet known)");
+	}
+	printf("ipfs-stats: curr CID : /ipfs/%s\n", atomspace_root().c_str());
 	time_t now = time(0);
 	// ctime returns string with newline at end of it.
 	printf("ipfs-stats: Time since stats reset=%lu secs, at %s",
@@ -508,6 +988,25 @@ void IPFSAtomStorage::print_stats(void)
 	size_t num_atom_deletes = _num_atom_deletes;
 	printf("ipfs-stats: atom remove requests = %zu total atom deletes = %zu\n",
 	       num_atom_removes, num_atom_deletes);
+
+	size_t num_publish_requests = _num_publish_requests;
+	size_t num_publishes = _num_publishes;
+	size_t num_publish_skips = _num_publish_skips;
+	size_t num_publish_fails = _num_publish_fails;
+	double publish_secs = 0.001 * _publish_msec / ((double) num_publishes);
+	double publish_slowest = 0.001 * _publish_slowest_msec;
+	printf("ipfs-stats: publish requests = %zu publishes = %zu skipped = %zu failed = %zu\n",
+	       num_publish_requests, num_publishes, num_publish_skips,
+	       num_publish_fails);
+	printf("ipfs-stats: avg publish time=%f seconds; longest publish time=%f\n",
+	       publish_secs, publish_slowest);
+	{
+		std::lock_guard<std::mutex> lck(_publish_mutex);
+		printf("ipfs-stats: last published CID: /ipfs/%s (lifetime=%s ttl=%s interval=%ld secs)\n",
+		       _last_published_cid.c_str(), _publish_lifetime.c_str(),
+		       _publish_ttl.c_str(), (long)
+		       std::chrono::duration_cast<std::chrono::seconds>(_publish_interval).count());
+	}
 	printf("\n");
 
 	size_t num_get_atoms = _num_get_atoms;
@@ -524,6 +1023,30 @@ void IPFSAtomStorage::print_stats(void)
 	frac = num_get_inlinks / ((double) num_get_insets);
 	printf("num_get_incoming_sets=%zu set total=%zu avg set size=%f\n",
 	       num_get_insets, num_get_inlinks, frac);
+	printf("incoming sets converted to by-type=%zu\n",
+	       (size_t) _num_incoming_upgrades);
+	printf("multi-gets=%zu atoms fetched by multi-get=%zu\n",
+	       (size_t) _num_multi_gets, (size_t) _num_multi_get_atoms);
+	{
+		std::lock_guard<std::mutex> lck(_job_mutex);
+		printf("async jobs threads=%zu of %zu queued=%zu submitted=%zu done=%zu\n",
+		       _job_threads.size(), _async_threads, _jobs.size(),
+		       (size_t) _num_jobs_submitted, (size_t) _num_jobs_done);
+	}
+	{
+		std::lock_guard<std::mutex> lck(_bulk_mutex);
+		for (const auto& pr : _bulk_jobs)
+		{
+			const BulkJob& job = *pr.second;
+			printf("bulk job %d: %s %s, %zu of %zu atoms\n", pr.first,
+			       job.kind.c_str(), bulk_state_name(job.state),
+			       (size_t) job.done, (size_t) job.total);
+		}
+	}
+	printf("outgoing=%s closure prefetches=%zu rounds=%zu blocks=%zu\n",
+	       _ipld_links ? "links" : "guids",
+	       (size_t) _num_closure_prefetches, (size_t) _num_closure_rounds,
+	       (size_t) _num_closure_blocks);
 
 	unsigned long tot_node = num_node_inserts;
 	unsigned long tot_link = num_link_inserts;
@@ -531,43 +1054,189 @@ void IPFSAtomStorage::print_stats(void)
 	printf("total stores for node=%lu link=%lu ratio=%f\n",
 	       tot_node, tot_link, frac);
 
-	// Store queue performance
-	unsigned long item_count = _write_queue._item_count;
-	unsigned long duplicate_count = _write_queue._duplicate_count;
-	unsigned long flush_count = _write_queue._flush_count;
-	unsigned long drain_count = _write_queue._drain_count;
-	unsigned long drain_msec = _write_queue._drain_msec;
-	unsigned long drain_slowest_msec = _write_queue._drain_slowest_msec;
-	unsigned long drain_concurrent = _write_queue._drain_concurrent;
-	int high_water = _write_queue.get_high_watermark();
-	int low_water = _write_queue.get_low_watermark();
-	bool stalling = _write_queue.stalling();
-
-	double dupe_frac = duplicate_count / ((double) (item_count - duplicate_count));
-	double flush_frac = (item_count - duplicate_count) / ((double) flush_count);
-	double fill_frac = (item_count - duplicate_count) / ((double) drain_count);
-
-	unsigned long dentries = drain_count + drain_concurrent;
-	double drain_ratio = dentries / ((double) drain_count);
-	double drain_secs = 0.001 * drain_msec / ((double) dentries);
-	double slowest = 0.001 * drain_slowest_msec;
+	// Store queue performance, per lane.
+	for (int lane = 0; lane < LANE_NUM; lane++)
+	{
+		auto& wq = lane_queue((WriteLane) lane);
+		unsigned long item_count = wq._item_count;
+		unsigned long duplicate_count = wq._duplicate_count;
+		unsigned long flush_count = wq._flush_count;
+		unsigned long drain_count = wq._drain_count;
+		unsigned long drain_msec = wq._drain_msec;
+		unsigned long drain_slowest_msec = wq._drain_slowest_msec;
+		unsigned long drain_concurrent = wq._drain_concurrent;
+		int high_water = wq.get_high_watermark();
+		int low_water = wq.get_low_watermark();
+		bool stalling = wq.stalling();
+
+		double dupe_frac = duplicate_count / ((double) (item_count - duplicate_count));
+		double flush_frac = (item_count - duplicate_count) / ((double) flush_count);
+		double fill_frac = (item_count - duplicate_count) / ((double) drain_count);
+
+		unsigned long dentries = drain_count + drain_concurrent;
+		double drain_ratio = dentries / ((double) drain_count);
+		double drain_secs = 0.001 * drain_msec / ((double) dentries);
+		double slowest = 0.001 * drain_slowest_msec;
+
+		printf("\n");
+		printf("%s lane:\n", lane_name((WriteLane) lane));
+		printf("hi-water=%d low-water=%d stalling=%s\n", high_water,
+		       low_water, stalling? "true" : "false");
+		printf("write items=%lu dup=%lu dupe_frac=%f flushes=%lu flush_ratio=%f\n",
+		       item_count, duplicate_count, dupe_frac, flush_count, flush_frac);
+		printf("drains=%lu fill_fraction=%f concurrency=%f\n",
+		       drain_count, fill_frac, drain_ratio);
+		printf("avg drain time=%f seconds; longest drain time=%f\n",
+		       drain_secs, slowest);
+
+		printf("currently in_drain=%d num_busy=%lu queue_size=%lu\n",
+		       (int) wq._in_drain, wq.get_busy_writers(), wq.get_size());
+
+		const LaneStats& ls = _lane_stats[lane];
+		printf("queue wait avg=%.0f p99=%lu max=%lu usecs; "
+		       "store avg=%.0f p99=%lu max=%lu usecs\n",
+		       ls.queue_wait.mean(),
+		       (unsigned long) ls.queue_wait.percentile(0.99),
+		       (unsigned long) ls.queue_wait.max(),
+		       ls.store_time.mean(),
+		       (unsigned long) ls.store_time.percentile(0.99),
+		       (unsigned long) ls.store_time.max());
+	}
+	printf("bulk atoms stored by idle interactive writers=%zu\n",
+	       (size_t) _num_bulk_borrows);
 
-	printf("\n");
-	printf("hi-water=%d low-water=%d stalling=%s\n", high_water,
-	       low_water, stalling? "true" : "false");
-	printf("write items=%lu dup=%lu dupe_frac=%f flushes=%lu flush_ratio=%f\n",
-	       item_count, duplicate_count, dupe_frac, flush_count, flush_frac);
-	printf("drains=%lu fill_fraction=%f concurrency=%f\n",
-	       drain_count, fill_frac, drain_ratio);
-	printf("avg drain time=%f seconds; longest drain time=%f\n",
-	       drain_secs, slowest);
-
-	printf("currently in_drain=%d num_busy=%lu queue_size=%lu\n",
-	       _write_queue._in_drain, _write_queue.get_busy_writers(),
-	       _write_queue.get_size());
-
-	printf("current conn_pool free=%u of %d\n", conn_pool.size(),
+	if (_qbytes_enabled)
+	{
+		size_t queued, peak, hi, lo;
+		{
+			std::lock_guard<std::mutex> lck(_qbytes_mutex);
+			queued = _queued_bytes;
+			peak = _queued_bytes_peak;
+			hi = _qbytes_high;
+			lo = _qbytes_low;
+		}
+		printf("queued bytes=%zu peak=%zu byte hi-water=%zu low-water=%zu\n",
+		       queued, peak, hi, lo);
+		printf("byte stalls=%zu avg stall=%.0f max stall=%lu usecs\n",
+		       (size_t) _qbytes_stalls, _qbytes_stall_time.mean(),
+		       (unsigned long) _qbytes_stall_time.max());
+	}
+
+	if (_wal_enabled)
+	{
+		size_t wal_pending;
+		{
+			std::lock_guard<std::mutex> lck(_wal_mutex);
+			wal_pending = _wal_pending.size();
+		}
+		printf("wal=%s appends=%zu replayed=%zu pending=%zu failures=%zu\n",
+		       _wal_path.c_str(), (size_t) _wal_appends,
+		       (size_t) _wal_replayed, wal_pending, (size_t) _wal_failures);
+		printf("wal batches=%zu committed=%zu avg commit=%.0f p99=%lu usecs\n",
+		       (size_t) _wal_batches, (size_t) _wal_committed,
+		       _wal_commit_latency.mean(),
+		       (unsigned long) _wal_commit_latency.percentile(0.99));
+	}
+
+	if (_ckpt_enabled)
+		printf("checkpoint=%s resumed=%zu skipped=%zu checkpoints=%zu\n",
+		       _ckpt_path.c_str(), (size_t) _ckpt_resumed,
+		       (size_t) _ckpt_skipped, (size_t) _ckpt_writes);
+
+	{
+		std::lock_guard<std::mutex> lck(_filter_mutex);
+		size_t negs = _num_filter_negatives;
+		size_t fps = _num_filter_false_positives;
+		printf("filter valid=%d keys=%zu capacity=%zu hashes=%zu bytes=%zu est fp=%f\n",
+		       (int) _filter_valid, _filter.size(), _filter.capacity(),
+		       _filter.num_hashes(), _filter.memory_bytes(),
+		       _filter.false_positive_rate());
+		printf("filter negatives=%zu false positives=%zu observed fp=%f rebuilds=%zu\n",
+		       negs, fps, fps / ((double) (negs + fps)),
+		       (size_t) _num_filter_rebuilds);
+	}
+
+	if (_read_only)
+		printf("read-only snapshot atoms=%zu hits=%zu misses=%zu\n",
+		       _snapshot_size, (size_t) _num_snapshot_hits,
+		       (size_t) _num_snapshot_misses);
+
+	printf("values layout=%s blocks put=%zu reused=%zu fetched=%zu unchanged=%zu\n",
+	       _value_blocks ? "blocks" : "inline",
+	       (size_t) _num_value_blocks_put,
+	       (size_t) _num_value_blocks_reused,
+	       (size_t) _num_value_blocks_fetched,
+	       (size_t) _num_values_unchanged);
+	if (0 < _compress_threshold)
+	{
+		size_t bin = _compress_bytes_in;
+		size_t bout = _compress_bytes_out;
+		printf("compression threshold=%zu compressed=%zu skipped=%zu expanded=%zu\n",
+		       _compress_threshold, (size_t) _num_compressed,
+		       (size_t) _num_compress_skips, (size_t) _num_expanded);
+		printf("compression ratio=%.2f (%zu to %zu bytes) compress=%zu expand=%zu usecs\n",
+		       bout ? bin / (double) bout : 1.0, bin, bout,
+		       (size_t) _compress_usec, (size_t) _expand_usec);
+	}
+
+	size_t pending_atoms;
+	{
+		std::lock_guard<std::mutex> lck(_pending_mutex);
+		pending_atoms = _pending_atoms.size();
+	}
+	printf("pending atoms=%zu overlay hits=%zu fences=%zu waited=%zu\n",
+	       pending_atoms, (size_t) _num_overlay_hits, (size_t) _num_fences,
+	       (size_t) _num_fence_waits);
+	printf("fence wait avg=%.0f p99=%lu max=%lu usecs\n",
+	       _fence_wait.mean(),
+	       (unsigned long) _fence_wait.percentile(0.99),
+	       (unsigned long) _fence_wait.max());
+
+	printf("current conn_pool free=%u of %zu (%d of them ours)\n",
+	       _shared->conn_pool.size(), _shared->num_connections(),
 	       _initial_conn_pool_size);
+	printf("shared %s instances=%zu blocks=%zu of %zu guids=%zu values=%zu\n",
+	       _shared->endpoint().c_str(), _shared->num_instances(),
+	       _shared->num_blocks(), _shared->block_capacity(),
+	       _shared->num_guids(), _shared->num_value_cids());
+	printf("shared block hits=%zu misses=%zu guid hits=%zu\n",
+	       (size_t) _num_shared_block_hits,
+	       (size_t) _num_shared_block_misses,
+	       (size_t) _num_shared_guid_hits);
+	if (sharded())
+	{
+		printf("split across %zu daemons; searched for %zu blocks\n",
+		       _shards.size(), (size_t) _num_shard_misses);
+		for (size_t s = 0; s < _shards.size(); s++)
+			printf("shard %zu %s calls=%zu links=%zu\n", s,
+			       _shards[s]->shared->endpoint().c_str(),
+			       (size_t) _shards[s]->calls, (size_t) _shards[s]->links);
+	}
+	printf("conn_pool waits=%lu avg=%.0f p99=%lu max=%lu usecs\n",
+	       (unsigned long) _conn_wait.count(), _conn_wait.mean(),
+	       (unsigned long) _conn_wait.percentile(0.99),
+	       (unsigned long) _conn_wait.max());
+
+	// Daemon call latencies, in microseconds, per endpoint.
+	printf("\n");
+	printf("%-22s %8s %6s %9s %9s %9s %9s %9s %10s %10s\n",
+	       "rpc", "calls", "errors", "avg", "p50", "p99", "p999", "max",
+	       "sent", "received");
+	for (int i = 0; i < RPC_NUM; i++)
+	{
+		const RPCStats& st = _rpc_stats[i];
+		unsigned long calls = st.calls;
+		if (0 == calls) continue;
+		printf("%-22s %8lu %6lu %9.0f %9lu %9lu %9lu %9lu %10lu %10lu\n",
+		       rpc_name((RPC) i), calls, (unsigned long) st.errors,
+		       st.latency.mean(),
+		       (unsigned long) st.latency.percentile(0.5),
+		       (unsigned long) st.latency.percentile(0.99),
+		       (unsigned long) st.latency.percentile(0.999),
+		       (unsigned long) st.latency.max(),
+		       (unsigned long) st.bytes_sent,
+		       (unsigned long) st.bytes_received);
+	}
 
 	printf("\n");
 }
@@ -16,9 +16,17 @@
 #define _OPENCOG_IPFS_ATOM_STORAGE_H
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include <ipfs/client.h>
@@ -37,6 +45,13 @@
 #include <opencog/atomspace/AtomTable.h>
 #include <opencog/atomspace/BackingStore.h>
 
+#include <opencog/persist/ipfs/IPFSCid.h>
+#include <opencog/persist/ipfs/IPFSRing.h>
+#include <opencog/persist/ipfs/IPFSShared.h>
+#include <opencog/persist/ipfs/IPFSTrace.h>
+#include <opencog/persist/ipfs/LatencyHistogram.h>
+#include <opencog/persist/ipfs/MembershipFilter.h>
+
 namespace opencog
 {
 /** \addtogroup grp_persist
@@ -48,29 +63,225 @@ namespace opencog
 
 class IPFSAtomStorage : public BackingStore
 {
+	public:
+		// Asynchronous stores go through one of several lanes, each
+		// with its own queue and its own writer threads, so that a
+		// bulk store cannot starve interactive updates.
+		enum WriteLane {
+			LANE_INTERACTIVE,
+			LANE_BULK,
+			LANE_NUM
+		};
+		static const char* lane_name(WriteLane);
+
 	private:
 		void init(const char *);
+		void stop_threads(void);
 		std::string _uri;
 		std::string _hostname;
 		int _port;
 
-		// Pool of shared connections
-		concurrent_stack<ipfs::Client*> conn_pool;
+		// Connections, blocks and GUIDs, shared with every other
+		// AtomSpace stored in the same daemon. This instance adds
+		// _initial_conn_pool_size connections to the common pool.
+		std::shared_ptr<IPFSShared> _shared;
 		int _initial_conn_pool_size;
+		std::atomic<size_t> _num_shared_block_hits;
+		std::atomic<size_t> _num_shared_block_misses;
+		std::atomic<size_t> _num_shared_guid_hits;
+
+		// ---------------------------------------------
+		// An AtomSpace can be split across several daemons, named in
+		// the URI as ipfs://host1:port1,host2:port2/key. Each Atom
+		// belongs to one of them, as picked by the ring; its blocks
+		// go there, and its entry goes into the directory kept there.
+		// The AtomSpace CID names a directory of these directories.
+		// Shard 0 is the first daemon named; it holds the top-level
+		// directory and the IPNS keys, and its shared state is
+		// _shared. With just one daemon, there is one shard, and the
+		// AtomSpace CID names the directory of Atoms itself.
+		// See IPFSShard.cc
+		struct Shard
+		{
+			std::shared_ptr<IPFSShared> shared;
+			std::mutex dir_mutex;
+			std::string dir_cid;
+			std::atomic<size_t> calls;
+			std::atomic<size_t> links;
+		};
+		std::vector<std::unique_ptr<Shard>> _shards;
+		IPFSRing _ring;
+		std::atomic<bool> _root_stale;
+		std::mutex _loc_mutex;
+		std::unordered_map<IPFSCid, size_t> _block_loc;
+		std::deque<IPFSCid> _loc_order;
+		std::atomic<size_t> _num_shard_misses;
+		static size_t num_endpoints(const std::string&);
+		void attach_shards(const std::string&);
+		void detach_shards(void);
+		bool sharded(void) const { return 1 < _shards.size(); }
+		size_t atom_shard(const std::string& label) const {
+			return _ring.owner(label); }
+		IPFSShared& atom_home(const std::string&);
+		std::string atom_path(const Handle&);
+		void note_block(const std::string&, size_t);
+		int block_shard(const std::string&);
+		std::string atomspace_root(void);
+		void refresh_root(void);
+		std::string put_root(void);
+		void set_atomspace_root(const std::string&);
+		void make_shard_dirs(const std::string&);
+		ipfs::Json atomspace_links(const std::string&);
+
+		// Borrow a connection from the pool, and give it back when
+		// done, even if the daemon call throws.
+		struct PooledConn
+		{
+			IPFSAtomStorage* _store;
+			size_t _shard;
+			ipfs::Client* _conn;
+			PooledConn(IPFSAtomStorage*, size_t shard = 0);
+			~PooledConn();
+			ipfs::Client* operator->() { return _conn; }
+		};
+
+		// ---------------------------------------------
+		// Daemon calls. Every call to the IPFS daemon goes through
+		// one of these, so that it can be timed and accounted for.
+		enum RPC {
+			RPC_DAG_GET,
+			RPC_DAG_PUT,
+			RPC_PATCH_ADD_LINK,
+			RPC_PATCH_RM_LINK,
+			RPC_FILES_ADD,
+			RPC_KEY_LIST,
+			RPC_KEY_GEN,
+			RPC_NAME_PUBLISH,
+			RPC_NAME_RESOLVE,
+			RPC_OBJECT_GET,
+			RPC_OBJECT_PUT,
+			RPC_NUM
+		};
+		static const char* rpc_name(RPC);
+
+		struct RPCStats
+		{
+			LatencyHistogram latency;
+			std::atomic<size_t> calls;
+			std::atomic<size_t> errors;
+			std::atomic<size_t> bytes_sent;
+			std::atomic<size_t> bytes_received;
+			void reset(void);
+		};
+		RPCStats _rpc_stats[RPC_NUM];
+		LatencyHistogram _conn_wait;
+		SpanTracer _tracer;
+		void rpc_done(RPC, std::chrono::steady_clock::time_point,
+		              size_t sent, size_t received);
+		static size_t json_bytes(const ipfs::Json&);
+		void rpc_failed(RPC, std::chrono::steady_clock::time_point);
+
+		ipfs::Json dag_get(const std::string&);
+		ipfs::Json dag_get(const std::string&, size_t shard);
+		ipfs::Json dag_probe(const std::string&, size_t shard);
+		std::string dag_put(const ipfs::Json&, size_t shard = 0);
+		std::string patch_add_link(const std::string&, const std::string&,
+		                           const std::string&, size_t shard = 0);
+		std::string patch_rm_link(const std::string&, const std::string&,
+		                          size_t shard = 0);
+		std::string files_add(const std::string&, const std::string&,
+		                      size_t shard = 0);
+		ipfs::Json key_list(void);
+		std::string key_gen(const std::string&, const std::string&, int);
+		std::string name_resolve(const std::string&);
+		std::string name_publish(ipfs::Client&, const std::string&,
+		                         const std::string&, const ipfs::Json&);
+		ipfs::Json object_get(const std::string&, size_t shard = 0);
+		std::string object_put(const ipfs::Json&, size_t shard = 0);
 
 		Handle tvpred; // the key to a very special valuation.
 
 		// ---------------------------------------------
 		// IPNS Publication happens in it's own thread, because
-		// it's slow. That means it needs a semaphore.
+		// it's slow. Requests are debounced: a burst of calls to
+		// publish_atomspace() results in just one publication of
+		// the most recent CID.
+		std::thread _publisher;
+		std::mutex _publish_mutex;
 		std::condition_variable _publish_cv;
 		bool _publish_keep_going;
+		bool _publish_pending;
+		std::string _publish_lifetime;
+		std::string _publish_ttl;
+		std::chrono::milliseconds _publish_interval;
+		std::string _last_published_cid;
 		static void publish_thread(IPFSAtomStorage*);
 
 		// The Main IPNS key under which to publish the AtomSpace.
 		std::string _keyname;
 		std::string _key_cid;
 
+		// Looking up, or generating, the key can be slow; with the
+		// `async` open option, it's done in the background, and only
+		// the things that need the key wait for it.
+		bool _async_open;
+		std::string _key_type;
+		int _key_size;
+		std::thread _key_finder;
+		std::mutex _key_mutex;
+		std::condition_variable _key_cv;
+		bool _key_ready;
+		std::exception_ptr _key_exception;
+		size_t _key_msec;
+		std::atomic<size_t> _num_key_waits;
+		void parse_open_options(const std::string&);
+		void find_or_make_key(void);
+		static void key_finder_thread(IPFSAtomStorage*);
+		void wait_for_key(void);
+
+		// The pool that runs the `*_async()` fetches. See IPFSAsync.cc
+		size_t _async_threads;
+		std::mutex _job_mutex;
+		std::condition_variable _job_cv;
+		std::deque<std::function<void(void)>> _jobs;
+		std::vector<std::thread> _job_threads;
+		bool _jobs_stop;
+		std::atomic<size_t> _num_jobs_submitted;
+		std::atomic<size_t> _num_jobs_done;
+		void submit_job(std::function<void(void)>);
+		static void job_thread(IPFSAtomStorage*);
+		void stop_jobs(void);
+		template<typename T> std::future<T> run_async(std::function<T(void)>);
+
+		// Bulk loads and stores, run in the background, each on a
+		// thread of its own. See IPFSBulk.cc
+		struct BulkJob
+		{
+			std::string kind;
+			std::string path;
+			std::atomic<size_t> done;
+			std::atomic<size_t> total;
+			size_t start_bytes;
+			std::atomic<size_t> bytes;
+			std::chrono::steady_clock::time_point start;
+			std::chrono::steady_clock::time_point finish;
+			std::atomic<bool> cancel;
+			std::atomic<int> state;
+			std::string error;
+			std::thread runner;
+		};
+		enum BulkState { JOB_RUNNING, JOB_FINISHED, JOB_CANCELLED, JOB_FAILED };
+		static const char* bulk_state_name(int);
+		std::mutex _bulk_mutex;
+		std::map<int, std::shared_ptr<BulkJob>> _bulk_jobs;
+		int _next_bulk_id;
+		size_t rpc_bytes(void);
+		int start_bulk_job(std::shared_ptr<BulkJob>,
+		                   std::function<void(BulkJob*)>);
+		std::shared_ptr<BulkJob> get_bulk_job(int);
+		void store_batches(const HandleSeq&, BulkJob*);
+		void stop_bulk_jobs(void);
+
 		// ---------------------------------------------
 		// The IPFS CID of the current atomspace.
 		std::mutex _atomspace_cid_mutex;
@@ -84,8 +295,14 @@ class IPFSAtomStorage : public BackingStore
 		// ---------------------------------------------
 		// Fetching of atoms.
 		ipfs::Json fetch_atom_dag(const std::string&);
+		void fetch_atom_dags(const std::vector<std::string>&,
+		                     std::vector<ipfs::Json>&);
+		void fetch_concurrently(size_t, const std::function<void(size_t)>&);
+		bool resolve_by_path(size_t);
+		void prefetch_outgoing(const ipfs::Json&);
 		Handle decodeStrAtom(const std::string&);
 		Handle decodeJSONAtom(const ipfs::Json&);
+		Handle decode_atom_dag(const ipfs::Json&);
 		Handle do_fetch_atom(Handle&);
 
 		// --------------------------
@@ -96,18 +313,26 @@ class IPFSAtomStorage : public BackingStore
 			return h->to_short_string(); }
 		ipfs::Json encodeAtomToJSON(const Handle&);
 
-		std::mutex _guid_mutex;
-		std::unordered_map<Handle, std::string> _guid_map;
+		// With the `outgoing=links` open option, outgoing sets are
+		// written as IPLD links, `{"/": guid}`, rather than as bare
+		// GUID strings, so that the daemon can follow them.
+		bool _ipld_links;
+		bool ipld_encoded(const Handle& h) const
+		{ return _ipld_links and h->is_link(); }
 
-		// The inverted map to above.
-		std::mutex _inv_mutex;
-		std::unordered_map<std::string, Handle> _guid_inv_map;
+		// The GUIDs of the Atoms linked into this AtomSpace. The
+		// inverse, GUID to Atom, is kept in _shared.
+		std::mutex _guid_mutex;
+		std::unordered_map<Handle, IPFSCid> _guid_map;
+		Handle guid_to_atom(const std::string&);
 
 		std::mutex _atom_cid_mutex;
-		std::unordered_map<Handle, std::string> _atom_cid_map;
+		std::unordered_map<Handle, IPFSCid> _atom_cid_map;
 
 		void do_store_atom(const Handle&);
-		void vdo_store_atom(const Handle&);
+		void vdo_store_atom(const Handle&, WriteLane);
+		void vdo_store_interactive(const Handle&);
+		void vdo_store_bulk(const Handle&);
 		void do_store_single_atom(const Handle&);
 
 		bool guid_not_yet_stored(const Handle&);
@@ -118,7 +343,9 @@ class IPFSAtomStorage : public BackingStore
 		bool bulk_store;
 		time_t bulk_start;
 
-		void load_as_from_cid(AtomSpace*, const std::string&);
+		std::string path_to_cid(const std::string&);
+		void load_as_from_cid(AtomSpace*, const std::string&,
+		                      BulkJob* job = nullptr);
 
 		// --------------------------
 		// Values
@@ -128,10 +355,82 @@ class IPFSAtomStorage : public BackingStore
 		ipfs::Json encodeValuesToJSON(const Handle&);
 		ValuePtr decodeStrValue(const std::string&);
 
+		// With the `values=blocks` open option, each Value is put in
+		// a block of its own, and the Atom holds only links to them,
+		// keyed by the GUID of the key. Unchanged Values are not
+		// uploaded again.
+		bool _value_blocks;
+		ipfs::Json encodeValuesToLinks(const Handle&,
+		                               std::vector<std::string>&);
+		std::string put_value_block(const std::string&, size_t shard);
+		std::string fetch_value_block(const std::string&);
+		std::atomic<size_t> _num_value_blocks_put;
+		std::atomic<size_t> _num_value_blocks_reused;
+		std::atomic<size_t> _num_value_blocks_fetched;
+
+		// The Value each key last held, when the Atom was stored, and
+		// the CID of its block. A key still holding that very Value
+		// is neither encoded nor hashed again.
+		struct StoredValue
+		{
+			std::weak_ptr<Value> value;
+			std::string cid;
+		};
+		std::mutex _stored_value_mutex;
+		std::map<Handle, std::map<Handle, StoredValue>> _stored_values;
+		bool recall_value_cid(const Handle&, const Handle&,
+		                      const ValuePtr&, std::string&);
+		void remember_value_cid(const Handle&, const Handle&,
+		                        const ValuePtr&, const std::string&);
+		void forget_stored_values(const HandleSeq&);
+		std::atomic<size_t> _num_values_unchanged;
+
+		// Value payloads of `_compress_threshold` bytes or more are
+		// compressed; zero turns compression off. See IPFSCompress.cc
+		size_t _compress_threshold;
+		int _compress_level;
+		std::string compress_value(const std::string&);
+		std::string expand_value(const std::string&);
+		static bool have_compression(void);
+		std::atomic<size_t> _num_compressed;
+		std::atomic<size_t> _num_compress_skips;
+		std::atomic<size_t> _num_expanded;
+		std::atomic<size_t> _compress_bytes_in;
+		std::atomic<size_t> _compress_bytes_out;
+		std::atomic<size_t> _compress_usec;
+		std::atomic<size_t> _expand_usec;
+
 		// --------------------------
 		// Incoming set management
 		void store_incoming_of(const Handle &, const Handle&);
-		void remove_incoming_of(const Handle &, const std::string&);
+		static std::vector<std::string> incoming_guids(const ipfs::Json&);
+		ipfs::Json typed_incoming(const ipfs::Json&);
+		std::atomic<size_t> _num_incoming_upgrades;
+
+		// --------------------------
+		// Deletion. A recursive delete is done as a batch; see
+		// IPFSAtomDelete.cc
+		struct Removal
+		{
+			HandleSeq doomed;
+			HandleSet gone;
+			// GUIDs of the doomed Atoms, as found in incoming sets.
+			std::map<Handle, std::string> guids;
+			// Survivors whose incoming sets were edited, and their
+			// new CIDs, by directory entry name.
+			HandleSeq stripped;
+			std::map<std::string, std::string> relink;
+			// Of those, the ones not yet linked into the directory.
+			std::set<std::string> fresh;
+		};
+		bool removal_closure(const Handle&, bool, Removal&);
+		void strip_incoming(Removal&);
+		void rewrite_directory(const Removal&);
+		std::string rewrite_links(const std::string&, size_t,
+		                          const std::set<std::string>&,
+		                          const std::map<std::string, std::string>&,
+		                          const std::set<std::string>&);
+		void forget_removed(const Removal&);
 
 		// --------------------------
 		// Performance statistics
@@ -148,15 +447,224 @@ class IPFSAtomStorage : public BackingStore
 		std::atomic<size_t> _store_count;
 		std::atomic<size_t> _valuation_stores;
 		std::atomic<size_t> _value_stores;
+		std::atomic<size_t> _num_publish_requests;
+		std::atomic<size_t> _num_publishes;
+		std::atomic<size_t> _num_publish_skips;
+		std::atomic<size_t> _num_publish_fails;
+		std::atomic<size_t> _publish_msec;
+		std::atomic<size_t> _publish_slowest_msec;
 		time_t _stats_time;
 
+		// Serializes snapshots against resets, so that a snapshot
+		// never sees a half-cleared set of counters.
+		std::mutex _stats_mutex;
+		static ipfs::Json histogram_json(const LatencyHistogram&);
+
 		// --------------------------
-		// Provider of asynchronous store of atoms.
+		// Provider of asynchronous store of atoms. There is one
+		// queue per lane; _write_queue is the interactive lane.
 		// async_caller<IPFSAtomStorage, Handle> _write_queue;
 		async_buffer<IPFSAtomStorage, Handle> _write_queue;
+		async_buffer<IPFSAtomStorage, Handle> _bulk_queue;
+		async_buffer<IPFSAtomStorage, Handle>& lane_queue(WriteLane lane) {
+			return (LANE_BULK == lane) ? _bulk_queue : _write_queue; }
 		std::exception_ptr _async_write_queue_exception;
 		void rethrow(void);
 
+		// The lane used by storeAtom(), for the calling thread.
+		static thread_local WriteLane _thread_lane;
+
+		struct LaneStats
+		{
+			std::mutex mtx;
+			std::unordered_map<Handle, std::chrono::steady_clock::time_point> enqueued;
+			LatencyHistogram queue_wait;
+			LatencyHistogram store_time;
+		};
+		LaneStats _lane_stats[LANE_NUM];
+		size_t _interactive_writers;
+		std::atomic<size_t> _num_bulk_borrows;
+		WriteLane borrow_lane(WriteLane);
+
+		// Optional byte accounting for the write queue. When the
+		// byte high-watermark is set, the estimated encoded size of
+		// each queued Atom, and its Values, is tracked, and writers
+		// stall while more than that many bytes are queued, until
+		// the queue drains below the low watermark.
+		std::atomic<bool> _qbytes_enabled;
+		std::mutex _qbytes_mutex;
+		std::condition_variable _qbytes_cv;
+		std::unordered_map<Handle, size_t> _qbytes_map;
+		size_t _queued_bytes;
+		size_t _queued_bytes_peak;
+		size_t _qbytes_high;
+		size_t _qbytes_low;
+		std::atomic<size_t> _qbytes_stalls;
+		LatencyHistogram _qbytes_stall_time;
+		void queue_store(const Handle&, WriteLane);
+		void enqueue_store(const Handle&, WriteLane, std::promise<void>*);
+		size_t unqueue_bytes(const Handle&);
+		void release_bytes(size_t);
+		size_t estimate_size(const Handle&);
+		size_t estimate_bare_size(const Handle&);
+		size_t estimate_value_size(const ValuePtr&);
+
+		// --------------------------
+		// Optional write-ahead log. When open, asynchronous stores
+		// are appended to a local file, and return immediately. A
+		// committer thread pushes them to IPFS, in batches, through
+		// the write queue above, and then records a checkpoint.
+		struct WALRecord
+		{
+			uint64_t seq;
+			Handle atom;
+			WriteLane lane;
+		};
+		std::atomic<bool> _wal_enabled;
+		std::string _wal_path;
+		int _wal_fd;
+		bool _wal_sync;
+		std::mutex _wal_mutex;
+		std::condition_variable _wal_cv;
+		std::deque<WALRecord> _wal_pending;
+		uint64_t _wal_next_seq;
+		uint64_t _wal_committed_seq;
+		bool _wal_keep_going;
+		bool _wal_stalled;
+		std::thread _wal_committer;
+		bool wal_append(const Handle&, WriteLane);
+		void wal_replay(void);
+		void wal_checkpoint(uint64_t, const std::string&);
+		void wal_wait_committed(std::unique_lock<std::mutex>&);
+		static void wal_commit_thread(IPFSAtomStorage*);
+		static void write_file_atomically(const std::string&,
+		                                  const std::string&);
+		void reset_atomspace_cid(const std::string&);
+
+		// --------------------------
+		// Optional checkpoints of bulk stores. When open, each batch
+		// of a bulk store is recorded in a journal, once stored, and
+		// the AtomSpace CID is checkpointed every so often. A bulk
+		// store that is restarted skips what was already stored.
+		// See IPFSCheckpoint.cc
+		std::mutex _ckpt_mutex;
+		std::atomic<bool> _ckpt_enabled;
+		std::string _ckpt_path;
+		int _ckpt_fd;
+		size_t _ckpt_interval;
+		size_t _ckpt_atoms;
+		size_t _ckpt_last;
+		std::unordered_map<std::string, IPFSCid> _ckpt_guids;
+		void ckpt_resume(void);
+		HandleSeq ckpt_skip(const HandleSeq&);
+		void ckpt_record(const HandleSeq&, size_t, size_t);
+		void ckpt_write(void);
+		void ckpt_finish(bool);
+		HandleSeq bulk_atoms(const AtomTable&);
+
+		// --------------------------
+		// Overlay of pending asynchronous stores. Every Atom that
+		// is queued (or logged), and everything in its outgoing
+		// tree, is listed here, by name, until it has been stored.
+		// Reads consult this first, and fences wait on it, instead
+		// of draining the whole write queue.
+		struct PendingStore
+		{
+			bool queued;
+			size_t inflight;
+			std::exception_ptr error;
+			std::vector<std::promise<void>> waiters;
+		};
+		struct PendingAtom
+		{
+			Handle atom;
+			size_t refs;
+			std::unordered_multiset<Handle> holders;
+		};
+		std::mutex _pending_mutex;
+		std::condition_variable _pending_cv;
+		std::unordered_map<Handle, PendingStore> _pending_stores;
+		std::unordered_map<std::string, PendingAtom> _pending_atoms;
+		bool pending_add(const Handle&, std::promise<void>* = nullptr);
+		void pending_begin(const Handle&);
+		void pending_done(const Handle&, std::exception_ptr = nullptr);
+		void pending_touch(const Handle&, const Handle&, bool);
+		Handle pending_lookup(const Handle&);
+		HandleSeq pending_holders(const Handle&);
+
+		// --------------------------
+		// Membership filter over the names in the AtomSpace
+		// directory, so that lookups of absent Atoms need not go
+		// to the daemon. See IPFSFilter.cc
+		std::mutex _filter_mutex;
+		MembershipFilter _filter;
+		std::atomic<bool> _filter_valid;
+		std::atomic<bool> _filter_stale;
+		void rebuild_filter(void);
+		void clear_filter(void);
+		void invalidate_filter(void);
+		void filter_add(const std::string&);
+		void filter_remove(const std::string&);
+		bool filter_may_contain(const Handle&);
+		Handle filtered_fetch(Handle&);
+		std::atomic<size_t> _num_filter_negatives;
+		std::atomic<size_t> _num_filter_false_positives;
+		std::atomic<size_t> _num_filter_rebuilds;
+
+		std::atomic<size_t> _num_multi_gets;
+		std::atomic<size_t> _num_multi_get_atoms;
+		std::atomic<size_t> _num_closure_prefetches;
+		std::atomic<size_t> _num_closure_rounds;
+		std::atomic<size_t> _num_closure_blocks;
+
+		// --------------------------
+		// Read-only snapshot, for ipfs:///ipfs/Qm... URIs. Nothing
+		// can change, so the directory is read once, when opened,
+		// and every block fetched is kept for good. Lookups of Atoms
+		// in the directory take no locks. See IPFSSnapshot.cc
+		struct SnapshotEntry
+		{
+			std::string cid;
+			std::atomic<const ipfs::Json*> dag{nullptr};
+		};
+		static const size_t SNAPSHOT_SHARDS = 64;
+		struct BlockShard
+		{
+			std::mutex mtx;
+			std::unordered_map<std::string, ipfs::Json> blocks;
+		};
+		bool _read_only;
+		std::unique_ptr<SnapshotEntry[]> _snapshot;
+		size_t _snapshot_size;
+		std::unordered_map<std::string, SnapshotEntry*> _snapshot_names;
+		std::unordered_map<std::string, SnapshotEntry*> _snapshot_cids;
+		BlockShard _snapshot_blocks[SNAPSHOT_SHARDS];
+		void open_snapshot(void);
+		void close_snapshot(void);
+		void check_writable(const char*);
+		const ipfs::Json& snapshot_block(SnapshotEntry&);
+		const ipfs::Json& snapshot_fetch(const std::string&);
+		ipfs::Json snapshot_atom_json(const Handle&);
+		std::atomic<size_t> _snapshot_cached;
+		std::atomic<size_t> _num_snapshot_hits;
+		std::atomic<size_t> _num_snapshot_misses;
+
+		std::atomic<size_t> _num_overlay_hits;
+		std::atomic<size_t> _num_fences;
+		std::atomic<size_t> _num_fence_waits;
+		LatencyHistogram _fence_wait;
+
+		std::atomic<size_t> _wal_appends;
+		std::atomic<size_t> _wal_batches;
+		std::atomic<size_t> _wal_committed;
+		std::atomic<size_t> _wal_replayed;
+		std::atomic<size_t> _wal_failures;
+		LatencyHistogram _wal_commit_latency;
+
+		std::atomic<size_t> _ckpt_resumed;
+		std::atomic<size_t> _ckpt_skipped;
+		std::atomic<size_t> _ckpt_writes;
+
 	public:
 		IPFSAtomStorage(std::string uri);
 		IPFSAtomStorage(const IPFSAtomStorage&) = delete; // disable copying
@@ -165,15 +673,41 @@ class IPFSAtomStorage : public BackingStore
 		bool connected(void); // connection to DB is alive
 		std::string get_ipfs_cid(void);
 		std::string get_ipns_key(void);
+		bool is_read_only(void) const { return _read_only; }
 		void publish_atomspace(void);
 		void resolve_atomspace(void);
+		void set_publish_options(const std::string& lifetime,
+		                         const std::string& ttl,
+		                         int min_interval_secs);
 
 		std::string get_atom_guid(const Handle&);
 		Handle fetch_atom(const std::string&);
+		HandleSeq fetch_incoming_set(const Handle&);
 		void load_atomspace(AtomSpace*, const std::string&);
 
+		// These return at once; see IPFSAsync.cc
+		std::future<Handle> fetch_atom_async(const std::string&);
+		std::future<Handle> get_atom_async(const Handle&);
+		std::future<HandleSeq> get_incoming_async(const Handle&);
+		std::future<void> store_atom_async(const Handle&);
+
+		// Bulk load and store in the background; see IPFSBulk.cc
+		// These return a job number, for the calls that follow.
+		int load_atomspace_job(AtomSpace*, const std::string&);
+		int store_atomspace_job(const AtomTable&);
+		ipfs::Json bulk_job_status(int);
+		void cancel_bulk_job(int);
+		void wait_bulk_job(int);
+
 		void kill_data(void); // destroy DB contents
 
+		void open_wal(const std::string& path, bool sync = false);
+		void close_wal(void);
+
+		void open_checkpoint(const std::string& path,
+		                     size_t interval = 10000);
+		void close_checkpoint(void);
+
 		void registerWith(AtomSpace*);
 		void unregisterWith(AtomSpace*);
 		void extract_callback(const AtomPtr&);
@@ -182,20 +716,33 @@ class IPFSAtomStorage : public BackingStore
 		// AtomStorage interface
 		Handle getNode(Type, const char *);
 		Handle getLink(Type, const HandleSeq&);
+		HandleSeq fetchAtoms(const HandleSeq&);
 		void getIncomingSet(AtomTable&, const Handle&);
 		void getIncomingByType(AtomTable&, const Handle&, Type t);
 		void storeAtom(const Handle&, bool synchronous = false);
+		void storeAtom(const Handle&, WriteLane);
+		static void set_thread_lane(WriteLane lane) { _thread_lane = lane; }
+		static WriteLane get_thread_lane(void) { return _thread_lane; }
 		void removeAtom(const Handle&, bool recursive);
 		void loadType(AtomTable&, Type);
 		void loadAtomSpace(AtomTable&); // Load entire contents
 		void storeAtomSpace(const AtomTable&); // Store entire contents
 		void barrier();
 		void flushStoreQueue();
+		void fence(const Handle&);
 
 		// Debugging and performance monitoring
 		void print_stats(void);
 		void clear_stats(void); // reset stats counters.
+		ipfs::Json get_stats(void);
+		std::string get_stats_prometheus(void);
+
+		// Span tracing, written as Chrome trace-event JSON.
+		void start_trace(size_t max_events = 1000000);
+		void stop_trace(void);
+		void dump_trace(const std::string& filename);
 		void set_hilo_watermarks(int, int);
+		void set_byte_watermarks(size_t, size_t);
 		void set_stall_writers(bool);
 };
 
@@ -27,21 +27,66 @@ using namespace opencog;
  * thread); this routine merely queues up the atom. If the synchronous
  * flag is set, then the store is performed in this thread, and it is
  * completed (sent to the IPFS daemon) before this method returns.
+ *
+ * Asynchronous stores are queued in the calling thread's lane; see
+ * set_thread_lane(). If the write-ahead log is open, they are appended
+ * to the log, instead of being queued; see IPFSWriteLog.cc
  */
 void IPFSAtomStorage::storeAtom(const Handle& h, bool synchronous)
 {
-	rethrow();
+	check_writable("store atoms");
 
 	// If a synchronous store, avoid the queues entirely.
 	if (synchronous)
 	{
+		rethrow();
+
+		TraceSpan span(_tracer, "storeAtom", "atom", h);
 		if (guid_not_yet_stored(h)) do_store_atom(h);
 		store_atom_values(h);
 		return;
 	}
 
-	// _write_queue.enqueue(h);
-	_write_queue.insert(h);
+	storeAtom(h, _thread_lane);
+}
+
+/// Asynchronously store the atom, queueing it in the given lane.
+void IPFSAtomStorage::storeAtom(const Handle& h, WriteLane lane)
+{
+	enqueue_store(h, lane, nullptr);
+}
+
+/// Queue the atom; if `done` is given, it is kept, and is fulfilled
+/// once the atom has been stored.
+void IPFSAtomStorage::enqueue_store(const Handle& h, WriteLane lane,
+                                    std::promise<void>* done)
+{
+	check_writable("store atoms");
+	rethrow();
+
+	TraceSpan span(_tracer, "storeAtom", "atom", h);
+
+	// Reads see the Atom from now on, even before it is stored.
+	bool was_queued = pending_add(h, done);
+
+	try
+	{
+		if (_wal_enabled and wal_append(h, lane)) return;
+	}
+	catch (...)
+	{
+		// Neither logged nor queued. Unless an earlier store of the
+		// Atom is still queued, it is not pending after all; this
+		// unlists it, and fails the waiters.
+		if (not was_queued)
+		{
+			pending_begin(h);
+			pending_done(h, std::current_exception());
+		}
+		throw;
+	}
+
+	queue_store(h, lane);
 }
 
 /**
@@ -55,6 +100,8 @@ void IPFSAtomStorage::storeAtom(const Handle& h, bool synchronous)
  */
 void IPFSAtomStorage::do_store_atom(const Handle& h)
 {
+	TraceSpan span(_tracer, "do_store_atom", "atom", h);
+
 	if (not guid_not_yet_stored(h)) return;
 
 	if (h->is_node())
@@ -79,8 +126,24 @@ void IPFSAtomStorage::do_store_atom(const Handle& h)
 /// when it gets dequeued, this method is called to store it.
 /// Take careful note of the design here: the only things that
 ///
-void IPFSAtomStorage::vdo_store_atom(const Handle& h)
+void IPFSAtomStorage::vdo_store_atom(const Handle& h, WriteLane lane)
 {
+	LaneStats& ls = _lane_stats[lane];
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lck(ls.mtx);
+		auto it = ls.enqueued.find(h);
+		if (it != ls.enqueued.end())
+		{
+			ls.queue_wait.record(std::chrono::duration_cast<
+				std::chrono::microseconds>(start - it->second).count());
+			ls.enqueued.erase(it);
+		}
+	}
+
+	pending_begin(h);
+	size_t bytes = unqueue_bytes(h);
+	std::exception_ptr err;
 	try
 	{
 		do_store_atom(h);
@@ -88,10 +151,178 @@ void IPFSAtomStorage::vdo_store_atom(const Handle& h)
 	}
 	catch (...)
 	{
-		_async_write_queue_exception = std::current_exception();
+		err = std::current_exception();
+		_async_write_queue_exception = err;
+	}
+	release_bytes(bytes);
+	pending_done(h, err);
+	ls.store_time.record_since(start);
+}
+
+void IPFSAtomStorage::vdo_store_interactive(const Handle& h)
+{
+	vdo_store_atom(h, LANE_INTERACTIVE);
+}
+
+void IPFSAtomStorage::vdo_store_bulk(const Handle& h)
+{
+	vdo_store_atom(h, LANE_BULK);
+}
+
+thread_local IPFSAtomStorage::WriteLane
+	IPFSAtomStorage::_thread_lane = IPFSAtomStorage::LANE_INTERACTIVE;
+
+const char* IPFSAtomStorage::lane_name(WriteLane lane)
+{
+	switch (lane)
+	{
+		case LANE_INTERACTIVE: return "interactive";
+		case LANE_BULK:        return "bulk";
+		default:               return "unknown";
 	}
 }
 
+/* ================================================================ */
+// Byte accounting for the write queue.
+
+/// Bulk stores borrow the interactive writers that have nothing to
+/// do: a bulk Atom goes to the interactive queue when fewer Atoms are
+/// queued or being stored there than there are writers. Interactive
+/// stores thus wait behind at most one bulk Atom per writer, while a
+/// bulk-only workload keeps every writer busy.
+IPFSAtomStorage::WriteLane IPFSAtomStorage::borrow_lane(WriteLane lane)
+{
+	if (LANE_BULK != lane) return lane;
+	if (_interactive_writers <=
+	    _write_queue.get_size() + _write_queue.get_busy_writers())
+		return lane;
+	_num_bulk_borrows++;
+	return LANE_INTERACTIVE;
+}
+
+/// Place the atom on the write queue for the lane. If byte accounting
+/// is on, and the queues hold too many bytes, wait for them to drain
+/// first.
+void IPFSAtomStorage::queue_store(const Handle& h, WriteLane lane)
+{
+	if (_qbytes_enabled)
+	{
+		size_t bytes = estimate_size(h);
+		std::unique_lock<std::mutex> lck(_qbytes_mutex);
+		if (_qbytes_high < _queued_bytes + bytes and 0 < _queued_bytes)
+		{
+			auto start = std::chrono::steady_clock::now();
+			_qbytes_stalls++;
+			_qbytes_cv.wait(lck, [this] {
+				return _queued_bytes <= _qbytes_low or not _qbytes_enabled; });
+			_qbytes_stall_time.record_since(start);
+		}
+
+		// If the atom is already queued, the write queue drops the
+		// duplicate; just update its size.
+		auto it = _qbytes_map.find(h);
+		if (it != _qbytes_map.end())
+		{
+			_queued_bytes -= it->second;
+			it->second = bytes;
+		}
+		else
+			_qbytes_map.emplace(h, bytes);
+		_queued_bytes += bytes;
+		if (_queued_bytes_peak < _queued_bytes)
+			_queued_bytes_peak = _queued_bytes;
+	}
+
+	// Note the time of the first enqueue; the write queue drops
+	// duplicates, so later ones don't count.
+	lane = borrow_lane(lane);
+	{
+		LaneStats& ls = _lane_stats[lane];
+		std::lock_guard<std::mutex> lck(ls.mtx);
+		ls.enqueued.emplace(h, std::chrono::steady_clock::now());
+	}
+
+	// _write_queue.enqueue(h);
+	lane_queue(lane).insert(h);
+}
+
+/// The atom is being taken off the queue, to be stored. Return the
+/// bytes it was charged; these stay charged until it's stored.
+size_t IPFSAtomStorage::unqueue_bytes(const Handle& h)
+{
+	if (not _qbytes_enabled) return 0;
+	std::lock_guard<std::mutex> lck(_qbytes_mutex);
+	auto it = _qbytes_map.find(h);
+	if (it == _qbytes_map.end()) return 0;
+	size_t bytes = it->second;
+	_qbytes_map.erase(it);
+	return bytes;
+}
+
+void IPFSAtomStorage::release_bytes(size_t bytes)
+{
+	if (0 == bytes) return;
+	{
+		std::lock_guard<std::mutex> lck(_qbytes_mutex);
+		_queued_bytes = (bytes < _queued_bytes) ? _queued_bytes - bytes : 0;
+		if (_qbytes_low < _queued_bytes) return;
+	}
+	_qbytes_cv.notify_all();
+}
+
+/// A rough estimate of the size of the encoded Atom and its Values.
+/// It does not need to be exact; it only needs to grow in proportion
+/// to the memory and bandwidth that storing the atom will take.
+size_t IPFSAtomStorage::estimate_size(const Handle& h)
+{
+	size_t bytes = estimate_bare_size(h);
+	for (const Handle& key: h->getKeys())
+		bytes += estimate_bare_size(key) + estimate_value_size(h->getValue(key));
+
+	return bytes;
+}
+
+/// The estimated size of the Atom alone, without its Values. Only the
+/// GUIDs of the outgoing Atoms are written, so each one costs the
+/// same, no matter how big it is, or what Values it carries.
+size_t IPFSAtomStorage::estimate_bare_size(const Handle& h)
+{
+	if (h->is_node())
+		return 32 + h->get_name().size();
+	return 32 + 48 * h->getOutgoingSet().size();
+}
+
+size_t IPFSAtomStorage::estimate_value_size(const ValuePtr& v)
+{
+	if (nullptr == v) return 0;
+	Type t = v->get_type();
+
+	// About 20 characters for a double, printed at full precision.
+	if (nameserver().isA(t, FLOAT_VALUE))
+		return 16 + 20 * FloatValueCast(v)->value().size();
+
+	if (nameserver().isA(t, STRING_VALUE))
+	{
+		size_t bytes = 16;
+		for (const std::string& s: StringValueCast(v)->value())
+			bytes += s.size() + 3;
+		return bytes;
+	}
+
+	if (nameserver().isA(t, LINK_VALUE))
+	{
+		size_t bytes = 16;
+		for (const ValuePtr& vp: LinkValueCast(v)->value())
+			bytes += estimate_value_size(vp);
+		return bytes;
+	}
+
+	if (v->is_atom())
+		return estimate_bare_size(HandleCast(v));
+
+	return 64;
+}
+
 bool IPFSAtomStorage::guid_not_yet_stored(const Handle& h)
 {
 	std::lock_guard<std::mutex> lck(_guid_mutex);
@@ -120,7 +351,10 @@ ipfs::Json IPFSAtomStorage::encodeAtomToJSON(const Handle& h)
 		int i=0;
 		for (const Handle& hout: h->getOutgoingSet())
 		{
-			oset[i] = get_atom_guid(hout);
+			if (_ipld_links)
+				oset[i] = {{"/", get_atom_guid(hout)}};
+			else
+				oset[i] = get_atom_guid(hout);
 			i++;
 		}
 		jatom["outgoing"] = oset;
@@ -142,27 +376,40 @@ ipfs::Json IPFSAtomStorage::encodeAtomToJSON(const Handle& h)
  */
 void IPFSAtomStorage::do_store_single_atom(const Handle& h)
 {
+	TraceSpan span(_tracer, "do_store_single_atom", "atom", h);
+
 	// Convert C++ Atom to json. But only the core, unique
 	// Atom, and NOT the values! Nor the incoming set...
 	ipfs::Json jatom = encodeAtomToJSON(h);
 
-	// XXX FIXME If ipfs throws, then this leaks from the pool
-	// We can't just catch here, we need to re-throw too.
-	ipfs::Json result;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagPut(jatom, &result);
-	conn_pool.push(conn);
+	// The GUID depends only on the Atom. If some AtomSpace on the
+	// Atom's daemon has already stored it, the block is already there.
+	std::string label(encodeAtomToStr(h));
+	IPFSShared& home = atom_home(label);
+	bool links = ipld_encoded(h);
+	std::string guid;
+	IPFSCid gcid(home.get_guid(label, links));
+	if (not gcid.empty())
+	{
+		_num_shared_guid_hits++;
+		guid = gcid.to_string();
+	}
+	else
+	{
+		guid = dag_put(jatom, atom_shard(label));
+		gcid = IPFSCid(guid);
+		_shared->put_block(guid, jatom);
+		home.record_guid(label, links, gcid);
+	}
 
-	std::string guid = result["Cid"]["/"];
+	// GUIDs are turned back into Atoms through the primary.
+	if (&home != _shared.get())
+		_shared->record_guid(label, links, gcid);
 
 	// Record the guid once and forevermore.
 	{
 		std::lock_guard<std::mutex> lck(_guid_mutex);
-		_guid_map[h] = guid;
-	}
-	{
-		std::lock_guard<std::mutex> lck(_inv_mutex);
-		_guid_inv_map[guid] = h;
+		_guid_map[h] = gcid;
 	}
 
 	// OK, the atom itself is in IPFS; add it to the atomspace, too.
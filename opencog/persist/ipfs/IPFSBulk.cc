@@ -2,6 +2,13 @@
  * IPFSBulk.cc
  * Bulk save & restore of entire AtomSpaces.
  *
+ * Bulk loads and stores can also be run in the background, as jobs,
+ * each on a thread of its own. Jobs work in batches; their progress
+ * can be polled, and they can be cancelled between one batch and the
+ * next. A store job waits for each batch to be fully written before
+ * starting the next, so a cancelled store leaves the AtomSpace CID
+ * naming exactly those Atoms that were stored, and nothing half-done.
+ *
  * Copyright (c) 2008,2009,2013,2017,2019 Linas Vepstas <linas@linas.org>
  * SPDX-License-Identifier: AGPL-3.0-or-later
  */
@@ -19,6 +26,10 @@
 
 using namespace opencog;
 
+// The number of Atoms fetched, or stored, at a time. Jobs can be
+// cancelled only between batches.
+#define BULK_BATCH_SIZE 100
+
 /* ================================================================ */
 
 /// load_atomspace -- load AtomSpace from path.
@@ -28,31 +39,29 @@ void IPFSAtomStorage::load_atomspace(AtomSpace* as, const std::string& path)
 {
 	rethrow();
 
+	TraceSpan span(_tracer, "load_atomspace", "bulk", path);
+
+	load_as_from_cid(as, path_to_cid(path));
+}
+
+/// Return the IPFS CID that the path names.
+std::string IPFSAtomStorage::path_to_cid(const std::string& path)
+{
 	if ('/' != path[0])
-	{
-		load_as_from_cid(as, path);
-		return;
-	}
+		return path;
 
 	if (std::string::npos != path.find("/ipfs/"))
-	{
-		load_as_from_cid(as, &path[sizeof("/ipfs/") - 1]);
-		return;
-	}
+		return &path[sizeof("/ipfs/") - 1];
 
 	if (std::string::npos != path.find("/ipns/"))
 	{
 		// Caution: as of this writing, name resolution takes
 		// exactly 60 seconds.
-		std::string ipfs_path;
-		ipfs::Client* conn = conn_pool.pop();
-		conn->NameResolve(path, &ipfs_path);
-		conn_pool.push(conn);
+		std::string ipfs_path = name_resolve(path);
 
 		// We are expecting the name to resolve into a string
 		// of the form "/ipfs/Qm..."
-		load_as_from_cid(as, &ipfs_path[sizeof("/ipfs/") - 1]);
-		return;
+		return &ipfs_path[sizeof("/ipfs/") - 1];
 	}
 
 	throw RuntimeException(TRACE_INFO, "Unsupported URI %s\n", path.c_str());
@@ -62,41 +71,58 @@ void IPFSAtomStorage::load_atomspace(AtomSpace* as, const std::string& path)
 
 /// load_as_from_cid -- load all atoms listed at the indicated CID.
 /// The CID is presumed to be an IPFS CID (and not an IPNS CID or
-/// something else).
-void IPFSAtomStorage::load_as_from_cid(AtomSpace* as, const std::string& cid)
+/// something else). If this is run as a job, progress is reported
+/// to it, and it stops early if the job is cancelled.
+void IPFSAtomStorage::load_as_from_cid(AtomSpace* as, const std::string& cid,
+                                       BulkJob* job)
 {
 	rethrow();
 
 	size_t start_count = _load_count;
-	printf("Loading all atoms from %s\n", cid.c_str());
+	if (nullptr == job)
+		printf("Loading all atoms from %s\n", cid.c_str());
 	bulk_load = true;
 	bulk_start = time(0);
 
-	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagGet(cid, &dag);
-	conn_pool.push(conn);
-	// std::cout << "The atomspace dag is:" << dag.dump(2) << std::endl;
+	// If the AtomSpace is split, this is all of the shards.
+	const ipfs::Json atom_list = atomspace_links(cid);
+	if (job) job->total = atom_list.size();
 
-	auto atom_list = dag["links"];
-	for (auto acid: atom_list)
+	// The Atoms in a batch are fetched concurrently.
+	std::vector<std::string> cids;
+	std::vector<ipfs::Json> dags;
+	for (size_t i = 0; i < atom_list.size(); i += BULK_BATCH_SIZE)
 	{
-		// std::cout << "Atom CID is: " << acid["Cid"]["/"] << std::endl;
+		if (job and job->cancel) break;
 
 		// In the current design, the Cid entry is NOT an IPNS entry,
 		// but is instead the IPFS CID of the Atom, with values
 		// attached to it. So we have to fetch that, to get the latest
 		// values on the atom.
-		as->add_atom(fetch_atom(acid["Cid"]["/"]));
-		_load_count++;
-	}
+		size_t end = std::min(i + BULK_BATCH_SIZE, atom_list.size());
+		cids.clear();
+		for (size_t j = i; j < end; j++)
+			cids.push_back(atom_list[j]["Cid"]["/"]);
+		fetch_atom_dags(cids, dags);
 
-	time_t secs = time(0) - bulk_start;
-	double rate = ((double) _load_count) / secs;
-	printf("Finished loading %zu atoms in total in %d seconds (%d per second)\n",
-		(_load_count - start_count), (int) secs, (int) rate);
+		for (const ipfs::Json& adag : dags)
+		{
+			prefetch_outgoing(adag);
+			as->add_atom(decode_atom_dag(adag));
+		}
+		_load_count += cids.size();
+		if (job) job->done += cids.size();
+	}
 	bulk_load = false;
 
+	if (nullptr == job)
+	{
+		time_t secs = time(0) - bulk_start;
+		double rate = ((double) _load_count) / secs;
+		printf("Finished loading %zu atoms in total in %d seconds (%d per second)\n",
+			(_load_count - start_count), (int) secs, (int) rate);
+	}
+
 	// synchrnonize!
 	as->barrier();
 }
@@ -108,13 +134,9 @@ void IPFSAtomStorage::loadType(AtomTable &table, Type atom_type)
 {
 	rethrow();
 
-	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagGet(_atomspace_cid, &dag);
-	conn_pool.push(conn);
-	// std::cout << "The atomspace dag is:" << dag.dump(2) << std::endl;
+	TraceSpan span(_tracer, "loadType", "bulk");
 
-	auto atom_list = dag["links"];
+	ipfs::Json atom_list = atomspace_links(atomspace_root());
 	for (auto acid: atom_list)
 	{
 		// std::cout << "Atom CID is: " << acid["Cid"]["/"] << std::endl;
@@ -131,31 +153,55 @@ void IPFSAtomStorage::loadType(AtomTable &table, Type atom_type)
 /// Store all of the atoms in the atom table.
 void IPFSAtomStorage::storeAtomSpace(const AtomTable &table)
 {
+	check_writable("store atoms");
 	rethrow();
 
+	TraceSpan span(_tracer, "storeAtomSpace", "bulk");
+
 	logger().info("Bulk store of AtomSpace\n");
 
 	_store_count = 0;
 	bulk_start = time(0);
 	bulk_store = true;
 
-	// Try to knock out the nodes first, then the links.
-	table.foreachHandleByType(
-		[&](const Handle& h)->void { storeAtom(h); },
-		NODE, true);
+	// With a checkpoint open, go a batch at a time, so that there
+	// is something to checkpoint.
+	if (_ckpt_enabled)
+	{
+		store_batches(bulk_atoms(table), nullptr);
+	}
+	else
+	{
+		// Try to knock out the nodes first, then the links. These go
+		// in the bulk lane, so as not to hold up interactive stores.
+		table.foreachHandleByType(
+			[&](const Handle& h)->void { storeAtom(h, LANE_BULK); },
+			NODE, true);
 
-	table.foreachHandleByType(
-		[&](const Handle& h)->void { storeAtom(h); },
-		LINK, true);
+		table.foreachHandleByType(
+			[&](const Handle& h)->void { storeAtom(h, LANE_BULK); },
+			LINK, true);
 
-	flushStoreQueue();
+		flushStoreQueue();
+	}
 	bulk_store = false;
 
 	time_t secs = time(0) - bulk_start;
 	double rate = ((double) _store_count) / secs;
 	printf("\tFinished storing %lu atoms total, in %d seconds (%d per second)\n",
 		(unsigned long) _store_count, (int) secs, (int) rate);
-	printf("\tAtomSpace CID: %s\n", _atomspace_cid.c_str());
+	printf("\tAtomSpace CID: %s\n", atomspace_root().c_str());
+}
+
+/// All of the Atoms in the table, nodes first, then links.
+HandleSeq IPFSAtomStorage::bulk_atoms(const AtomTable& table)
+{
+	HandleSeq atoms;
+	table.foreachHandleByType(
+		[&](const Handle& h)->void { atoms.push_back(h); }, NODE, true);
+	table.foreachHandleByType(
+		[&](const Handle& h)->void { atoms.push_back(h); }, LINK, true);
+	return atoms;
 }
 
 void IPFSAtomStorage::loadAtomSpace(AtomTable &table)
@@ -163,7 +209,237 @@ void IPFSAtomStorage::loadAtomSpace(AtomTable &table)
 	// Perform an IPNS lookup, if a key was given.
 	if (0 < _keyname.size()) resolve_atomspace();
 
-	load_atomspace(table.getAtomSpace(), _atomspace_cid);
+	load_atomspace(table.getAtomSpace(), atomspace_root());
+}
+
+/* ================================================================ */
+// Bulk jobs
+
+const char* IPFSAtomStorage::bulk_state_name(int state)
+{
+	switch (state)
+	{
+		case JOB_RUNNING: return "running";
+		case JOB_FINISHED: return "finished";
+		case JOB_CANCELLED: return "cancelled";
+		case JOB_FAILED: return "failed";
+	}
+	return "unknown";
+}
+
+/// Bytes sent and received, by all daemon calls, so far.
+size_t IPFSAtomStorage::rpc_bytes(void)
+{
+	size_t bytes = 0;
+	for (int i = 0; i < RPC_NUM; i++)
+		bytes += _rpc_stats[i].bytes_sent + _rpc_stats[i].bytes_received;
+	return bytes;
+}
+
+/// Run `work` on a thread of its own, and return the job number.
+int IPFSAtomStorage::start_bulk_job(std::shared_ptr<BulkJob> job,
+                                    std::function<void(BulkJob*)> work)
+{
+	job->done = 0;
+	job->start_bytes = rpc_bytes();
+	job->bytes = 0;
+	job->start = std::chrono::steady_clock::now();
+	job->cancel = false;
+	job->state = JOB_RUNNING;
+
+	std::lock_guard<std::mutex> lck(_bulk_mutex);
+	int id = _next_bulk_id++;
+	BulkJob* jp = job.get();
+	job->runner = std::thread([this, jp, work](void)
+	{
+		int state = JOB_FINISHED;
+		try
+		{
+			work(jp);
+			if (jp->cancel and jp->done < jp->total)
+				state = JOB_CANCELLED;
+		}
+		catch (const std::exception& ex)
+		{
+			jp->error = ex.what();
+			state = JOB_FAILED;
+		}
+		jp->bytes = rpc_bytes() - jp->start_bytes;
+		jp->finish = std::chrono::steady_clock::now();
+		jp->state = state;
+	});
+	_bulk_jobs[id] = job;
+	return id;
+}
+
+std::shared_ptr<IPFSAtomStorage::BulkJob> IPFSAtomStorage::get_bulk_job(int id)
+{
+	std::lock_guard<std::mutex> lck(_bulk_mutex);
+	auto it = _bulk_jobs.find(id);
+	if (_bulk_jobs.end() == it)
+		throw RuntimeException(TRACE_INFO, "No such bulk job: %d", id);
+	return it->second;
+}
+
+/// Load all of the Atoms at the path into the AtomSpace, in the
+/// background.
+int IPFSAtomStorage::load_atomspace_job(AtomSpace* as, const std::string& path)
+{
+	rethrow();
+
+	auto job = std::make_shared<BulkJob>();
+	job->kind = "load";
+	job->path = path;
+	job->total = 0;
+	return start_bulk_job(job, [this, as, path](BulkJob* jp)
+	{
+		TraceSpan span(_tracer, "load_atomspace_job", "bulk", path);
+		load_as_from_cid(as, path_to_cid(path), jp);
+		as->barrier();
+	});
+}
+
+/// Store all of the Atoms in the table, in the background. The Atoms
+/// are gathered up at once; Atoms added to the table afterwards are
+/// not stored.
+int IPFSAtomStorage::store_atomspace_job(const AtomTable& table)
+{
+	check_writable("store atoms");
+	rethrow();
+
+	HandleSeq atoms(bulk_atoms(table));
+	auto job = std::make_shared<BulkJob>();
+	job->kind = "store";
+	job->total = atoms.size();
+	return start_bulk_job(job, [this, atoms](BulkJob* jp)
+	{
+		TraceSpan span(_tracer, "store_atomspace_job", "bulk");
+		store_batches(atoms, jp);
+	});
+}
+
+/// Store the Atoms in the bulk lane, one batch at a time, waiting for
+/// each batch to be fully written before queueing the next. If a
+/// checkpoint is open, Atoms stored by an earlier, interrupted bulk
+/// store are skipped, and each batch is journaled once stored.
+void IPFSAtomStorage::store_batches(const HandleSeq& all, BulkJob* job)
+{
+	HandleSeq atoms(ckpt_skip(all));
+	if (job) job->done += all.size() - atoms.size();
+
+	size_t i = 0;
+	try
+	{
+		for (; i < atoms.size(); i += BULK_BATCH_SIZE)
+		{
+			if (job and job->cancel) break;
+
+			size_t end = std::min(i + BULK_BATCH_SIZE, atoms.size());
+			std::vector<std::future<void>> stored;
+			std::exception_ptr err;
+			for (size_t j = i; j < end and not err; j++)
+			{
+				std::promise<void> done;
+				stored.push_back(done.get_future());
+				try { enqueue_store(atoms[j], LANE_BULK, &done); }
+				catch (...) { err = std::current_exception(); }
+			}
+
+			// All must be waited for, even if one fails, before the
+			// failure is reported.
+			for (std::future<void>& f : stored)
+			{
+				try { f.get(); }
+				catch (...) { err = std::current_exception(); }
+			}
+			if (err) std::rethrow_exception(err);
+			if (job) job->done += end - i;
+			ckpt_record(atoms, i, end);
+		}
+	}
+	catch (...)
+	{
+		ckpt_finish(false);
+		throw;
+	}
+	ckpt_finish(atoms.size() <= i);
+}
+
+/// Progress of the job: its state, the number of Atoms done out of
+/// the total, the rate, the estimated time to finish, and the bytes
+/// transferred to and from the daemon. The byte count includes all
+/// other traffic, from this AtomSpace, while the job was running.
+ipfs::Json IPFSAtomStorage::bulk_job_status(int id)
+{
+	std::shared_ptr<BulkJob> job(get_bulk_job(id));
+
+	int state = job->state;
+	size_t done = job->done;
+	size_t total = job->total;
+	size_t bytes = (JOB_RUNNING == state) ?
+		rpc_bytes() - job->start_bytes : (size_t) job->bytes;
+	auto end = (JOB_RUNNING == state) ?
+		std::chrono::steady_clock::now() : job->finish;
+	double secs = std::chrono::duration<double>(end - job->start).count();
+
+	double rate = (0.0 < secs) ? done / secs : 0.0;
+	ipfs::Json status = {
+		{"id", id},
+		{"kind", job->kind},
+		{"state", bulk_state_name(state)},
+		{"done", done},
+		{"total", total},
+		{"seconds", secs},
+		{"atoms_per_sec", rate},
+		{"bytes", bytes}};
+
+	if (JOB_RUNNING == state and 0.0 < rate and done <= total)
+		status["eta_sec"] = (total - done) / rate;
+	if (JOB_FAILED == state)
+		status["error"] = job->error;
+	if (0 < job->path.size())
+		status["path"] = job->path;
+	return status;
+}
+
+/// Ask the job to stop, after the batch that it is working on.
+void IPFSAtomStorage::cancel_bulk_job(int id)
+{
+	get_bulk_job(id)->cancel = true;
+}
+
+/// Wait for the job to end, one way or another.
+void IPFSAtomStorage::wait_bulk_job(int id)
+{
+	std::shared_ptr<BulkJob> job(get_bulk_job(id));
+
+	// Only one thread may join; the others poll.
+	std::unique_lock<std::mutex> lck(_bulk_mutex);
+	if (job->runner.joinable())
+	{
+		std::thread runner(std::move(job->runner));
+		lck.unlock();
+		runner.join();
+		return;
+	}
+	lck.unlock();
+	while (JOB_RUNNING == job->state)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+}
+
+/// Cancel every job, and wait for them to stop.
+void IPFSAtomStorage::stop_bulk_jobs(void)
+{
+	std::vector<int> ids;
+	{
+		std::lock_guard<std::mutex> lck(_bulk_mutex);
+		for (auto& pr : _bulk_jobs)
+		{
+			pr.second->cancel = true;
+			ids.push_back(pr.first);
+		}
+	}
+	for (int id : ids) wait_bulk_job(id);
 }
 
 /* ============================= END OF FILE ================= */
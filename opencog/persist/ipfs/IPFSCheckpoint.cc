@@ -0,0 +1,230 @@
+/*
+ * IPFSCheckpoint.cc
+ * Checkpoints, so that an interrupted bulk store can be resumed.
+ *
+ * A bulk store of a big AtomSpace can run for hours. If it dies part
+ * way, the next run starts over, because the GUIDs of the Atoms stored
+ * so far, and the AtomSpace CID, were only ever kept in memory. With a
+ * checkpoint open, a bulk store goes a batch at a time; once a batch
+ * has been stored, its Atoms, and their GUIDs, are appended to a
+ * journal. Every so often, the journal is synced to disk, and the
+ * AtomSpace CID is written to a checkpoint file, together with the
+ * number of journal records that it covers. The next time that the
+ * checkpoint is opened, the AtomSpace CID is reset to the one in the
+ * checkpoint, and a bulk store skips every Atom in the journal.
+ *
+ * Skipped Atoms keep the Values that they had when they were stored.
+ *
+ * File layout: the journal at PATH holds one JSON record per line:
+ *    {"atom":"(ConceptNode \"foo\")","guid":"Qm..."}
+ * The checkpoint at PATH.ckpt holds
+ *    {"atoms":1000,"cid":"Qm..."}
+ * Journal records past the checkpointed count are discarded. When a
+ * bulk store runs to the end, both files are emptied, so that the next
+ * bulk store stores everything again.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include <opencog/util/Logger.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+
+/**
+ * Open (or create) the checkpoint journal at `path`. If it holds a
+ * checkpoint, the AtomSpace CID is reset to the checkpointed one, and
+ * the next bulk store resumes from there. A checkpoint is written
+ * after every `interval` Atoms.
+ */
+void IPFSAtomStorage::open_checkpoint(const std::string& path,
+                                      size_t interval)
+{
+	check_writable("open a checkpoint");
+
+	std::lock_guard<std::mutex> lck(_ckpt_mutex);
+	if (_ckpt_enabled)
+		throw RuntimeException(TRACE_INFO,
+			"Checkpoint %s is already open", _ckpt_path.c_str());
+
+	_ckpt_path = path;
+	_ckpt_interval = (0 < interval) ? interval : 1;
+	ckpt_resume();
+	_ckpt_enabled = true;
+}
+
+/// Write a last checkpoint, covering everything journaled, and close.
+void IPFSAtomStorage::close_checkpoint(void)
+{
+	std::lock_guard<std::mutex> lck(_ckpt_mutex);
+	if (not _ckpt_enabled) return;
+	_ckpt_enabled = false;
+
+	if (_ckpt_last < _ckpt_atoms) ckpt_write();
+	if (0 <= _ckpt_fd) close(_ckpt_fd);
+	_ckpt_fd = -1;
+	_ckpt_guids.clear();
+}
+
+/// Read the checkpoint and the journal. Called with the lock held.
+void IPFSAtomStorage::ckpt_resume(void)
+{
+	_ckpt_guids.clear();
+	_ckpt_atoms = 0;
+	size_t offset = 0;
+
+	std::ifstream ckpt(_ckpt_path + ".ckpt");
+	if (ckpt.is_open())
+	{
+		ipfs::Json jck = ipfs::Json::parse(ckpt);
+		size_t natoms = jck["atoms"];
+
+		std::ifstream in(_ckpt_path);
+		std::string line;
+		while (_ckpt_atoms < natoms and std::getline(in, line))
+		{
+			ipfs::Json rec = ipfs::Json::parse(line);
+			_ckpt_guids[rec["atom"]] = IPFSCid(rec["guid"].get<std::string>());
+			_ckpt_atoms++;
+			offset += line.size() + 1;
+		}
+		if (_ckpt_atoms < natoms)
+			throw IOException(TRACE_INFO,
+				"Checkpoint journal %s is missing records", _ckpt_path.c_str());
+
+		reset_atomspace_cid(jck["cid"]);
+		_ckpt_resumed += _ckpt_atoms;
+		logger().info("Resuming bulk store from checkpoint %s: %zu atoms\n",
+		              _ckpt_path.c_str(), _ckpt_atoms);
+	}
+	_ckpt_last = _ckpt_atoms;
+
+	_ckpt_fd = open(_ckpt_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (_ckpt_fd < 0)
+		throw IOException(TRACE_INFO,
+			"Unable to open checkpoint journal %s: %s",
+			_ckpt_path.c_str(), strerror(errno));
+
+	// Records past the checkpoint might name Atoms that the
+	// checkpointed AtomSpace doesn't have; they go.
+	if (ftruncate(_ckpt_fd, offset))
+		throw IOException(TRACE_INFO,
+			"Unable to truncate checkpoint journal %s: %s",
+			_ckpt_path.c_str(), strerror(errno));
+}
+
+/* ================================================================ */
+
+/// Return the Atoms that the journal does not name. Those that it does
+/// name get their GUIDs back, so that they are not stored again, not
+/// even as part of the outgoing set of some Link.
+HandleSeq IPFSAtomStorage::ckpt_skip(const HandleSeq& atoms)
+{
+	if (not _ckpt_enabled) return atoms;
+
+	HandleSeq todo;
+	std::lock_guard<std::mutex> lck(_ckpt_mutex);
+	for (const Handle& h : atoms)
+	{
+		std::string label(encodeAtomToStr(h));
+		auto it = _ckpt_guids.find(label);
+		if (_ckpt_guids.end() == it)
+		{
+			todo.push_back(h);
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> glck(_guid_mutex);
+			_guid_map[h] = it->second;
+		}
+		_shared->record_guid(label, ipld_encoded(h), it->second);
+		_ckpt_skipped++;
+	}
+	return todo;
+}
+
+/// Journal the Atoms `atoms[begin]` up to `atoms[end]`, which have all
+/// been stored, and write a checkpoint, if it is time for one.
+void IPFSAtomStorage::ckpt_record(const HandleSeq& atoms,
+                                  size_t begin, size_t end)
+{
+	if (not _ckpt_enabled) return;
+
+	std::string text;
+	std::vector<std::pair<std::string, std::string>> recs;
+	for (size_t i = begin; i < end; i++)
+	{
+		recs.push_back({encodeAtomToStr(atoms[i]), get_atom_guid(atoms[i])});
+		ipfs::Json rec = {
+			{"atom", recs.back().first},
+			{"guid", recs.back().second}};
+		text += rec.dump() + "\n";
+	}
+
+	std::lock_guard<std::mutex> lck(_ckpt_mutex);
+	if ((ssize_t) text.size() != write(_ckpt_fd, text.c_str(), text.size()))
+		throw IOException(TRACE_INFO,
+			"Unable to write checkpoint journal %s: %s",
+			_ckpt_path.c_str(), strerror(errno));
+	_ckpt_atoms += end - begin;
+
+	// A later bulk store, in this same session, skips these, too.
+	for (const auto& pr : recs)
+		_ckpt_guids[pr.first] = IPFSCid(pr.second);
+
+	if (_ckpt_interval <= _ckpt_atoms - _ckpt_last)
+		ckpt_write();
+}
+
+/// Sync the journal, and checkpoint the AtomSpace CID. Everything in
+/// the journal is already in the AtomSpace that the CID names. Called
+/// with the lock held.
+void IPFSAtomStorage::ckpt_write(void)
+{
+	if (fdatasync(_ckpt_fd))
+		throw IOException(TRACE_INFO,
+			"Unable to sync checkpoint journal %s: %s",
+			_ckpt_path.c_str(), strerror(errno));
+
+	ipfs::Json jck = {{"atoms", _ckpt_atoms}, {"cid", atomspace_root()}};
+	write_file_atomically(_ckpt_path + ".ckpt", jck.dump() + "\n");
+	_ckpt_last = _ckpt_atoms;
+	_ckpt_writes++;
+}
+
+/// A bulk store has stopped. If it was cut short, checkpoint what was
+/// done; otherwise, start over, the next time.
+void IPFSAtomStorage::ckpt_finish(bool complete)
+{
+	if (not _ckpt_enabled) return;
+
+	std::lock_guard<std::mutex> lck(_ckpt_mutex);
+	if (not complete)
+	{
+		if (_ckpt_last < _ckpt_atoms) ckpt_write();
+		return;
+	}
+
+	unlink((_ckpt_path + ".ckpt").c_str());
+	if (ftruncate(_ckpt_fd, 0))
+		throw IOException(TRACE_INFO,
+			"Unable to truncate checkpoint journal %s: %s",
+			_ckpt_path.c_str(), strerror(errno));
+	_ckpt_guids.clear();
+	_ckpt_atoms = 0;
+	_ckpt_last = 0;
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,247 @@
+/*
+ * IPFSCid.cc
+ * Conversion of CIDs between their string and binary forms.
+ *
+ * A CIDv0 is the base58 encoding of a multihash: 0x12 (sha2-256),
+ * 0x20 (32 bytes), then the digest. A CIDv1 is a multibase prefix
+ * (here, only `b`, lower-case base32) on the encoding of: the version
+ * (1), the codec, and then the multihash, all as varints.
+ *
+ * Base58 is a change of radix, over the entire string, and doesn't
+ * lend itself to vector instructions; the lookups below are
+ * table-driven, and run over fixed-size buffers, without allocation.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "IPFSCid.h"
+#include "IPFSHash.h"
+
+using namespace opencog;
+
+#define MH_SHA2_256 0x12
+#define MH_DIGEST_LEN 32
+#define CIDV0_STRLEN 46
+#define CIDV0_BYTES (2 + MH_DIGEST_LEN)
+
+static const char b32_alphabet[] = "abcdefghijklmnopqrstuvwxyz234567";
+
+/// Reverse lookup tables; -1 for characters not in the alphabet.
+struct Radix
+{
+	int8_t b58[128];
+	int8_t b32[128];
+	Radix(void)
+	{
+		memset(b58, -1, sizeof(b58));
+		memset(b32, -1, sizeof(b32));
+		for (int i = 0; i < 58; i++) b58[(int) IPFSHash::B58_ALPHABET[i]] = i;
+		for (int i = 0; i < 32; i++) b32[(int) b32_alphabet[i]] = i;
+	}
+};
+static const Radix radix;
+
+/* ================================================================ */
+
+/// Decode base58 into exactly `len` bytes, big-endian.
+static bool b58_decode(const std::string& str, uint8_t* out, size_t len)
+{
+	memset(out, 0, len);
+	for (unsigned char c : str)
+	{
+		if (128 <= c or radix.b58[c] < 0) return false;
+		uint32_t carry = radix.b58[c];
+		for (size_t i = len; 0 < i--; )
+		{
+			carry += 58 * (uint32_t) out[i];
+			out[i] = carry & 0xff;
+			carry >>= 8;
+		}
+		if (carry) return false;
+	}
+	return true;
+}
+
+/// Decode unpadded base32; return the number of bytes, or zero.
+static size_t b32_decode(const std::string& str, size_t start,
+                         uint8_t* out, size_t maxlen)
+{
+	size_t len = 0;
+	uint32_t acc = 0;
+	int bits = 0;
+	for (size_t i = start; i < str.size(); i++)
+	{
+		unsigned char c = str[i];
+		if (128 <= c or radix.b32[c] < 0) return 0;
+		acc = (acc << 5) | radix.b32[c];
+		bits += 5;
+		if (8 <= bits)
+		{
+			if (maxlen <= len) return 0;
+			bits -= 8;
+			out[len++] = (acc >> bits) & 0xff;
+		}
+	}
+	return len;
+}
+
+static std::string b32_encode(const uint8_t* in, size_t len)
+{
+	std::string out;
+	uint32_t acc = 0;
+	int bits = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		acc = (acc << 8) | in[i];
+		bits += 8;
+		while (5 <= bits)
+		{
+			bits -= 5;
+			out += b32_alphabet[(acc >> bits) & 31];
+		}
+	}
+	if (0 < bits) out += b32_alphabet[(acc << (5 - bits)) & 31];
+	return out;
+}
+
+static bool get_varint(const uint8_t* buf, size_t len, size_t& pos,
+                       uint32_t& val)
+{
+	val = 0;
+	for (int shift = 0; pos < len and shift < 28; shift += 7)
+	{
+		uint8_t b = buf[pos++];
+		val |= (uint32_t) (b & 0x7f) << shift;
+		if (0 == (b & 0x80)) return true;
+	}
+	return false;
+}
+
+static void put_varint(uint8_t* buf, size_t& pos, uint32_t val)
+{
+	while (0x80 <= val)
+	{
+		buf[pos++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buf[pos++] = val;
+}
+
+/* ================================================================ */
+// The intern table, for CIDs that don't fit the binary form.
+
+static std::mutex intern_mutex;
+static std::vector<std::string> interned;
+static std::unordered_map<std::string, uint32_t> intern_index;
+
+void IPFSCid::intern(const std::string& str)
+{
+	uint32_t idx;
+	{
+		std::lock_guard<std::mutex> lck(intern_mutex);
+		auto it = intern_index.find(str);
+		if (intern_index.end() != it)
+			idx = it->second;
+		else
+		{
+			idx = interned.size();
+			interned.push_back(str);
+			intern_index.emplace(str, idx);
+		}
+	}
+	_kind = INTERNED;
+	_codec = 0;
+	memset(_digest, 0, sizeof(_digest));
+	memcpy(_digest, &idx, sizeof(idx));
+}
+
+size_t IPFSCid::num_interned(void)
+{
+	std::lock_guard<std::mutex> lck(intern_mutex);
+	return interned.size();
+}
+
+/* ================================================================ */
+
+IPFSCid::IPFSCid(const std::string& str) :
+	_kind(EMPTY), _pad(0), _codec(0)
+{
+	memset(_digest, 0, sizeof(_digest));
+	if (0 == str.size()) return;
+
+	uint8_t buf[2 * CIDV0_BYTES];
+	if (CIDV0_STRLEN == str.size() and 'Q' == str[0] and 'm' == str[1])
+	{
+		if (b58_decode(str, buf, CIDV0_BYTES) and
+		    MH_SHA2_256 == buf[0] and MH_DIGEST_LEN == buf[1])
+		{
+			_kind = V0;
+			memcpy(_digest, &buf[2], MH_DIGEST_LEN);
+		}
+	}
+	else if ('b' == str[0])
+	{
+		size_t len = b32_decode(str, 1, buf, sizeof(buf));
+		size_t pos = 0;
+		uint32_t version, codec, mh, mhlen;
+		if (get_varint(buf, len, pos, version) and 1 == version and
+		    get_varint(buf, len, pos, codec) and codec <= 0xffff and
+		    get_varint(buf, len, pos, mh) and MH_SHA2_256 == mh and
+		    get_varint(buf, len, pos, mhlen) and MH_DIGEST_LEN == mhlen and
+		    pos + MH_DIGEST_LEN == len)
+		{
+			_kind = V1;
+			_codec = codec;
+			memcpy(_digest, &buf[pos], MH_DIGEST_LEN);
+		}
+	}
+
+	// Anything that doesn't spell out the same way again is interned.
+	if (EMPTY == _kind or to_string() != str)
+		intern(str);
+}
+
+IPFSCid IPFSCid::of_bytes(const std::string& bytes)
+{
+	IPFSCid cid;
+	cid._kind = V0;
+	IPFSHash::sha256(bytes, cid._digest);
+	return cid;
+}
+
+std::string IPFSCid::to_string(void) const
+{
+	uint8_t buf[2 * CIDV0_BYTES];
+	size_t pos = 0;
+	switch (_kind)
+	{
+		case V0:
+			buf[0] = MH_SHA2_256;
+			buf[1] = MH_DIGEST_LEN;
+			memcpy(&buf[2], _digest, MH_DIGEST_LEN);
+			return IPFSHash::base58(buf, CIDV0_BYTES);
+		case V1:
+			put_varint(buf, pos, 1);
+			put_varint(buf, pos, _codec);
+			put_varint(buf, pos, MH_SHA2_256);
+			put_varint(buf, pos, MH_DIGEST_LEN);
+			memcpy(&buf[pos], _digest, MH_DIGEST_LEN);
+			return "b" + b32_encode(buf, pos + MH_DIGEST_LEN);
+		case INTERNED:
+		{
+			uint32_t idx;
+			memcpy(&idx, _digest, sizeof(idx));
+			std::lock_guard<std::mutex> lck(intern_mutex);
+			return interned[idx];
+		}
+		default:
+			return std::string();
+	}
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,103 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/IPFSCid.h
+ *
+ * FUNCTION:
+ * Compact, fixed-size binary form of an IPFS CID.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_IPFS_CID_H
+#define _OPENCOG_IPFS_CID_H
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * A CID, as the 32-byte SHA-256 digest that it names, plus the
+ * little that is needed to spell it out again: whether it is a
+ * CIDv0 (`Qm...`, base58) or a CIDv1 (`b...`, base32), and for the
+ * latter, the codec. That is 36 bytes, held inline, with no heap
+ * allocation, as compared to a 46-character `std::string`, which is
+ * always on the heap. The digest is already uniformly random, so
+ * hashing is just a load.
+ *
+ * The daemon hands out SHA-256 CIDs, unless told otherwise. Anything
+ * else (other hash functions, other multibases, or strings that are
+ * not CIDs at all) is kept in a process-wide intern table, and the
+ * CID holds its index there. Such strings are never freed; there are
+ * not expected to be many of them.
+ *
+ * Converting to and from strings happens only where CIDs are sent to,
+ * or received from, the daemon; everything kept in memory, and every
+ * lookup, uses the binary form.
+ */
+class IPFSCid
+{
+	private:
+		enum Kind : uint8_t { EMPTY = 0, V0, V1, INTERNED };
+
+		uint8_t _kind;
+		uint8_t _pad;
+		uint16_t _codec;
+		uint8_t _digest[32];
+
+		void intern(const std::string&);
+
+	public:
+		IPFSCid(void) : _kind(EMPTY), _pad(0), _codec(0)
+		{ memset(_digest, 0, sizeof(_digest)); }
+		explicit IPFSCid(const std::string&);
+
+		/// The CIDv0 naming the SHA-256 digest of `bytes`. This is a
+		/// compact key for content held in memory; it is not the CID
+		/// that the daemon would give a block holding those bytes.
+		static IPFSCid of_bytes(const std::string& bytes);
+
+		std::string to_string(void) const;
+		bool empty(void) const { return EMPTY == _kind; }
+
+		size_t hash(void) const
+		{
+			size_t h;
+			memcpy(&h, _digest, sizeof(h));
+			return h ^ _kind;
+		}
+
+		bool operator==(const IPFSCid& other) const
+		{
+			return _kind == other._kind and _codec == other._codec and
+				0 == memcmp(_digest, other._digest, sizeof(_digest));
+		}
+		bool operator!=(const IPFSCid& other) const
+		{ return not (*this == other); }
+
+		/// The number of strings in the intern table.
+		static size_t num_interned(void);
+};
+
+/** @}*/
+} // namespace opencog
+
+namespace std
+{
+template<> struct hash<opencog::IPFSCid>
+{
+	size_t operator()(const opencog::IPFSCid& cid) const { return cid.hash(); }
+};
+} // namespace std
+
+#endif // _OPENCOG_IPFS_CID_H
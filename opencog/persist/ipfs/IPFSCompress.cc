@@ -0,0 +1,177 @@
+/*
+ * IPFSCompress.cc
+ * Compression of large Value payloads.
+ *
+ * Values are stored as text: FloatValues as decimal numbers, and
+ * StringValues as quoted strings. A long FloatValue (an embedding, say)
+ * is thus many kilobytes of digits, which compress well. Payloads at
+ * least `_compress_threshold` bytes long are compressed with zstd, and
+ * stored, base64-encoded, after a `zstd:` marker. Uncompressed payloads
+ * always start with an open-paren, so the two can't be confused, and
+ * old data reads back unchanged.
+ *
+ * Compression is off unless asked for, with the `compress` open
+ * option, and is used only if zstd was found at build time. Without
+ * it, nothing is compressed, and reading a compressed payload throws.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+#define ZSTD_MARKER "zstd:"
+#define ZSTD_MARKER_LEN (sizeof(ZSTD_MARKER)-1)
+
+// Don't believe a frame that claims to expand past this.
+#define MAX_EXPANDED_SIZE (256UL * 1024 * 1024)
+
+/* ================================================================ */
+
+static const char b64chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string b64_encode(const char* buf, size_t len)
+{
+	std::string out;
+	out.reserve(4 * ((len + 2) / 3));
+	size_t i = 0;
+	for (; i + 2 < len; i += 3)
+	{
+		uint32_t n = ((uint8_t) buf[i] << 16) |
+		             ((uint8_t) buf[i+1] << 8) | (uint8_t) buf[i+2];
+		out += b64chars[(n >> 18) & 63];
+		out += b64chars[(n >> 12) & 63];
+		out += b64chars[(n >> 6) & 63];
+		out += b64chars[n & 63];
+	}
+	if (i < len)
+	{
+		uint32_t n = (uint8_t) buf[i] << 16;
+		if (i + 1 < len) n |= (uint8_t) buf[i+1] << 8;
+		out += b64chars[(n >> 18) & 63];
+		out += b64chars[(n >> 12) & 63];
+		out += (i + 1 < len) ? b64chars[(n >> 6) & 63] : '=';
+		out += '=';
+	}
+	return out;
+}
+
+static std::string b64_decode(const std::string& in, size_t start)
+{
+	std::string out;
+	out.reserve(3 * (in.size() - start) / 4);
+	uint32_t n = 0;
+	int bits = 0;
+	for (size_t i = start; i < in.size(); i++)
+	{
+		char c = in[i];
+		if ('=' == c) break;
+		const char* p = strchr(b64chars, c);
+		if (nullptr == p or 0 == c)
+			throw RuntimeException(TRACE_INFO,
+				"Bad character in compressed Value");
+		n = (n << 6) | (p - b64chars);
+		bits += 6;
+		if (8 <= bits)
+		{
+			bits -= 8;
+			out += (char) ((n >> bits) & 0xff);
+		}
+	}
+	return out;
+}
+
+/* ================================================================ */
+
+static bool is_compressed(const std::string& stored)
+{
+	return 0 == stored.compare(0, ZSTD_MARKER_LEN, ZSTD_MARKER);
+}
+
+/// Return the payload, compressed, if it's big enough to be worth it.
+std::string IPFSAtomStorage::compress_value(const std::string& text)
+{
+#ifdef HAVE_ZSTD
+	if (0 == _compress_threshold or text.size() < _compress_threshold)
+		return text;
+
+	auto start = std::chrono::steady_clock::now();
+	std::string buf;
+	buf.resize(ZSTD_compressBound(text.size()));
+	size_t len = ZSTD_compress(&buf[0], buf.size(),
+	                           text.data(), text.size(), _compress_level);
+	std::string out;
+	if (not ZSTD_isError(len))
+		out = ZSTD_MARKER + b64_encode(buf.data(), len);
+
+	_compress_usec += std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	// Random-looking text might not shrink; keep it as it was.
+	if (0 == out.size() or text.size() <= out.size())
+	{
+		_num_compress_skips++;
+		return text;
+	}
+
+	_num_compressed++;
+	_compress_bytes_in += text.size();
+	_compress_bytes_out += out.size();
+	return out;
+#else
+	return text;
+#endif
+}
+
+/// Return the payload, uncompressed.
+std::string IPFSAtomStorage::expand_value(const std::string& stored)
+{
+	if (not is_compressed(stored)) return stored;
+
+#ifdef HAVE_ZSTD
+	auto start = std::chrono::steady_clock::now();
+	std::string buf(b64_decode(stored, ZSTD_MARKER_LEN));
+
+	unsigned long long len = ZSTD_getFrameContentSize(buf.data(), buf.size());
+	if (ZSTD_CONTENTSIZE_ERROR == len or ZSTD_CONTENTSIZE_UNKNOWN == len or
+	    MAX_EXPANDED_SIZE < len)
+		throw RuntimeException(TRACE_INFO, "Bad compressed Value");
+
+	std::string text;
+	text.resize(len);
+	size_t got = ZSTD_decompress(&text[0], len, buf.data(), buf.size());
+	if (ZSTD_isError(got))
+		throw RuntimeException(TRACE_INFO,
+			"Can't expand compressed Value: %s", ZSTD_getErrorName(got));
+	text.resize(got);
+
+	_expand_usec += std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	_num_expanded++;
+	return text;
+#else
+	throw RuntimeException(TRACE_INFO,
+		"Found a zstd-compressed Value, but built without zstd");
+#endif
+}
+
+/// True, if this was built with compression.
+bool IPFSAtomStorage::have_compression(void)
+{
+#ifdef HAVE_ZSTD
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* ============================= END OF FILE ================= */
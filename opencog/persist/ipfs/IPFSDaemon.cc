@@ -0,0 +1,458 @@
+/*
+ * IPFSDaemon.cc
+ * Timed and accounted wrappers around calls to the IPFS daemon.
+ *
+ * Every request made to the daemon goes through one of the wrappers
+ * below, so that its latency, its success or failure, and the number
+ * of bytes moved in each direction can be recorded, per endpoint.
+ * These are reported by `print_stats()`. Each call is also a trace
+ * span, when tracing is enabled; the span includes the time spent
+ * waiting for a pooled connection.
+ *
+ * When the AtomSpace is split across several daemons, the calls that
+ * put or patch something say which daemon to use. A `dag get` goes to
+ * whichever daemon holds the block that the path starts at, where
+ * that is known; otherwise, each daemon is asked in turn, and told to
+ * give up after PROBE_TIMEOUT. A daemon lacking the block would go
+ * looking for it on the network, and that can take minutes.
+ *
+ * Byte counts are of the JSON and string payloads handed to and
+ * returned by the client library; they do not include HTTP headers
+ * or multipart framing. The client does not say how big the JSON was
+ * once serialized, and serializing it again, just to count it, costs
+ * as much as the call itself, for big Values. So the length is worked
+ * out by walking the JSON, which allocates nothing.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+typedef std::chrono::steady_clock Clock;
+
+// How long a daemon may look for a block it doesn't have, when it is
+// not known where the block is.
+#define PROBE_TIMEOUT "2s"
+
+/* ================================================================ */
+
+IPFSAtomStorage::PooledConn::PooledConn(IPFSAtomStorage* store,
+                                        size_t shard) :
+	_store(store), _shard(shard)
+{
+	// pop() blocks when the pool is empty; how long it blocks is
+	// a measure of how starved the daemon calls are for connections.
+	Shard& sh = *_store->_shards[_shard];
+	auto start = Clock::now();
+	_conn = sh.shared->conn_pool.pop();
+	_store->_conn_wait.record_since(start);
+	sh.calls++;
+}
+
+IPFSAtomStorage::PooledConn::~PooledConn()
+{
+	_store->_shards[_shard]->shared->conn_pool.push(_conn);
+}
+
+/* ================================================================ */
+
+const char* IPFSAtomStorage::rpc_name(RPC rpc)
+{
+	switch (rpc)
+	{
+		case RPC_DAG_GET:        return "dag/get";
+		case RPC_DAG_PUT:        return "dag/put";
+		case RPC_PATCH_ADD_LINK: return "object/patch/add-link";
+		case RPC_PATCH_RM_LINK:  return "object/patch/rm-link";
+		case RPC_FILES_ADD:      return "add";
+		case RPC_KEY_LIST:       return "key/list";
+		case RPC_KEY_GEN:        return "key/gen";
+		case RPC_NAME_PUBLISH:   return "name/publish";
+		case RPC_NAME_RESOLVE:   return "name/resolve";
+		case RPC_OBJECT_GET:     return "object/get";
+		case RPC_OBJECT_PUT:     return "object/put";
+		default:                 return "unknown";
+	}
+}
+
+void IPFSAtomStorage::RPCStats::reset(void)
+{
+	latency.reset();
+	calls = 0;
+	errors = 0;
+	bytes_sent = 0;
+	bytes_received = 0;
+}
+
+void IPFSAtomStorage::rpc_done(RPC rpc, Clock::time_point start,
+                               size_t sent, size_t received)
+{
+	RPCStats& st = _rpc_stats[rpc];
+	st.latency.record_since(start);
+	st.calls++;
+	st.bytes_sent += sent;
+	st.bytes_received += received;
+}
+
+/// Failed calls are counted, and their latency is recorded, since
+/// a slow failure is still time spent waiting on the daemon. Note
+/// that a dag/get of an Atom that is not in the AtomSpace fails;
+/// these are not really errors, but are counted as such.
+void IPFSAtomStorage::rpc_failed(RPC rpc, Clock::time_point start)
+{
+	RPCStats& st = _rpc_stats[rpc];
+	st.latency.record_since(start);
+	st.calls++;
+	st.errors++;
+}
+
+/// The length of the string, quoted and escaped, as dump() writes it.
+static size_t quoted_length(const std::string& str)
+{
+	size_t n = 2;
+	for (unsigned char c : str)
+	{
+		if ('"' == c or '\\' == c or '\b' == c or '\f' == c or
+		    '\n' == c or '\r' == c or '\t' == c) n += 2;
+		else if (c < 0x20) n += 6;
+		else n++;
+	}
+	return n;
+}
+
+/// The length of the JSON payload, as dump() writes it, without
+/// writing it. Floating-point numbers are counted at 17 digits, which
+/// can be a few more than dump() uses; payloads hold few of them.
+size_t IPFSAtomStorage::json_bytes(const ipfs::Json& j)
+{
+	char num[32];
+	size_t n;
+	switch (j.type())
+	{
+		case ipfs::Json::value_t::null:
+			return 4;
+		case ipfs::Json::value_t::boolean:
+			return j.get<bool>() ? 4 : 5;
+		case ipfs::Json::value_t::string:
+			return quoted_length(j.get_ref<const std::string&>());
+		case ipfs::Json::value_t::number_integer:
+			return snprintf(num, sizeof(num), "%lld",
+			                (long long) j.get<int64_t>());
+		case ipfs::Json::value_t::number_unsigned:
+			return snprintf(num, sizeof(num), "%llu",
+			                (unsigned long long) j.get<uint64_t>());
+		case ipfs::Json::value_t::number_float:
+			return snprintf(num, sizeof(num), "%.17g", j.get<double>());
+		case ipfs::Json::value_t::array:
+			n = 1;
+			for (const ipfs::Json& elt : j)
+				n += json_bytes(elt) + 1;
+			return j.empty() ? 2 : n;
+		case ipfs::Json::value_t::object:
+			n = 1;
+			for (auto it = j.begin(); it != j.end(); it++)
+				n += quoted_length(it.key()) + 1 + json_bytes(it.value()) + 1;
+			return j.empty() ? 2 : n;
+		default:
+			return 0;
+	}
+}
+
+/* ================================================================ */
+
+/// Get from whichever daemon holds the block that the path starts at.
+ipfs::Json IPFSAtomStorage::dag_get(const std::string& path)
+{
+	if (not sharded()) return dag_get(path, 0);
+
+	int known = block_shard(path);
+	if (0 <= known) return dag_get(path, known);
+
+	// Not a block that we've put or seen listed. On peered daemons,
+	// the first one tried can get it from the others.
+	_num_shard_misses++;
+	for (size_t s = 0; ; s++)
+	{
+		try
+		{
+			ipfs::Json dag = dag_probe(path, s);
+			note_block(path, s);
+			return dag;
+		}
+		catch (...)
+		{
+			if (s + 1 == _shards.size()) throw;
+		}
+	}
+}
+
+ipfs::Json IPFSAtomStorage::dag_get(const std::string& path, size_t shard)
+{
+	ipfs::Json dag;
+	TraceSpan span(_tracer, rpc_name(RPC_DAG_GET), "rpc", path);
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->DagGet(path, &dag);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_DAG_GET, start);
+		throw;
+	}
+	rpc_done(RPC_DAG_GET, start, path.size(), json_bytes(dag));
+	return dag;
+}
+
+/// A dag/get on a connection of its own, rather than a pooled one,
+/// with a timeout, so that the daemon fails fast if it does not have
+/// the block.
+ipfs::Json IPFSAtomStorage::dag_probe(const std::string& path, size_t shard)
+{
+	ipfs::Json dag;
+	TraceSpan span(_tracer, rpc_name(RPC_DAG_GET), "rpc", path);
+	const IPFSShared& sh = *_shards[shard]->shared;
+	ipfs::Client probe(sh.hostname(), sh.port(), PROBE_TIMEOUT);
+	auto start = Clock::now();
+	try
+	{
+		probe.DagGet(path, &dag);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_DAG_GET, start);
+		throw;
+	}
+	rpc_done(RPC_DAG_GET, start, path.size(), json_bytes(dag));
+	return dag;
+}
+
+/// Return the CID of the stored object.
+std::string IPFSAtomStorage::dag_put(const ipfs::Json& obj, size_t shard)
+{
+	ipfs::Json result;
+	TraceSpan span(_tracer, rpc_name(RPC_DAG_PUT), "rpc");
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->DagPut(obj, &result);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_DAG_PUT, start);
+		throw;
+	}
+	rpc_done(RPC_DAG_PUT, start, json_bytes(obj), json_bytes(result));
+	note_block(result["Cid"]["/"], shard);
+	return result["Cid"]["/"];
+}
+
+/// Add a link to the directory `root`, returning the CID of the
+/// new directory.
+std::string IPFSAtomStorage::patch_add_link(const std::string& root,
+                                            const std::string& name,
+                                            const std::string& cid,
+                                            size_t shard)
+{
+	std::string new_root;
+	TraceSpan span(_tracer, rpc_name(RPC_PATCH_ADD_LINK), "rpc", name);
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->ObjectPatchAddLink(root, name, cid, &new_root);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_PATCH_ADD_LINK, start);
+		throw;
+	}
+	rpc_done(RPC_PATCH_ADD_LINK, start,
+	         root.size() + name.size() + cid.size(), new_root.size());
+	note_block(new_root, shard);
+	return new_root;
+}
+
+/// Remove a link from the directory `root`, returning the CID of
+/// the new directory.
+std::string IPFSAtomStorage::patch_rm_link(const std::string& root,
+                                           const std::string& name,
+                                           size_t shard)
+{
+	std::string new_root;
+	TraceSpan span(_tracer, rpc_name(RPC_PATCH_RM_LINK), "rpc", name);
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->ObjectPatchRmLink(root, name, &new_root);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_PATCH_RM_LINK, start);
+		throw;
+	}
+	rpc_done(RPC_PATCH_RM_LINK, start,
+	         root.size() + name.size(), new_root.size());
+	note_block(new_root, shard);
+	return new_root;
+}
+
+/// Add a file with the given contents, returning its CID.
+std::string IPFSAtomStorage::files_add(const std::string& name,
+                                       const std::string& contents,
+                                       size_t shard)
+{
+	ipfs::Json result;
+	TraceSpan span(_tracer, rpc_name(RPC_FILES_ADD), "rpc", name);
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->FilesAdd({{name,
+			ipfs::http::FileUpload::Type::kFileContents,
+			contents}}, &result);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_FILES_ADD, start);
+		throw;
+	}
+	rpc_done(RPC_FILES_ADD, start, name.size() + contents.size(),
+	         json_bytes(result));
+	note_block(result[0]["hash"], shard);
+	return result[0]["hash"];
+}
+
+ipfs::Json IPFSAtomStorage::key_list(void)
+{
+	ipfs::Json keys;
+	TraceSpan span(_tracer, rpc_name(RPC_KEY_LIST), "rpc");
+	PooledConn conn(this);
+	auto start = Clock::now();
+	try
+	{
+		conn->KeyList(&keys);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_KEY_LIST, start);
+		throw;
+	}
+	rpc_done(RPC_KEY_LIST, start, 0, json_bytes(keys));
+	return keys;
+}
+
+/// Generate a new key, returning its ID.
+std::string IPFSAtomStorage::key_gen(const std::string& name,
+                                     const std::string& type, int size)
+{
+	std::string id;
+	TraceSpan span(_tracer, rpc_name(RPC_KEY_GEN), "rpc", name);
+	PooledConn conn(this);
+	auto start = Clock::now();
+	try
+	{
+		conn->KeyGen(name, type, size, &id);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_KEY_GEN, start);
+		throw;
+	}
+	rpc_done(RPC_KEY_GEN, start, name.size() + type.size(), id.size());
+	return id;
+}
+
+/// Resolve an IPNS name, returning the IPFS path it points at.
+std::string IPFSAtomStorage::name_resolve(const std::string& name)
+{
+	std::string path;
+	TraceSpan span(_tracer, rpc_name(RPC_NAME_RESOLVE), "rpc", name);
+	PooledConn conn(this);
+	auto start = Clock::now();
+	try
+	{
+		conn->NameResolve(name, &path);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_NAME_RESOLVE, start);
+		throw;
+	}
+	rpc_done(RPC_NAME_RESOLVE, start, name.size(), path.size());
+	return path;
+}
+
+/// Publish `cid` under the IPNS key `key`, returning the IPNS name.
+/// This takes an explicit connection, because the publisher thread
+/// keeps one of its own, rather than tying up one from the pool for
+/// a minute or more.
+std::string IPFSAtomStorage::name_publish(ipfs::Client& clnt,
+                                          const std::string& cid,
+                                          const std::string& key,
+                                          const ipfs::Json& options)
+{
+	std::string name;
+	TraceSpan span(_tracer, rpc_name(RPC_NAME_PUBLISH), "rpc", cid);
+	auto start = Clock::now();
+	try
+	{
+		clnt.NamePublish(cid, key, options, &name);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_NAME_PUBLISH, start);
+		throw;
+	}
+	rpc_done(RPC_NAME_PUBLISH, start, cid.size() + key.size(), name.size());
+	return name;
+}
+
+/// Get a protobuf object (e.g. a directory), with all of its links.
+ipfs::Json IPFSAtomStorage::object_get(const std::string& cid, size_t shard)
+{
+	ipfs::Json obj;
+	TraceSpan span(_tracer, rpc_name(RPC_OBJECT_GET), "rpc", cid);
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->ObjectGet(cid, &obj);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_OBJECT_GET, start);
+		throw;
+	}
+	rpc_done(RPC_OBJECT_GET, start, cid.size(), json_bytes(obj));
+	return obj;
+}
+
+/// Store a protobuf object, returning its CID.
+std::string IPFSAtomStorage::object_put(const ipfs::Json& obj, size_t shard)
+{
+	ipfs::Json result;
+	TraceSpan span(_tracer, rpc_name(RPC_OBJECT_PUT), "rpc");
+	PooledConn conn(this, shard);
+	auto start = Clock::now();
+	try
+	{
+		conn->ObjectPut(obj, &result);
+	}
+	catch (...)
+	{
+		rpc_failed(RPC_OBJECT_PUT, start);
+		throw;
+	}
+	rpc_done(RPC_OBJECT_PUT, start, json_bytes(obj), json_bytes(result));
+	note_block(result["Hash"], shard);
+	return result["Hash"];
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,143 @@
+/*
+ * IPFSFilter.cc
+ * Membership filter over the AtomSpace directory.
+ *
+ * Looking up an Atom that is not in the AtomSpace costs a round-trip
+ * to the daemon, which then fails. When most lookups are misses, most
+ * of that is wasted. So a counting Bloom filter of the names in the
+ * AtomSpace directory is kept, and lookups that it rules out are
+ * answered locally.
+ *
+ * The filter is built from the directory when the AtomSpace is opened,
+ * and whenever the AtomSpace CID is replaced wholesale (by resolving
+ * IPNS, or replaying a write-ahead log). It is kept up to date on every
+ * add and remove, under the AtomSpace CID lock, so that it never lags
+ * the directory. If it gets too full, it is rebuilt, at the next
+ * lookup.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <algorithm>
+
+#include <opencog/util/Logger.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+// Smallest filter built; about 40KB at a 1% false-positive rate.
+#define MIN_FILTER_CAPACITY 4096
+
+/* ================================================================ */
+
+/// Rebuild the filter from the names in the AtomSpace directory.
+/// If the directory cannot be read, the filter is left invalid, and
+/// every lookup goes to the daemon, until the next rebuild.
+void IPFSAtomStorage::rebuild_filter(void)
+{
+	TraceSpan span(_tracer, "rebuild_filter", "bulk");
+
+	// Hold the CID lock, and, if the AtomSpace is split, the lock on
+	// every shard directory, so that no add or remove is lost between
+	// reading the directories and installing the filter.
+	std::lock_guard<std::mutex> clck(_atomspace_cid_mutex);
+	std::vector<std::unique_lock<std::mutex>> dlcks;
+	if (sharded())
+		for (const auto& sh : _shards)
+			dlcks.emplace_back(sh->dir_mutex);
+	_filter_stale = false;
+	_filter_valid = false;
+
+	std::vector<ipfs::Json> dirs;
+	try
+	{
+		if (sharded())
+			for (size_t s = 0; s < _shards.size(); s++)
+				dirs.push_back(object_get(_shards[s]->dir_cid, s));
+		else
+			dirs.push_back(object_get(_atomspace_cid));
+	}
+	catch (const std::exception& ex)
+	{
+		logger().warn("Unable to build membership filter for %s: %s\n",
+		              _atomspace_cid.c_str(), ex.what());
+		return;
+	}
+
+	size_t nlinks = 0;
+	for (ipfs::Json& dir : dirs)
+		nlinks += dir["Links"].size();
+	size_t cap = std::max((size_t) MIN_FILTER_CAPACITY, 2 * nlinks);
+
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	_filter.reset(cap);
+	for (ipfs::Json& dir : dirs)
+		for (const ipfs::Json& lnk : dir["Links"])
+			_filter.add(lnk["Name"]);
+	_filter_valid = true;
+	_num_filter_rebuilds++;
+}
+
+/// Start over with an empty filter; for a brand-new AtomSpace.
+void IPFSAtomStorage::clear_filter(void)
+{
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	_filter.reset(MIN_FILTER_CAPACITY);
+	_filter_stale = false;
+	_filter_valid = true;
+}
+
+/// The AtomSpace CID was replaced; rebuild at the next lookup.
+void IPFSAtomStorage::invalidate_filter(void)
+{
+	_filter_valid = false;
+	_filter_stale = true;
+}
+
+/// A name was added to the directory. The CID lock must be held.
+void IPFSAtomStorage::filter_add(const std::string& name)
+{
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	if (not _filter_valid) return;
+	_filter.add(name);
+
+	// Over-full; the false-positive rate is climbing.
+	if (2 * _filter.capacity() < _filter.size()) _filter_stale = true;
+}
+
+/// A name was removed from the directory. The CID lock must be held.
+void IPFSAtomStorage::filter_remove(const std::string& name)
+{
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	if (not _filter_valid) return;
+	_filter.remove(name);
+}
+
+/// Return false only if the Atom is definitely not in the AtomSpace.
+bool IPFSAtomStorage::filter_may_contain(const Handle& h)
+{
+	if (_filter_stale) rebuild_filter();
+
+	std::string label(encodeAtomToStr(h));
+	std::lock_guard<std::mutex> lck(_filter_mutex);
+	if (not _filter_valid) return true;
+	return _filter.maybe_contains(label);
+}
+
+/// Look up the Atom in the AtomSpace, unless the filter rules it out.
+Handle IPFSAtomStorage::filtered_fetch(Handle& h)
+{
+	if (not filter_may_contain(h))
+	{
+		_num_filter_negatives++;
+		return Handle();
+	}
+
+	Handle hf(do_fetch_atom(h));
+	if (nullptr == hf and _filter_valid) _num_filter_false_positives++;
+	return hf;
+}
+
+/* ============================= END OF FILE ================= */
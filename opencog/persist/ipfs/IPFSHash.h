@@ -0,0 +1,148 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/IPFSHash.h
+ *
+ * FUNCTION:
+ * SHA-256 and base58, as used to name blocks.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_IPFS_HASH_H
+#define _OPENCOG_IPFS_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * The two pieces of content addressing that are done locally: the
+ * SHA-256 digest, and the base58 spelling of a CIDv0. Both IPFSCid
+ * and the mock daemon use these, so that the two agree on how a CID
+ * is spelled. Everything is inline; the mock daemon does not link
+ * against the storage library.
+ */
+struct IPFSHash
+{
+	static constexpr const char* B58_ALPHABET =
+		"123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+	static constexpr uint32_t sha_k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+		0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+		0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+		0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+		0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+		0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+		0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+		0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+		0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+	static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+	static void sha256_block(uint32_t h[8], const uint8_t* p)
+	{
+		uint32_t w[64];
+		for (int i = 0; i < 16; i++)
+			w[i] = (p[4*i] << 24) | (p[4*i+1] << 16) | (p[4*i+2] << 8) | p[4*i+3];
+		for (int i = 16; i < 64; i++)
+		{
+			uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+			uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+			w[i] = w[i-16] + s0 + w[i-7] + s1;
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+		uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+		for (int i = 0; i < 64; i++)
+		{
+			uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+			uint32_t ch = (e & f) ^ (~e & g);
+			uint32_t t1 = k + S1 + ch + sha_k[i] + w[i];
+			uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+			uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+			uint32_t t2 = S0 + maj;
+			k = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+	}
+
+	/// Whole blocks are hashed in place; only the padded tail is copied.
+	static void sha256(const std::string& msg, uint8_t digest[32])
+	{
+		uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		                 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+		const uint8_t* p = (const uint8_t*) msg.data();
+		size_t whole = msg.size() - msg.size() % 64;
+		for (size_t blk = 0; blk < whole; blk += 64)
+			sha256_block(h, p + blk);
+
+		uint8_t tail[128];
+		size_t rem = msg.size() - whole;
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, p + whole, rem);
+		tail[rem] = 0x80;
+		size_t tlen = (rem < 56) ? 64 : 128;
+		uint64_t bitlen = ((uint64_t) msg.size()) * 8;
+		for (int i = 0; i < 8; i++)
+			tail[tlen - 1 - i] = bitlen >> (8*i);
+		for (size_t blk = 0; blk < tlen; blk += 64)
+			sha256_block(h, tail + blk);
+
+		for (int i = 0; i < 8; i++)
+		{
+			digest[4*i] = h[i] >> 24;
+			digest[4*i+1] = h[i] >> 16;
+			digest[4*i+2] = h[i] >> 8;
+			digest[4*i+3] = h[i];
+		}
+	}
+
+	/// Base58 of up to 34 bytes: a multihash, say.
+	static std::string base58(const uint8_t* in, size_t len)
+	{
+		// 34 bytes never need more than 47 base58 digits.
+		uint8_t digits[68];
+		size_t ndig = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			uint32_t carry = in[i];
+			for (size_t j = 0; j < ndig; j++)
+			{
+				carry += (uint32_t) digits[j] << 8;
+				digits[j] = carry % 58;
+				carry /= 58;
+			}
+			while (carry)
+			{
+				digits[ndig++] = carry % 58;
+				carry /= 58;
+			}
+		}
+
+		std::string out;
+		for (size_t i = 0; i < len and 0 == in[i]; i++) out += '1';
+		for (size_t j = ndig; 0 < j--; ) out += B58_ALPHABET[digits[j]];
+		return out;
+	}
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_IPFS_HASH_H
@@ -2,11 +2,22 @@
  * IPFSIncoming.cc
  * Save and restore of atom incoming set.
  *
+ * The incoming set is kept in the mutable version of the Atom, as a
+ * map from the type of the holder to the GUIDs of the holders of that
+ * type:
+ *    "incoming": {"ListLink": ["Qm...", "Qm..."], "EvaluationLink": [...]}
+ * so that the holders of a given type can be found without fetching
+ * all of the others. Older AtomSpaces kept a flat list of GUIDs; such
+ * a list is still read, and is converted the first time that the
+ * incoming set of that Atom is written.
+ *
  * Copyright (c) 2008,2009,2013,2017,2019 Linas Vepstas <linas@linas.org>
  * SPDX-License-Identifier: AGPL-3.0-or-later
  */
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include <opencog/atoms/base/Atom.h>
 
 #include "IPFSAtomStorage.h"
@@ -15,10 +26,51 @@ using namespace opencog;
 
 /* ================================================================== */
 
+/// Return the GUIDs in the incoming set, in either format.
+std::vector<std::string> IPFSAtomStorage::incoming_guids(const ipfs::Json& inco)
+{
+	std::vector<std::string> guids;
+	if (inco.is_array())
+	{
+		for (const ipfs::Json& guid : inco)
+			guids.push_back(guid.get<std::string>());
+	}
+	else if (inco.is_object())
+	{
+		for (const auto& bucket : inco)
+			for (const ipfs::Json& guid : bucket)
+				guids.push_back(guid.get<std::string>());
+	}
+	return guids;
+}
+
+/// Return the incoming set in the by-type format. An old-style flat
+/// list is converted; this needs the type of each holder, which is
+/// taken from the cache, if possible, and otherwise fetched.
+ipfs::Json IPFSAtomStorage::typed_incoming(const ipfs::Json& inco)
+{
+	if (inco.is_object()) return inco;
+
+	ipfs::Json typed = ipfs::Json::object();
+	for (const std::string& guid : incoming_guids(inco))
+	{
+		Handle hin(guid_to_atom(guid));
+		ipfs::Json& bucket = typed[nameserver().getTypeName(hin->get_type())];
+		if (bucket.end() == std::find(bucket.begin(), bucket.end(), guid))
+			bucket.push_back(guid);
+	}
+	if (0 < inco.size()) _num_incoming_upgrades++;
+	return typed;
+}
+
+/* ================================================================== */
+
 /// Store `holder` into the incoming set of atom.
 void IPFSAtomStorage::store_incoming_of(const Handle& atom,
                                         const Handle& holder)
 {
+	TraceSpan span(_tracer, "store_incoming_of", "atom", atom);
+
 	// No publication of Incoming Set, if there's no AtomSpace key.
 	if (0 == _keyname.size()) return;
 
@@ -32,87 +84,36 @@ void IPFSAtomStorage::store_incoming_of(const Handle& atom,
 	{
 		std::string holder_guid = get_atom_guid(holder);
 		std::lock_guard<std::mutex> lck(_json_mutex);
-		jatom = _json_map.find(atom)->second;
+		const auto& pj = _json_map.find(atom);
+		if (_json_map.end() == pj)
+			jatom = get_atom_json(atom);
+		else
+			jatom = pj->second;
 
-		ipfs::Json jinco;
+		ipfs::Json jinco = ipfs::Json::object();
 		auto incli = jatom.find("incoming");
 		if (jatom.end() != incli)
-		{
-			// Is the atom already a part of the incoming set?
-			// If so, then there's nothing to do.
-			auto havit = incli->find(holder_guid);
-			if (incli->end() != havit) return;
-			jinco = *incli;
-		}
+			jinco = typed_incoming(*incli);
+
+		// Is the atom already a part of the incoming set?
+		// If so, then there's nothing to do.
+		ipfs::Json& bucket = jinco[nameserver().getTypeName(holder->get_type())];
+		if (bucket.end() != std::find(bucket.begin(), bucket.end(), holder_guid))
+			return;
 
-		jinco.push_back(holder_guid);
+		bucket.push_back(holder_guid);
 		jatom["incoming"] = jinco;
 		_json_map[atom] = jatom;
 	}
 
 	// Store the thing in IPFS
-	ipfs::Json result;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagPut(jatom, &result);
-	conn_pool.push(conn);
-
-	std::string atoid = result["Cid"]["/"];
+	std::string atoid = dag_put(jatom, atom_shard(encodeAtomToStr(atom)));
 	// std::cout << "Incoming Atom: " << encodeAtomToStr(atom)
 	//          << " CID: " << atoid << std::endl;
 
 	update_atom_in_atomspace(atom, atoid);
 }
 
-/* ================================================================== */
-
-/// Remove `holder` from the incoming set of atom.
-void IPFSAtomStorage::remove_incoming_of(const Handle& atom,
-                                         const std::string& holder)
-{
-	// std::cout << "Remove from " << atom->to_short_string()
-	//           << " in CID " << holder << std::endl;
-
-	// Twiddle the incoming set of atom. As before, we can either
-	// ask IPFS for the current json, or we can work out of what we
-	// have in the cache. Use the cache for speed. All edits to the
-	// json must be don atomically, since there may be other threads
-	// racing with us.
-	ipfs::Json jatom;
-	{
-		std::lock_guard<std::mutex> lck(_json_mutex);
-		auto patom = _json_map.find(atom);
-		if (_json_map.end() == patom)
-			jatom = get_atom_json(atom);
-		else
-			jatom = patom->second; // jatom = _json_map[atom];
-
-		// Remove the holder from the incoming set ...
-		auto pinco = jatom.find("incoming");
-		if (jatom.end() == pinco)
-			throw RuntimeException(TRACE_INFO,
-				"Error: Atom is missing incoming set! WTF!?\n");
-
-		std::set<std::string> inco = *pinco; // inco = jatom["incoming"];
-		inco.erase(holder);
-		if (0 < inco.size())
-			jatom["incoming"] = inco;
-		else
-			jatom.erase("incoming");
-		// std::cout << "Atom after erasure: " << jatom.dump(2) << std::endl;
-		_json_map[atom] = jatom;
-	}
-
-	// Store the edited Atom back into IPFS...
-	ipfs::Json result;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagPut(jatom, &result);
-	conn_pool.push(conn);
-
-	// Finally, update the Atomspace with this revised Atom.
-	std::string atoid = result["Cid"]["/"];
-	update_atom_in_atomspace(atom, atoid);
-}
-
 /* ================================================================ */
 /**
  * Retreive the entire incoming set of the indicated atom.
@@ -120,29 +121,54 @@ void IPFSAtomStorage::remove_incoming_of(const Handle& atom,
  * expects the associated Values to be fetched also.
  */
 void IPFSAtomStorage::getIncomingSet(AtomTable& table, const Handle& h)
+{
+	for (const Handle& hl : fetch_incoming_set(h))
+		table.add(hl, false);
+}
+
+/// Return the incoming set of the Atom, with Values.
+HandleSeq IPFSAtomStorage::fetch_incoming_set(const Handle& h)
 {
 	rethrow();
 
-	// Get the incoming set of the atom.
-	std::string path = _atomspace_cid + "/" + h->to_short_string();
-	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagGet(path, &dag);
-	conn_pool.push(conn);
+	TraceSpan span(_tracer, "getIncomingSet", "atom", h);
+
+	// Links still sitting in the write queue are not in IPFS yet.
+	// Nothing is ever queued on a read-only snapshot.
+	HandleSeq pend;
+	if (not _read_only) pend = pending_holders(h);
+
+	// Get the incoming set of the atom. If it is held by a pending
+	// Link, it might not be in IPFS yet, either; that's not an error.
+	ipfs::Json dag = (_read_only or 0 < pend.size()) ?
+		get_atom_json(h) : dag_get(atom_path(h));
 	// std::cout << "The dag is:" << dag.dump(2) << std::endl;
 
-	auto iset = dag["incoming"];
-	for (auto acid: iset)
+	HandleSeq links;
+	HandleSet seen;
+	std::vector<std::string> iset(incoming_guids(dag["incoming"]));
+	for (const std::string& acid: iset)
 	{
 		// std::cout << "The incoming is:" << acid.dump(2) << std::endl;
 		// Fetch once, to get it's type & name/outgoing
 		// Fetch a second time to get the current values.
 		Handle h(fetch_atom(acid));
-		table.add(do_fetch_atom(h), false);
+		links.push_back(do_fetch_atom(h));
+		seen.insert(h);
+	}
+
+	// A pending Link might be a re-store of one that is already
+	// listed; list it only once.
+	for (const Handle& hl : pend)
+	{
+		if (not seen.insert(hl).second) continue;
+		links.push_back(hl);
+		_num_overlay_hits++;
 	}
 
 	_num_get_insets++;
 	_num_get_inlinks += iset.size();
+	return links;
 }
 
 /**
@@ -153,17 +179,30 @@ void IPFSAtomStorage::getIncomingByType(AtomTable& table, const Handle& h, Type
 {
 	rethrow();
 
-	// Code is almost same as above. It's not terribly efficient.
-	// But it works, at least.
-	std::string path = _atomspace_cid + "/" + h->to_short_string();
+	TraceSpan span(_tracer, "getIncomingByType", "atom", h);
+
+	// Only the holders of the right type are fetched; an old-style
+	// incoming set has to be fetched in full, and filtered.
+	HandleSeq pend;
+	if (not _read_only) pend = pending_holders(h);
 
-	ipfs::Json dag;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagGet(path, &dag);
-	conn_pool.push(conn);
+	ipfs::Json dag = (_read_only or 0 < pend.size()) ?
+		get_atom_json(h) : dag_get(atom_path(h));
 
-	auto iset = dag["incoming"];
-	for (auto acid: iset)
+	const ipfs::Json& inco = dag["incoming"];
+	if (inco.is_object())
+	{
+		auto bucket = inco.find(nameserver().getTypeName(t));
+		if (inco.end() != bucket)
+		{
+			for (const ipfs::Json& acid: *bucket)
+			{
+				table.add(fetch_atom(acid.get<std::string>()), false);
+				_num_get_inlinks ++;
+			}
+		}
+	}
+	else for (const std::string& acid: incoming_guids(inco))
 	{
 		Handle h(fetch_atom(acid));
 		if (t == h->get_type())
@@ -172,6 +211,12 @@ void IPFSAtomStorage::getIncomingByType(AtomTable& table, const Handle& h, Type
 			_num_get_inlinks ++;
 		}
 	}
+	for (const Handle& hl : pend)
+	{
+		if (t != hl->get_type()) continue;
+		table.add(hl, false);
+		_num_overlay_hits++;
+	}
 
 	_num_get_insets++;
 }
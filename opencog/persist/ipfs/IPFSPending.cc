@@ -0,0 +1,192 @@
+/*
+ * IPFSPending.cc
+ * Overlay of pending asynchronous stores, and per-atom fences.
+ *
+ * An asynchronous `storeAtom()` only queues the Atom; it reaches IPFS
+ * some time later. Until then, a read from IPFS would not see it. So
+ * every queued Atom is listed here, along with everything in its
+ * outgoing tree (all of which get stored, or have their incoming sets
+ * edited, when it is). Reads of an Atom that is listed are answered
+ * from the overlay. A fence on an Atom waits only until no pending
+ * store involves that Atom, rather than draining the whole queue.
+ *
+ * Atoms are listed by name (their directory entry), so that a freshly
+ * created Handle finds the pending one.
+ *
+ * The promises of `store_atom_async()` are kept with the pending store,
+ * and fulfilled when it is unlisted.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+
+/// The Atom is about to be handed to the write queue (or the log).
+/// Returns true if an earlier store of it is still queued.
+bool IPFSAtomStorage::pending_add(const Handle& h, std::promise<void>* done)
+{
+	std::lock_guard<std::mutex> lck(_pending_mutex);
+	bool was_queued = false;
+	auto it = _pending_stores.find(h);
+	if (_pending_stores.end() != it)
+	{
+		was_queued = it->second.queued;
+		it->second.queued = true;
+	}
+	else
+	{
+		it = _pending_stores.emplace(h, PendingStore{true, 0}).first;
+		pending_touch(h, Handle::UNDEFINED, true);
+	}
+	if (done) it->second.waiters.push_back(std::move(*done));
+	return was_queued;
+}
+
+/// A writer has taken the Atom off the queue. Another store of the
+/// same Atom, queued while this one runs, keeps it listed.
+void IPFSAtomStorage::pending_begin(const Handle& h)
+{
+	std::lock_guard<std::mutex> lck(_pending_mutex);
+	auto it = _pending_stores.find(h);
+	if (_pending_stores.end() == it)
+	{
+		// Queued without going through storeAtom(), e.g. replayed
+		// from the write-ahead log.
+		_pending_stores.emplace(h, PendingStore{false, 1});
+		pending_touch(h, Handle::UNDEFINED, true);
+		return;
+	}
+	it->second.queued = false;
+	it->second.inflight++;
+}
+
+/// The writer is done with the Atom, whether or not the store worked.
+/// If it failed, `err` is the reason.
+void IPFSAtomStorage::pending_done(const Handle& h, std::exception_ptr err)
+{
+	std::vector<std::promise<void>> waiters;
+	{
+		std::lock_guard<std::mutex> lck(_pending_mutex);
+		auto it = _pending_stores.find(h);
+		if (_pending_stores.end() == it) return;
+		if (err) it->second.error = err;
+		if (0 < it->second.inflight) it->second.inflight--;
+		if (it->second.queued or 0 < it->second.inflight) return;
+
+		err = it->second.error;
+		waiters.swap(it->second.waiters);
+		_pending_stores.erase(it);
+		pending_touch(h, Handle::UNDEFINED, false);
+	}
+	_pending_cv.notify_all();
+
+	for (std::promise<void>& p : waiters)
+	{
+		if (err) p.set_exception(err);
+		else p.set_value();
+	}
+}
+
+/// List (or unlist) the Atom and its outgoing tree. `holder` is the
+/// Link that the Atom is in, if any. The lock must be held.
+void IPFSAtomStorage::pending_touch(const Handle& h, const Handle& holder,
+                                    bool add)
+{
+	std::string label(encodeAtomToStr(h));
+	if (add)
+	{
+		PendingAtom& pa = _pending_atoms[label];
+		if (0 == pa.refs) pa.atom = h;
+		pa.refs++;
+		if (holder) pa.holders.insert(holder);
+	}
+	else
+	{
+		auto it = _pending_atoms.find(label);
+		if (_pending_atoms.end() == it) return;
+		PendingAtom& pa = it->second;
+		if (holder)
+		{
+			auto hit = pa.holders.find(holder);
+			if (pa.holders.end() != hit) pa.holders.erase(hit);
+		}
+		if (0 == --pa.refs) _pending_atoms.erase(it);
+	}
+
+	if (not h->is_link()) return;
+	for (const Handle& ho : h->getOutgoingSet())
+		pending_touch(ho, h, add);
+}
+
+/// Return the pending version of the Atom, or the undefined handle,
+/// if no store involving it is pending.
+Handle IPFSAtomStorage::pending_lookup(const Handle& h)
+{
+	std::string label(encodeAtomToStr(h));
+	std::lock_guard<std::mutex> lck(_pending_mutex);
+	auto it = _pending_atoms.find(label);
+	if (_pending_atoms.end() == it) return Handle::UNDEFINED;
+	return it->second.atom;
+}
+
+/// Return the pending Links that hold the Atom.
+HandleSeq IPFSAtomStorage::pending_holders(const Handle& h)
+{
+	std::string label(encodeAtomToStr(h));
+	std::lock_guard<std::mutex> lck(_pending_mutex);
+	auto it = _pending_atoms.find(label);
+	if (_pending_atoms.end() == it) return HandleSeq();
+
+	// A Link can be in the incoming set more than once, if it holds
+	// the Atom more than once; list it only once.
+	HandleSeq holders;
+	HandleSet seen;
+	for (const Handle& hl : it->second.holders)
+		if (seen.insert(hl).second) holders.push_back(hl);
+	return holders;
+}
+
+/* ================================================================ */
+
+/**
+ * Wait until no pending store involves the Atom: neither a store of
+ * the Atom itself, nor of any Link that holds it, directly or not.
+ * Stores of unrelated Atoms may still be in the queue. If any store
+ * failed, the error is thrown here, as `flushStoreQueue()` does.
+ *
+ * With the write-ahead log open, logged Atoms reach the write queue
+ * only a batch at a time, and a stalled committer holds them back
+ * until the error is reported; so this falls back to a full flush.
+ */
+void IPFSAtomStorage::fence(const Handle& h)
+{
+	TraceSpan span(_tracer, "fence", "queue", h);
+	_num_fences++;
+
+	if (_wal_enabled)
+	{
+		flushStoreQueue();
+		return;
+	}
+
+	std::string label(encodeAtomToStr(h));
+	{
+		std::unique_lock<std::mutex> lck(_pending_mutex);
+		if (_pending_atoms.end() != _pending_atoms.find(label))
+		{
+			_num_fence_waits++;
+			auto start = std::chrono::steady_clock::now();
+			_pending_cv.wait(lck, [&] {
+				return _pending_atoms.end() == _pending_atoms.find(label); });
+			_fence_wait.record_since(start);
+		}
+	}
+	rethrow();
+}
+
+/* ============================= END OF FILE ================= */
@@ -50,14 +50,31 @@ void IPFSPersistSCM::init(void)
     define_scheme_primitive("ipfs-close", &IPFSPersistSCM::do_close, this, "persist-ipfs");
     define_scheme_primitive("ipfs-stats", &IPFSPersistSCM::do_stats, this, "persist-ipfs");
     define_scheme_primitive("ipfs-clear-stats", &IPFSPersistSCM::do_clear_stats, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-stats-json", &IPFSPersistSCM::do_stats_json, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-stats-prometheus", &IPFSPersistSCM::do_stats_prometheus, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-trace-start", &IPFSPersistSCM::do_trace_start, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-trace-stop", &IPFSPersistSCM::do_trace_stop, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-trace-dump", &IPFSPersistSCM::do_trace_dump, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-open-wal", &IPFSPersistSCM::do_open_wal, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-close-wal", &IPFSPersistSCM::do_close_wal, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-open-checkpoint", &IPFSPersistSCM::do_open_checkpoint, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-close-checkpoint", &IPFSPersistSCM::do_close_checkpoint, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-set-write-lane", &IPFSPersistSCM::do_set_write_lane, this, "persist-ipfs");
 
     define_scheme_primitive("ipfs-atom-cid", &IPFSPersistSCM::do_atom_cid, this, "persist-ipfs");
     define_scheme_primitive("ipfs-fetch-atom", &IPFSPersistSCM::do_fetch_atom, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-fetch-atoms", &IPFSPersistSCM::do_fetch_atoms, this, "persist-ipfs");
     define_scheme_primitive("ipfs-load-atomspace", &IPFSPersistSCM::do_load_atomspace, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-bulk-load", &IPFSPersistSCM::do_bulk_load, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-bulk-store", &IPFSPersistSCM::do_bulk_store, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-bulk-status", &IPFSPersistSCM::do_bulk_status, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-bulk-cancel", &IPFSPersistSCM::do_bulk_cancel, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-bulk-wait", &IPFSPersistSCM::do_bulk_wait, this, "persist-ipfs");
     define_scheme_primitive("ipfs-atomspace-cid", &IPFSPersistSCM::do_ipfs_atomspace, this, "persist-ipfs");
     define_scheme_primitive("ipns-atomspace-cid", &IPFSPersistSCM::do_ipns_atomspace, this, "persist-ipfs");
     define_scheme_primitive("ipfs-publish-atomspace", &IPFSPersistSCM::do_publish_atomspace, this, "persist-ipfs");
     define_scheme_primitive("ipfs-resolve-atomspace", &IPFSPersistSCM::do_resolve_atomspace, this, "persist-ipfs");
+    define_scheme_primitive("ipfs-publish-options", &IPFSPersistSCM::do_publish_options, this, "persist-ipfs");
 }
 
 IPFSPersistSCM::~IPFSPersistSCM()
@@ -136,6 +153,18 @@ Handle IPFSPersistSCM::do_fetch_atom(const std::string& cid)
     return _as->add_atom(_backing->fetch_atom(cid));
 }
 
+HandleSeq IPFSPersistSCM::do_fetch_atoms(const HandleSeq& hs)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-fetch-atoms: Error: Database not open");
+
+    HandleSeq found;
+    for (const Handle& h : _backing->fetchAtoms(hs))
+        if (h) found.push_back(_as->add_atom(h));
+    return found;
+}
+
 void IPFSPersistSCM::do_load_atomspace(const std::string& cid)
 {
     if (nullptr == _backing)
@@ -145,6 +174,51 @@ void IPFSPersistSCM::do_load_atomspace(const std::string& cid)
     return _backing->load_atomspace(_as, cid);
 }
 
+int IPFSPersistSCM::do_bulk_load(const std::string& path)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-bulk-load: Error: Database not open");
+
+    return _backing->load_atomspace_job(_as, path);
+}
+
+int IPFSPersistSCM::do_bulk_store(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-bulk-store: Error: Database not open");
+
+    return _backing->store_atomspace_job(_as->get_atomtable());
+}
+
+std::string IPFSPersistSCM::do_bulk_status(int job)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-bulk-status: Error: Database not open");
+
+    return _backing->bulk_job_status(job).dump();
+}
+
+void IPFSPersistSCM::do_bulk_cancel(int job)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-bulk-cancel: Error: Database not open");
+
+    _backing->cancel_bulk_job(job);
+}
+
+void IPFSPersistSCM::do_bulk_wait(int job)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-bulk-wait: Error: Database not open");
+
+    _backing->wait_bulk_job(job);
+}
+
 std::string IPFSPersistSCM::do_ipfs_atomspace(void)
 {
     if (nullptr == _backing)
@@ -181,6 +255,17 @@ void IPFSPersistSCM::do_resolve_atomspace(void)
     return _backing->resolve_atomspace();
 }
 
+void IPFSPersistSCM::do_publish_options(const std::string& lifetime,
+                                        const std::string& ttl,
+                                        int min_interval)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-publish-options: Error: Database not open");
+
+    _backing->set_publish_options(lifetime, ttl, min_interval);
+}
+
 void IPFSPersistSCM::do_stats(void)
 {
     if (nullptr == _backing) {
@@ -202,6 +287,104 @@ void IPFSPersistSCM::do_clear_stats(void)
     _backing->clear_stats();
 }
 
+std::string IPFSPersistSCM::do_stats_json(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-stats-json: Error: Database not open");
+
+    ipfs::Json stats = _backing->get_stats();
+    stats["atomspace_size"] = (size_t) _as->get_size();
+    return stats.dump();
+}
+
+std::string IPFSPersistSCM::do_stats_prometheus(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-stats-prometheus: Error: Database not open");
+
+    return _backing->get_stats_prometheus();
+}
+
+void IPFSPersistSCM::do_trace_start(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-trace-start: Error: Database not open");
+
+    _backing->start_trace();
+}
+
+void IPFSPersistSCM::do_trace_stop(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-trace-stop: Error: Database not open");
+
+    _backing->stop_trace();
+}
+
+void IPFSPersistSCM::do_trace_dump(const std::string& filename)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-trace-dump: Error: Database not open");
+
+    _backing->dump_trace(filename);
+}
+
+void IPFSPersistSCM::do_open_wal(const std::string& path, bool sync)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-open-wal: Error: Database not open");
+
+    _backing->open_wal(path, sync);
+}
+
+void IPFSPersistSCM::do_close_wal(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-close-wal: Error: Database not open");
+
+    _backing->close_wal();
+}
+
+void IPFSPersistSCM::do_open_checkpoint(const std::string& path, int interval)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-open-checkpoint: Error: Database not open");
+
+    if (interval <= 0)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-open-checkpoint: Error: Interval must be positive");
+
+    _backing->open_checkpoint(path, interval);
+}
+
+void IPFSPersistSCM::do_close_checkpoint(void)
+{
+    if (nullptr == _backing)
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-close-checkpoint: Error: Database not open");
+
+    _backing->close_checkpoint();
+}
+
+void IPFSPersistSCM::do_set_write_lane(const std::string& lane)
+{
+    if (lane == "interactive")
+        IPFSAtomStorage::set_thread_lane(IPFSAtomStorage::LANE_INTERACTIVE);
+    else if (lane == "bulk")
+        IPFSAtomStorage::set_thread_lane(IPFSAtomStorage::LANE_BULK);
+    else
+        throw RuntimeException(TRACE_INFO,
+            "ipfs-set-write-lane: Error: Unknown lane \"%s\"", lane.c_str());
+}
+
 void opencog_persist_ipfs_init(void)
 {
     static IPFSPersistSCM patty(NULL);
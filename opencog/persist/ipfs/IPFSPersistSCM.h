@@ -41,14 +41,31 @@ public:
 	void do_load(void);
 	std::string do_atom_cid(const Handle&);
 	Handle do_fetch_atom(const std::string&);
+	HandleSeq do_fetch_atoms(const HandleSeq&);
 	void do_load_atomspace(const std::string&);
+	int do_bulk_load(const std::string&);
+	int do_bulk_store(void);
+	std::string do_bulk_status(int);
+	void do_bulk_cancel(int);
+	void do_bulk_wait(int);
 	std::string do_ipfs_atomspace(void);
 	std::string do_ipns_atomspace(void);
 	void do_publish_atomspace(void);
 	void do_resolve_atomspace(void);
+	void do_publish_options(const std::string&, const std::string&, int);
 
 	void do_stats(void);
 	void do_clear_stats(void);
+	std::string do_stats_json(void);
+	std::string do_stats_prometheus(void);
+	void do_trace_start(void);
+	void do_trace_stop(void);
+	void do_trace_dump(const std::string&);
+	void do_open_wal(const std::string&, bool);
+	void do_close_wal(void);
+	void do_open_checkpoint(const std::string&, int);
+	void do_close_checkpoint(void);
+	void do_set_write_lane(const std::string&);
 }; // class
 
 /** @}*/
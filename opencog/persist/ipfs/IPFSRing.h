@@ -0,0 +1,99 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/IPFSRing.h
+ *
+ * FUNCTION:
+ * Consistent-hash ring, assigning Atoms to the daemons of a sharded
+ * AtomSpace.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_IPFS_RING_H
+#define _OPENCOG_IPFS_RING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * Consistent-hash ring over `n` shards. Each shard is placed on the
+ * ring at `VNODES` points; a key belongs to the shard at the first
+ * point at or after the hash of the key, going around. Adding a shard
+ * moves only about 1/n of the keys, and, with enough points, each
+ * shard gets close to 1/n of them.
+ *
+ * Shards are named by their number, not by the daemon that holds
+ * them, and the hash (FNV-1a, then a splitmix64 finalization) is the
+ * same in every process and on every platform, so that every reader
+ * of an AtomSpace, no matter which daemons it talks to, finds a key
+ * in the same shard as the writer put it.
+ */
+class IPFSRing
+{
+	private:
+		static const size_t VNODES = 128;
+		std::vector<std::pair<uint64_t, size_t>> _points;
+		size_t _num_shards;
+
+	public:
+		static uint64_t hash(const std::string& key)
+		{
+			uint64_t h = 0xcbf29ce484222325ULL;
+			for (unsigned char c : key)
+			{
+				h ^= c;
+				h *= 0x100000001b3ULL;
+			}
+			h += 0x9e3779b97f4a7c15ULL;
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+			return h ^ (h >> 31);
+		}
+
+		IPFSRing(void) : _num_shards(1) {}
+
+		void reset(size_t num_shards)
+		{
+			_num_shards = std::max(num_shards, (size_t) 1);
+			_points.clear();
+			if (1 == _num_shards) return;
+
+			_points.reserve(_num_shards * VNODES);
+			for (size_t s = 0; s < _num_shards; s++)
+				for (size_t v = 0; v < VNODES; v++)
+					_points.push_back({hash("shard-" + std::to_string(s) +
+					                        "#" + std::to_string(v)), s});
+			std::sort(_points.begin(), _points.end());
+		}
+
+		size_t num_shards(void) const { return _num_shards; }
+
+		/// The shard that the key belongs to.
+		size_t owner(const std::string& key) const
+		{
+			if (1 == _num_shards) return 0;
+			uint64_t h = hash(key);
+			auto it = std::lower_bound(_points.begin(), _points.end(),
+			                           std::make_pair(h, (size_t) 0));
+			if (_points.end() == it) it = _points.begin();
+			return it->second;
+		}
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_IPFS_RING_H
@@ -0,0 +1,303 @@
+/*
+ * IPFSShard.cc
+ * Splitting one AtomSpace across several IPFS daemons.
+ *
+ * Every change to the AtomSpace is a patch of its directory, and the
+ * patches have to be made one at a time, so a single daemon caps how
+ * fast an AtomSpace can be stored, no matter how many writers there
+ * are. Given several daemons, as in
+ *    ipfs://host1:5001,host2:5001,host3:5001/atomspace-key
+ * each Atom is assigned to one of them, by a consistent-hash ring over
+ * the Atom's name (the same name that its GUID is the hash of; the
+ * GUID itself is not known until the Atom has been put). The Atom's
+ * blocks, and its entry in the directory, go to that daemon. Each
+ * daemon keeps a directory of its own, under a lock of its own, so
+ * patches to different daemons proceed in parallel.
+ *
+ * The AtomSpace CID names a top-level directory, kept on the first
+ * daemon, with one entry per shard, `shard-0`, `shard-1`, and so on,
+ * linking to the directories of the shards. It is put afresh only
+ * when someone asks for the CID (to publish it, checkpoint it, etc.)
+ * and some shard directory has changed since.
+ *
+ * Readers find an Atom by name in the directory of the shard that the
+ * ring picks, so they must name the same number of daemons, in the
+ * same order, as the writer did. Bulk loads read the shard directories
+ * one after another, so they work through any daemons that can reach
+ * all of the blocks.
+ * Blocks that are known only by CID (the Atoms in an incoming set,
+ * say) are fetched from the daemon that they were put to, or seen
+ * listed on; failing that, each daemon is tried in turn, with a short
+ * timeout. Daemons that are peered with one another will find any
+ * block on the first try. Where blocks are is remembered for as many
+ * blocks as the shared block cache holds; past that, the oldest are
+ * forgotten first.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+// Names of the entries in the top-level directory.
+#define SHARD_PREFIX "shard-"
+#define SHARD_PREFIX_LEN (sizeof(SHARD_PREFIX) - 1)
+
+/* ================================================================ */
+
+/// The number of daemons named in the URI.
+size_t IPFSAtomStorage::num_endpoints(const std::string& uri)
+{
+	size_t start = sizeof("ipfs://") - 1;
+	size_t end = std::min(uri.find('/', start), uri.size());
+	size_t n = 1;
+	for (size_t i = start; i < end; i++)
+		if (',' == uri[i]) n++;
+	return n;
+}
+
+/// Attach to each of the daemons in the comma-separated list of
+/// `hostname:port` pairs; either part may be left out. The first
+/// daemon named is the primary.
+void IPFSAtomStorage::attach_shards(const std::string& endpoints)
+{
+	size_t start = 0;
+	while (start <= endpoints.size())
+	{
+		size_t end = endpoints.find(',', start);
+		if (std::string::npos == end) end = endpoints.size();
+
+		std::string host = endpoints.substr(start, end - start);
+		int port = 5001;
+		size_t colon = host.find(':');
+		if (std::string::npos != colon)
+		{
+			port = atoi(host.c_str() + colon + 1);
+			host.resize(colon);
+		}
+		if (0 == host.size()) host = "localhost";
+
+		_shards.emplace_back(new Shard);
+		Shard& sh = *_shards.back();
+		sh.shared = IPFSShared::attach(host, port, _initial_conn_pool_size);
+		sh.calls = 0;
+		sh.links = 0;
+		if (1 == _shards.size())
+		{
+			_hostname = host;
+			_port = port;
+		}
+		start = end + 1;
+	}
+
+	_shared = _shards[0]->shared;
+	_ring.reset(_shards.size());
+	_root_stale = false;
+}
+
+/// The shared state of the daemon holding the Atom's blocks.
+IPFSShared& IPFSAtomStorage::atom_home(const std::string& label)
+{
+	return *_shards[atom_shard(label)]->shared;
+}
+
+/// The path to the Atom's entry in the AtomSpace directory.
+std::string IPFSAtomStorage::atom_path(const Handle& h)
+{
+	std::string label(encodeAtomToStr(h));
+	if (not sharded())
+	{
+		std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
+		return _atomspace_cid + "/" + label;
+	}
+
+	Shard& sh = *_shards[atom_shard(label)];
+	std::lock_guard<std::mutex> lck(sh.dir_mutex);
+	return sh.dir_cid + "/" + label;
+}
+
+/* ================================================================ */
+// Where the blocks are.
+
+/// The CID that a path starts at: either CID/name or /ipfs/CID/name.
+static std::string path_head(const std::string& path)
+{
+	size_t start = path.compare(0, 6, "/ipfs/") ? 0 : 6;
+	size_t end = path.find('/', start);
+	if (std::string::npos == end) end = path.size();
+	return path.substr(start, end - start);
+}
+
+/// Remember that the block that the path starts at is on `shard`.
+void IPFSAtomStorage::note_block(const std::string& path, size_t shard)
+{
+	if (not sharded()) return;
+	IPFSCid cid(path_head(path));
+	size_t limit = _shared->block_capacity();
+	std::lock_guard<std::mutex> lck(_loc_mutex);
+	auto ins = _block_loc.emplace(cid, shard);
+	if (not ins.second)
+	{
+		ins.first->second = shard;
+		return;
+	}
+	_loc_order.push_back(cid);
+
+	while (limit < _loc_order.size())
+	{
+		_block_loc.erase(_loc_order.front());
+		_loc_order.pop_front();
+	}
+}
+
+/// The shard holding the block that the path starts at, or -1 if
+/// not known.
+int IPFSAtomStorage::block_shard(const std::string& path)
+{
+	IPFSCid cid(path_head(path));
+	std::lock_guard<std::mutex> lck(_loc_mutex);
+	auto it = _block_loc.find(cid);
+	if (_block_loc.end() == it) return -1;
+	return it->second;
+}
+
+/* ================================================================ */
+// The top-level directory.
+
+/// If these are the links of the top-level directory of a split
+/// AtomSpace, return the CIDs of the shard directories, in shard
+/// order; otherwise, return nothing.
+static std::vector<std::string> shard_dirs(const ipfs::Json& links)
+{
+	std::vector<std::string> dirs(links.size());
+	for (const ipfs::Json& lnk : links)
+	{
+		const std::string& name = lnk["Name"].get_ref<const std::string&>();
+		if (name.compare(0, SHARD_PREFIX_LEN, SHARD_PREFIX))
+			return std::vector<std::string>();
+		size_t s = atoi(name.c_str() + SHARD_PREFIX_LEN);
+		if (links.size() <= s or 0 < dirs[s].size() or
+		    name != SHARD_PREFIX + std::to_string(s))
+			return std::vector<std::string>();
+		dirs[s] = lnk["Cid"]["/"];
+	}
+	return dirs;
+}
+
+/// Return the AtomSpace CID. If the AtomSpace is split, and some
+/// shard directory has changed, the top-level directory is put anew.
+std::string IPFSAtomStorage::atomspace_root(void)
+{
+	std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
+	refresh_root();
+	return _atomspace_cid;
+}
+
+/// Called with the CID lock held.
+void IPFSAtomStorage::refresh_root(void)
+{
+	if (not _root_stale.exchange(false)) return;
+	try
+	{
+		_atomspace_cid = put_root();
+	}
+	catch (...)
+	{
+		_root_stale = true;
+		throw;
+	}
+}
+
+/// Put the top-level directory, linking the shard directories, on the
+/// primary daemon, and return its CID.
+std::string IPFSAtomStorage::put_root(void)
+{
+	ipfs::Json links = ipfs::Json::array();
+	for (size_t s = 0; s < _shards.size(); s++)
+	{
+		std::lock_guard<std::mutex> lck(_shards[s]->dir_mutex);
+		links.push_back({{"Name", SHARD_PREFIX + std::to_string(s)},
+		                 {"Hash", _shards[s]->dir_cid},
+		                 {"Size", 0}});
+	}
+	ipfs::Json root = {{"Data", ""}, {"Links", links}};
+	return object_put(root, 0);
+}
+
+/// Make `cid` the AtomSpace CID. If this AtomSpace is split, `cid`
+/// must name one that is split the same number of ways; the shard
+/// directories are taken from it. Called with the CID lock held.
+void IPFSAtomStorage::set_atomspace_root(const std::string& cid)
+{
+	if (sharded())
+	{
+		ipfs::Json root = dag_get(cid);
+		std::vector<std::string> dirs(shard_dirs(root["links"]));
+		if (dirs.size() != _shards.size())
+			throw IOException(TRACE_INFO,
+				"AtomSpace %s is not split across %zu daemons\n",
+				cid.c_str(), _shards.size());
+
+		for (size_t s = 0; s < _shards.size(); s++)
+		{
+			note_block(dirs[s], s);
+			std::lock_guard<std::mutex> lck(_shards[s]->dir_mutex);
+			_shards[s]->dir_cid = dirs[s];
+		}
+		_root_stale = false;
+	}
+	_atomspace_cid = cid;
+}
+
+/// Start every shard off with an empty directory, and put the
+/// top-level directory linking them.
+void IPFSAtomStorage::make_shard_dirs(const std::string& text)
+{
+	for (size_t s = 0; s < _shards.size(); s++)
+	{
+		std::string dir = files_add("AtomSpace", text, s);
+		std::lock_guard<std::mutex> lck(_shards[s]->dir_mutex);
+		_shards[s]->dir_cid = dir;
+	}
+
+	std::lock_guard<std::mutex> lck(_atomspace_cid_mutex);
+	_root_stale = false;
+	_atomspace_cid = put_root();
+}
+
+/// Return the entries of the AtomSpace directory at `root`, as given
+/// by `dag get`: {"Name": "...", "Cid": {"/": "..."}, ...}. The
+/// entries of a split AtomSpace are gathered up from all of its
+/// shards, whether or not this instance is split the same way.
+ipfs::Json IPFSAtomStorage::atomspace_links(const std::string& root)
+{
+	// Any CID names immutable content; but only a snapshot keeps it.
+	auto get = [this](const std::string& cid) -> ipfs::Json {
+		return _read_only ? snapshot_fetch(cid) : dag_get(cid); };
+
+	ipfs::Json dir = get(root);
+	std::vector<std::string> dirs(shard_dirs(dir["links"]));
+	if (0 == dirs.size()) return dir["links"];
+
+	// If the shards line up with ours, their blocks are where the
+	// shard directories are.
+	bool ours = dirs.size() == _shards.size();
+	ipfs::Json links = ipfs::Json::array();
+	for (size_t s = 0; s < dirs.size(); s++)
+	{
+		if (ours) note_block(dirs[s], s);
+		ipfs::Json sdir = get(dirs[s]);
+		for (const ipfs::Json& lnk : sdir["links"])
+		{
+			if (ours) note_block(lnk["Cid"]["/"], s);
+			links.push_back(lnk);
+		}
+	}
+	return links;
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,208 @@
+/*
+ * IPFSShared.cc
+ * Connections, blocks and GUIDs shared by all storage objects that
+ * talk to the same daemon.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <functional>
+
+#include "IPFSShared.h"
+
+using namespace opencog;
+
+// Blocks kept, across all AtomSpaces on one daemon. Atom blocks are
+// a few hundred bytes, so this is some tens of megabytes.
+#define DEFAULT_BLOCK_CAPACITY 65536
+
+std::mutex IPFSShared::_registry_mutex;
+std::map<std::string, std::weak_ptr<IPFSShared>> IPFSShared::_registry;
+
+/* ================================================================ */
+
+IPFSShared::IPFSShared(const std::string& hostname, int port) :
+	_endpoint(hostname + ":" + std::to_string(port)),
+	_hostname(hostname),
+	_port(port),
+	_num_connections(0),
+	_num_instances(0),
+	_block_capacity(DEFAULT_BLOCK_CAPACITY)
+{
+}
+
+IPFSShared::~IPFSShared()
+{
+	while (not conn_pool.is_empty())
+		delete conn_pool.pop();
+}
+
+std::shared_ptr<IPFSShared> IPFSShared::attach(const std::string& hostname,
+                                               int port, size_t nconns)
+{
+	std::shared_ptr<IPFSShared> shared;
+	{
+		std::lock_guard<std::mutex> lck(_registry_mutex);
+
+		// Forget the daemons that no one is using any more.
+		for (auto it = _registry.begin(); it != _registry.end(); )
+		{
+			if (it->second.expired()) it = _registry.erase(it);
+			else it++;
+		}
+
+		std::string endpoint = hostname + ":" + std::to_string(port);
+		shared = _registry[endpoint].lock();
+		if (nullptr == shared)
+		{
+			shared = std::make_shared<IPFSShared>(hostname, port);
+			_registry[endpoint] = shared;
+		}
+	}
+
+	for (size_t i = 0; i < nconns; i++)
+		shared->conn_pool.push(new ipfs::Client(hostname, port));
+	shared->_num_connections += nconns;
+	shared->_num_instances++;
+	return shared;
+}
+
+void IPFSShared::detach(size_t nconns)
+{
+	// pop() blocks until another user hands a connection back.
+	for (size_t i = 0; i < nconns; i++)
+		delete conn_pool.pop();
+	_num_connections -= nconns;
+	_num_instances--;
+}
+
+/* ================================================================ */
+
+IPFSShared::BlockShard& IPFSShared::shard(const std::string& cid)
+{
+	return _blocks[std::hash<std::string>()(cid) % BLOCK_SHARDS];
+}
+
+/// Copy the block into `dag`, and return true, if it is cached.
+bool IPFSShared::get_block(const std::string& cid, ipfs::Json& dag)
+{
+	BlockShard& bs = shard(cid);
+	std::lock_guard<std::mutex> lck(bs.mtx);
+	auto it = bs.blocks.find(cid);
+	if (bs.blocks.end() == it) return false;
+	dag = it->second;
+	return true;
+}
+
+void IPFSShared::put_block(const std::string& cid, const ipfs::Json& dag)
+{
+	size_t limit = _block_capacity / BLOCK_SHARDS;
+	BlockShard& bs = shard(cid);
+	std::lock_guard<std::mutex> lck(bs.mtx);
+	if (not bs.blocks.emplace(cid, dag).second) return;
+	bs.order.push_back(cid);
+
+	while (limit < bs.order.size())
+	{
+		bs.blocks.erase(bs.order.front());
+		bs.order.pop_front();
+	}
+}
+
+/// Set the most blocks kept. Shrinking takes effect as new blocks
+/// are added.
+void IPFSShared::set_block_capacity(size_t cap)
+{
+	if (cap < BLOCK_SHARDS) cap = BLOCK_SHARDS;
+	_block_capacity = cap;
+}
+
+size_t IPFSShared::num_blocks(void)
+{
+	size_t n = 0;
+	for (BlockShard& bs : _blocks)
+	{
+		std::lock_guard<std::mutex> lck(bs.mtx);
+		n += bs.blocks.size();
+	}
+	return n;
+}
+
+/* ================================================================ */
+
+/// Return the GUID of the named Atom, written the given way, or the
+/// empty CID, if it has not been stored (or fetched) by anyone yet.
+IPFSCid IPFSShared::get_guid(const std::string& name, bool links)
+{
+	std::lock_guard<std::mutex> lck(_guid_mutex);
+	auto it = _guid_by_name[links].find(name);
+	if (_guid_by_name[links].end() == it) return IPFSCid();
+	return it->second;
+}
+
+/// Return the name of the Atom with the given GUID, or the empty
+/// string, if it's not known.
+std::string IPFSShared::get_name(const IPFSCid& guid)
+{
+	std::lock_guard<std::mutex> lck(_guid_mutex);
+	auto it = _name_by_guid.find(guid);
+	if (_name_by_guid.end() == it) return std::string();
+	return it->second;
+}
+
+void IPFSShared::record_guid(const std::string& name, bool links,
+                             const IPFSCid& guid)
+{
+	std::lock_guard<std::mutex> lck(_guid_mutex);
+	auto ins = _guid_by_name[links].emplace(name, guid);
+	if (not ins.second) return;
+	_name_by_guid.emplace(guid, name);
+	_guid_order.push_back({links, name, guid});
+
+	while (_block_capacity < _guid_order.size())
+	{
+		const GuidEntry& old = _guid_order.front();
+		_guid_by_name[old.links].erase(old.name);
+		_name_by_guid.erase(old.guid);
+		_guid_order.pop_front();
+	}
+}
+
+/// Return the CID of the block holding the encoded Value with the
+/// given digest, or the empty string, if it's not known.
+std::string IPFSShared::get_value_cid(const IPFSCid& digest)
+{
+	std::lock_guard<std::mutex> lck(_value_mutex);
+	auto it = _value_cids.find(digest);
+	if (_value_cids.end() == it) return std::string();
+	return it->second.to_string();
+}
+
+void IPFSShared::record_value_cid(const IPFSCid& digest,
+                                  const std::string& cid)
+{
+	std::lock_guard<std::mutex> lck(_value_mutex);
+	if (not _value_cids.emplace(digest, IPFSCid(cid)).second) return;
+	_value_order.push_back(digest);
+
+	while (_block_capacity < _value_order.size())
+	{
+		_value_cids.erase(_value_order.front());
+		_value_order.pop_front();
+	}
+}
+
+size_t IPFSShared::num_value_cids(void)
+{
+	std::lock_guard<std::mutex> lck(_value_mutex);
+	return _value_cids.size();
+}
+
+size_t IPFSShared::num_guids(void)
+{
+	std::lock_guard<std::mutex> lck(_guid_mutex);
+	return _guid_by_name[0].size() + _guid_by_name[1].size();
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,149 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/IPFSShared.h
+ *
+ * FUNCTION:
+ * State shared by all of the storage objects talking to one daemon.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_IPFS_SHARED_H
+#define _OPENCOG_IPFS_SHARED_H
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <ipfs/client.h>
+
+#include <opencog/util/concurrent_stack.h>
+#include <opencog/persist/ipfs/IPFSCid.h>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * Everything that several AtomSpaces, stored in the same IPFS daemon,
+ * can usefully share: the connections to the daemon, the blocks that
+ * have been fetched from it, and the GUIDs of the Atoms stored in it.
+ * Blocks are named by their content, so they never go stale, no
+ * matter which AtomSpace fetched or stored them; the same is true of
+ * GUIDs, which depend only on the Atom itself, and on how its outgoing
+ * set is written. A Link has one GUID with bare GUID strings, and
+ * another with IPLD links; the two are kept apart. Only the Atom's
+ * name is kept with its GUID, never its Handle: each AtomSpace makes
+ * its own Atom from the name.
+ *
+ * Likewise, the CIDs of Value blocks are remembered, by the SHA-256
+ * of their content, so that a Value that some AtomSpace has already
+ * put is not uploaded again.
+ *
+ * There is one of these per daemon (per host:port), for as long as
+ * any storage object is attached to it. Each storage object lends
+ * its connections to the common pool when it attaches, and takes
+ * them back when it detaches.
+ *
+ * The block cache holds at most `block_capacity()` blocks; past that,
+ * the oldest are dropped first. The same bound, and the same order,
+ * applies to the GUIDs, and to the Value CIDs.
+ */
+class IPFSShared
+{
+	private:
+		static std::mutex _registry_mutex;
+		static std::map<std::string, std::weak_ptr<IPFSShared>> _registry;
+
+		std::string _endpoint;
+		std::string _hostname;
+		int _port;
+
+		std::atomic<size_t> _num_connections;
+		std::atomic<size_t> _num_instances;
+
+		static const size_t BLOCK_SHARDS = 64;
+		struct BlockShard
+		{
+			std::mutex mtx;
+			std::unordered_map<std::string, ipfs::Json> blocks;
+			std::deque<std::string> order;
+		};
+		BlockShard _blocks[BLOCK_SHARDS];
+		std::atomic<size_t> _block_capacity;
+		BlockShard& shard(const std::string&);
+
+		std::mutex _guid_mutex;
+		struct GuidEntry
+		{
+			bool links;
+			std::string name;
+			IPFSCid guid;
+		};
+		std::unordered_map<std::string, IPFSCid> _guid_by_name[2];
+		std::unordered_map<IPFSCid, std::string> _name_by_guid;
+		std::deque<GuidEntry> _guid_order;
+
+		std::mutex _value_mutex;
+		std::unordered_map<IPFSCid, IPFSCid> _value_cids;
+		std::deque<IPFSCid> _value_order;
+
+	public:
+		IPFSShared(const std::string& hostname, int port);
+		IPFSShared(const IPFSShared&) = delete;
+		IPFSShared& operator=(const IPFSShared&) = delete;
+		~IPFSShared();
+
+		/// Return the shared state for the daemon, creating it if
+		/// need be, and add `nconns` connections to its pool.
+		static std::shared_ptr<IPFSShared> attach(const std::string& hostname,
+		                                          int port, size_t nconns);
+		/// Take back `nconns` connections, waiting until they are
+		/// free, and close them.
+		void detach(size_t nconns);
+
+		concurrent_stack<ipfs::Client*> conn_pool;
+
+		// Immutable blocks, by CID.
+		bool get_block(const std::string& cid, ipfs::Json&);
+		void put_block(const std::string& cid, const ipfs::Json&);
+		void set_block_capacity(size_t);
+
+		// Atom name <-> GUID. `links` is true for a Link written
+		// with IPLD links; it is always false for Nodes.
+		IPFSCid get_guid(const std::string& name, bool links);
+		std::string get_name(const IPFSCid& guid);
+		void record_guid(const std::string& name, bool links,
+		                 const IPFSCid& guid);
+
+		// Digest of encoded Value -> CID of its block. The digest
+		// is `IPFSCid::of_bytes(payload)`.
+		std::string get_value_cid(const IPFSCid& digest);
+		void record_value_cid(const IPFSCid& digest,
+		                      const std::string& cid);
+
+		const std::string& endpoint(void) const { return _endpoint; }
+		const std::string& hostname(void) const { return _hostname; }
+		int port(void) const { return _port; }
+		size_t num_connections(void) const { return _num_connections; }
+		size_t num_instances(void) const { return _num_instances; }
+		size_t num_blocks(void);
+		size_t block_capacity(void) const { return _block_capacity; }
+		size_t num_guids(void);
+		size_t num_value_cids(void);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_IPFS_SHARED_H
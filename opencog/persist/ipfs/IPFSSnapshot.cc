@@ -0,0 +1,144 @@
+/*
+ * IPFSSnapshot.cc
+ * Read-only access to an AtomSpace snapshot.
+ *
+ * An AtomSpace opened by its IPFS CID, as `ipfs:///ipfs/Qm...`, can
+ * never change: the CID names the content. So writes are refused up
+ * front, and nothing that exists only to keep writes consistent (the
+ * pending-store overlay, the membership filter, the CID lock) is used.
+ *
+ * The AtomSpace directory is read once, when the snapshot is opened,
+ * into a table that is never modified afterwards; looking an Atom up
+ * in it needs no lock. Each entry has a slot for the Atom's block,
+ * filled in, once, by whichever thread fetches it first, and kept
+ * until the snapshot is closed. Reads of Atoms in the directory, once
+ * their blocks are fetched, thus never lock, and never go to the
+ * daemon. Other blocks (those named by the GUIDs in incoming and
+ * outgoing sets) are kept as well, in a sharded table.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <functional>
+
+#include <opencog/util/Logger.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+
+/// Read the AtomSpace directory into the snapshot table.
+void IPFSAtomStorage::open_snapshot(void)
+{
+	TraceSpan span(_tracer, "open_snapshot", "bulk");
+
+	// A split AtomSpace is read shard by shard.
+	const ipfs::Json links = atomspace_links(_atomspace_cid);
+
+	_snapshot_size = links.size();
+	_snapshot.reset(new SnapshotEntry[_snapshot_size]);
+	_snapshot_names.reserve(_snapshot_size);
+	_snapshot_cids.reserve(_snapshot_size);
+
+	size_t i = 0;
+	for (const ipfs::Json& lnk : links)
+	{
+		SnapshotEntry* ent = &_snapshot[i++];
+		ent->cid = lnk["Cid"]["/"];
+		_snapshot_names.emplace(lnk["Name"], ent);
+		_snapshot_cids.emplace(ent->cid, ent);
+	}
+
+	logger().info("Opened read-only AtomSpace %s with %zu atoms\n",
+	              _atomspace_cid.c_str(), _snapshot_size);
+}
+
+/// Release the cached blocks.
+void IPFSAtomStorage::close_snapshot(void)
+{
+	for (size_t i = 0; i < _snapshot_size; i++)
+		delete _snapshot[i].dag.load();
+	_snapshot_names.clear();
+	_snapshot_cids.clear();
+	_snapshot.reset();
+	_snapshot_size = 0;
+	_snapshot_cached = 0;
+}
+
+/// Throw, if this is a read-only snapshot.
+void IPFSAtomStorage::check_writable(const char* what)
+{
+	if (_read_only)
+		throw RuntimeException(TRACE_INFO,
+			"Cannot %s: %s is a read-only snapshot", what, _uri.c_str());
+}
+
+/* ================================================================ */
+
+/// Return the block of a directory entry, fetching it if need be.
+/// Two threads might both fetch it; the first one to finish wins,
+/// and the other throws its copy away. The blocks are identical.
+const ipfs::Json& IPFSAtomStorage::snapshot_block(SnapshotEntry& ent)
+{
+	const ipfs::Json* dag = ent.dag.load(std::memory_order_acquire);
+	if (dag)
+	{
+		_num_snapshot_hits++;
+		return *dag;
+	}
+
+	_num_snapshot_misses++;
+	ipfs::Json* fetched = new ipfs::Json(dag_get(ent.cid));
+	if (ent.dag.compare_exchange_strong(dag, fetched,
+	                                    std::memory_order_acq_rel))
+	{
+		_snapshot_cached++;
+		return *fetched;
+	}
+
+	delete fetched;
+	return *dag;
+}
+
+/// Return the block with the given CID, fetching it if need be.
+const ipfs::Json& IPFSAtomStorage::snapshot_fetch(const std::string& cid)
+{
+	auto ent = _snapshot_cids.find(cid);
+	if (_snapshot_cids.end() != ent)
+		return snapshot_block(*ent->second);
+
+	BlockShard& shard =
+		_snapshot_blocks[std::hash<std::string>()(cid) % SNAPSHOT_SHARDS];
+	{
+		std::lock_guard<std::mutex> lck(shard.mtx);
+		auto it = shard.blocks.find(cid);
+		if (shard.blocks.end() != it)
+		{
+			_num_snapshot_hits++;
+			return it->second;
+		}
+	}
+
+	// Don't hold the lock while talking to the daemon. References
+	// to map entries stay valid as the map grows.
+	_num_snapshot_misses++;
+	ipfs::Json dag = dag_get(cid);
+	std::lock_guard<std::mutex> lck(shard.mtx);
+	auto ins = shard.blocks.emplace(cid, std::move(dag));
+	if (ins.second) _snapshot_cached++;
+	return ins.first->second;
+}
+
+/// The snapshot version of `get_atom_json()`. Atoms that are not in
+/// the directory are not in the snapshot; no need to ask the daemon.
+ipfs::Json IPFSAtomStorage::snapshot_atom_json(const Handle& atom)
+{
+	auto ent = _snapshot_names.find(encodeAtomToStr(atom));
+	if (_snapshot_names.end() == ent) return ipfs::Json();
+	return snapshot_block(*ent->second);
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,586 @@
+/*
+ * IPFSStats.cc
+ * Machine-readable snapshots of the performance counters.
+ *
+ * `print_stats()` is meant for humans; the snapshot here is meant for
+ * monitoring systems. It is a JSON object holding every counter,
+ * gauge and histogram, and can also be rendered in the Prometheus
+ * text exposition format.
+ *
+ * Taking a snapshot never talks to the daemon, and never walks a
+ * per-Atom table; it reads each counter once, and takes a few locks
+ * just long enough to copy out a size or a CID. Two of those locks,
+ * the one on the AtomSpace CID and those on the shard directories,
+ * are also held while a directory is being patched, so a snapshot may
+ * wait out one patch. It is cheap enough to poll every second. It is
+ * serialized against `clear_stats()`, so that it never sees
+ * half-reset counters.
+ *
+ * The CID reported is the one last put. When the AtomSpace is split,
+ * the top-level directory is only put when someone asks for the CID
+ * (see IPFSShard.cc), so it can lag behind the shards; "root_stale"
+ * says whether it does. Polling the stats does not put it.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <sstream>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+
+ipfs::Json IPFSAtomStorage::histogram_json(const LatencyHistogram& h)
+{
+	return {
+		{"count", h.count()},
+		{"sum", h.sum()},
+		{"mean", h.mean()},
+		{"p50", h.percentile(0.5)},
+		{"p90", h.percentile(0.9)},
+		{"p99", h.percentile(0.99)},
+		{"p999", h.percentile(0.999)},
+		{"max", h.max()}};
+}
+
+/**
+ * Return a snapshot of all performance counters, as a JSON object.
+ * Counters are cumulative since the last `clear_stats()`; gauges
+ * (queue size, pool occupancy, stall state) are instantaneous.
+ * Latencies are in microseconds, unless the key says otherwise.
+ */
+ipfs::Json IPFSAtomStorage::get_stats(void)
+{
+	std::lock_guard<std::mutex> lck(_stats_mutex);
+
+	ipfs::Json stats;
+	stats["uri"] = _uri;
+	{
+		std::lock_guard<std::mutex> klck(_key_mutex);
+		stats["ipns"] = _key_ready ? _key_cid : "";
+		stats["open"] = {
+			{"async", _async_open},
+			{"key_ready", _key_ready},
+			{"key_type", _key_type},
+			{"outgoing", _ipld_links ? "links" : "guids"},
+			{"key_msec", _key_msec},
+			{"key_waits", (size_t) _num_key_waits}};
+	}
+	{
+		std::lock_guard<std::mutex> clck(_atomspace_cid_mutex);
+		stats["cid"] = _atomspace_cid;
+	}
+	time_t now = time(0);
+	stats["time"] = (long) now;
+	stats["stats_since"] = (long) _stats_time;
+	stats["stats_secs"] = (long) (now - _stats_time);
+
+	stats["atoms"] = {
+		{"loads", (size_t) _load_count},
+		{"stores", (size_t) _store_count},
+		{"valuation_stores", (size_t) _valuation_stores},
+		{"value_stores", (size_t) _value_stores},
+		{"remove_requests", (size_t) _num_atom_removes},
+		{"deletes", (size_t) _num_atom_deletes},
+		{"get_atoms", (size_t) _num_get_atoms},
+		{"got_nodes", (size_t) _num_got_nodes},
+		{"got_links", (size_t) _num_got_links},
+		{"get_incoming_sets", (size_t) _num_get_insets},
+		{"get_incoming_links", (size_t) _num_get_inlinks},
+		{"node_inserts", (size_t) _num_node_inserts},
+		{"link_inserts", (size_t) _num_link_inserts},
+		{"incoming_upgrades", (size_t) _num_incoming_upgrades},
+		{"multi_gets", (size_t) _num_multi_gets},
+		{"multi_get_atoms", (size_t) _num_multi_get_atoms},
+		{"closure_prefetches", (size_t) _num_closure_prefetches},
+		{"closure_rounds", (size_t) _num_closure_rounds},
+		{"closure_blocks", (size_t) _num_closure_blocks}};
+
+	{
+		std::lock_guard<std::mutex> lck(_job_mutex);
+		stats["jobs"] = {
+			{"threads", _job_threads.size()},
+			{"max_threads", _async_threads},
+			{"queued", _jobs.size()},
+			{"submitted", (size_t) _num_jobs_submitted},
+			{"done", (size_t) _num_jobs_done}};
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(_bulk_mutex);
+		size_t running = 0;
+		for (const auto& pr : _bulk_jobs)
+			if (JOB_RUNNING == pr.second->state) running++;
+		stats["bulk_jobs"] = {
+			{"started", _bulk_jobs.size()},
+			{"running", running}};
+	}
+
+	stats["publish"] = {
+		{"requests", (size_t) _num_publish_requests},
+		{"publishes", (size_t) _num_publishes},
+		{"skips", (size_t) _num_publish_skips},
+		{"fails", (size_t) _num_publish_fails},
+		{"msec", (size_t) _publish_msec},
+		{"slowest_msec", (size_t) _publish_slowest_msec}};
+
+	ipfs::Json lanes = ipfs::Json::object();
+	for (int i = 0; i < LANE_NUM; i++)
+	{
+		async_buffer<IPFSAtomStorage, Handle>& q = lane_queue((WriteLane) i);
+		lanes[lane_name((WriteLane) i)] = {
+			{"items", (size_t) q._item_count},
+			{"duplicates", (size_t) q._duplicate_count},
+			{"flushes", (size_t) q._flush_count},
+			{"drains", (size_t) q._drain_count},
+			{"drain_msec", (size_t) q._drain_msec},
+			{"drain_slowest_msec", (size_t) q._drain_slowest_msec},
+			{"drain_concurrent", (size_t) q._drain_concurrent},
+			{"in_drain", (bool) q._in_drain},
+			{"busy_writers", (size_t) q.get_busy_writers()},
+			{"size", (size_t) q.get_size()},
+			{"high_watermark", q.get_high_watermark()},
+			{"low_watermark", q.get_low_watermark()},
+			{"stalling", q.stalling()},
+			{"queue_wait_usec", histogram_json(_lane_stats[i].queue_wait)},
+			{"store_usec", histogram_json(_lane_stats[i].store_time)}};
+	}
+	stats["write_queue"]["lanes"] = lanes;
+	stats["write_queue"]["interactive_writers"] = _interactive_writers;
+	stats["write_queue"]["bulk_borrows"] = (size_t) _num_bulk_borrows;
+
+	{
+		std::lock_guard<std::mutex> qlck(_qbytes_mutex);
+		stats["write_queue"]["bytes"] = {
+			{"enabled", (bool) _qbytes_enabled},
+			{"queued", _queued_bytes},
+			{"peak", _queued_bytes_peak},
+			{"high_watermark", _qbytes_high},
+			{"low_watermark", _qbytes_low},
+			{"stalls", (size_t) _qbytes_stalls},
+			{"stall_usec", histogram_json(_qbytes_stall_time)}};
+	}
+
+	size_t wal_pending;
+	{
+		std::lock_guard<std::mutex> wlck(_wal_mutex);
+		wal_pending = _wal_pending.size();
+	}
+	stats["wal"] = {
+		{"enabled", (bool) _wal_enabled},
+		{"path", _wal_path},
+		{"appends", (size_t) _wal_appends},
+		{"replayed", (size_t) _wal_replayed},
+		{"pending", wal_pending},
+		{"batches", (size_t) _wal_batches},
+		{"committed", (size_t) _wal_committed},
+		{"failures", (size_t) _wal_failures},
+		{"commit_usec", histogram_json(_wal_commit_latency)}};
+
+	{
+		std::lock_guard<std::mutex> clck(_ckpt_mutex);
+		stats["checkpoint"] = {
+			{"enabled", (bool) _ckpt_enabled},
+			{"path", _ckpt_path},
+			{"interval", _ckpt_interval},
+			{"journaled", _ckpt_atoms},
+			{"checkpointed", _ckpt_last},
+			{"resumed", (size_t) _ckpt_resumed},
+			{"skipped", (size_t) _ckpt_skipped},
+			{"checkpoints", (size_t) _ckpt_writes}};
+	}
+
+	{
+		std::lock_guard<std::mutex> flck(_filter_mutex);
+		size_t negs = _num_filter_negatives;
+		size_t fps = _num_filter_false_positives;
+		stats["filter"] = {
+			{"valid", (bool) _filter_valid},
+			{"keys", _filter.size()},
+			{"capacity", _filter.capacity()},
+			{"hashes", _filter.num_hashes()},
+			{"memory_bytes", _filter.memory_bytes()},
+			{"estimated_fp_rate", _filter.false_positive_rate()},
+			{"negatives", negs},
+			{"false_positives", fps},
+			{"observed_fp_rate", (0 == negs + fps) ? 0.0 :
+			                     fps / ((double) (negs + fps))},
+			{"rebuilds", (size_t) _num_filter_rebuilds}};
+	}
+
+	stats["snapshot"] = {
+		{"read_only", _read_only},
+		{"atoms", _snapshot_size},
+		{"cached_blocks", (size_t) _snapshot_cached},
+		{"hits", (size_t) _num_snapshot_hits},
+		{"misses", (size_t) _num_snapshot_misses}};
+
+	size_t pending_atoms;
+	{
+		std::lock_guard<std::mutex> plck(_pending_mutex);
+		pending_atoms = _pending_atoms.size();
+	}
+	stats["pending"] = {
+		{"atoms", pending_atoms},
+		{"overlay_hits", (size_t) _num_overlay_hits},
+		{"fences", (size_t) _num_fences},
+		{"fence_waits", (size_t) _num_fence_waits},
+		{"fence_wait_usec", histogram_json(_fence_wait)}};
+
+	stats["values"] = {
+		{"layout", _value_blocks ? "blocks" : "inline"},
+		{"blocks_put", (size_t) _num_value_blocks_put},
+		{"blocks_reused", (size_t) _num_value_blocks_reused},
+		{"blocks_fetched", (size_t) _num_value_blocks_fetched},
+		{"unchanged", (size_t) _num_values_unchanged}};
+
+	size_t cin = _compress_bytes_in;
+	size_t cout = _compress_bytes_out;
+	stats["compression"] = {
+		{"available", have_compression()},
+		{"threshold", _compress_threshold},
+		{"level", _compress_level},
+		{"compressed", (size_t) _num_compressed},
+		{"skipped", (size_t) _num_compress_skips},
+		{"expanded", (size_t) _num_expanded},
+		{"bytes_in", cin},
+		{"bytes_out", cout},
+		{"ratio", cout ? cin / (double) cout : 1.0},
+		{"compress_usec", (size_t) _compress_usec},
+		{"expand_usec", (size_t) _expand_usec}};
+
+	// The pool is shared with the other AtomSpaces on this daemon;
+	// "own" is the part that this one added.
+	stats["conn_pool"] = {
+		{"free", (size_t) _shared->conn_pool.size()},
+		{"size", _shared->num_connections()},
+		{"own", _initial_conn_pool_size},
+		{"wait_usec", histogram_json(_conn_wait)}};
+
+	// The hits and misses are for this AtomSpace only.
+	stats["shared"] = {
+		{"endpoint", _shared->endpoint()},
+		{"instances", _shared->num_instances()},
+		{"blocks", _shared->num_blocks()},
+		{"block_capacity", _shared->block_capacity()},
+		{"guids", _shared->num_guids()},
+		{"value_cids", _shared->num_value_cids()},
+		{"interned_cids", IPFSCid::num_interned()},
+		{"block_hits", (size_t) _num_shared_block_hits},
+		{"block_misses", (size_t) _num_shared_block_misses},
+		{"guid_hits", (size_t) _num_shared_guid_hits}};
+
+	// The daemons that the AtomSpace is split across; just the one,
+	// if it is not split. "links" counts directory patches.
+	ipfs::Json shards = ipfs::Json::array();
+	for (const auto& sh : _shards)
+	{
+		std::lock_guard<std::mutex> dlck(sh->dir_mutex);
+		shards.push_back({
+			{"endpoint", sh->shared->endpoint()},
+			{"calls", (size_t) sh->calls},
+			{"links", (size_t) sh->links},
+			{"dir", sh->dir_cid}});
+	}
+	{
+		std::lock_guard<std::mutex> llck(_loc_mutex);
+		stats["sharding"] = {
+			{"shards", shards},
+			{"located_blocks", _block_loc.size()},
+			{"root_stale", (bool) _root_stale},
+			{"misses", (size_t) _num_shard_misses}};
+	}
+
+	ipfs::Json rpcs = ipfs::Json::object();
+	for (int i = 0; i < RPC_NUM; i++)
+	{
+		const RPCStats& st = _rpc_stats[i];
+		rpcs[rpc_name((RPC) i)] = {
+			{"calls", (size_t) st.calls},
+			{"errors", (size_t) st.errors},
+			{"bytes_sent", (size_t) st.bytes_sent},
+			{"bytes_received", (size_t) st.bytes_received},
+			{"latency_usec", histogram_json(st.latency)}};
+	}
+	stats["rpc"] = rpcs;
+
+	return stats;
+}
+
+/* ================================================================ */
+
+// The HELP and TYPE lines that precede the samples of each metric.
+static void prom_head(std::ostringstream& out, const std::string& name,
+                      const char* type, const char* help)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+}
+
+static void prom_line(std::ostringstream& out, const std::string& name,
+                      const std::string& labels, const ipfs::Json& val)
+{
+	out << name;
+	if (0 < labels.size()) out << "{" << labels << "}";
+	if (val.is_boolean())
+		out << " " << (val.get<bool>() ? 1 : 0) << "\n";
+	else
+		out << " " << val.dump() << "\n";
+}
+
+static void prom_one(std::ostringstream& out, const std::string& name,
+                     const char* type, const char* help,
+                     const ipfs::Json& val)
+{
+	prom_head(out, name, type, help);
+	prom_line(out, name, "", val);
+}
+
+/**
+ * Return the same snapshot as `get_stats()`, in the Prometheus text
+ * exposition format. Metric names are prefixed `atomspace_ipfs_`.
+ * Latency histograms are exported as summaries, in seconds.
+ */
+std::string IPFSAtomStorage::get_stats_prometheus(void)
+{
+	ipfs::Json st = get_stats();
+	std::ostringstream out;
+	const std::string pfx = "atomspace_ipfs_";
+
+	prom_one(out, pfx + "stats_seconds", "gauge",
+	         "Seconds since the counters were last cleared.",
+	         st["stats_secs"]);
+
+	const ipfs::Json& atoms = st["atoms"];
+	prom_one(out, pfx + "loads_total", "counter",
+	         "Atoms loaded.", atoms["loads"]);
+	prom_one(out, pfx + "stores_total", "counter",
+	         "Atoms stored.", atoms["stores"]);
+	prom_one(out, pfx + "valuation_stores_total", "counter",
+	         "Valuations stored.", atoms["valuation_stores"]);
+	prom_one(out, pfx + "value_stores_total", "counter",
+	         "Values stored.", atoms["value_stores"]);
+	prom_one(out, pfx + "remove_requests_total", "counter",
+	         "Atom removal requests.", atoms["remove_requests"]);
+	prom_one(out, pfx + "deletes_total", "counter",
+	         "Atoms deleted.", atoms["deletes"]);
+	prom_one(out, pfx + "get_atoms_total", "counter",
+	         "Atom fetches.", atoms["get_atoms"]);
+	prom_one(out, pfx + "get_incoming_sets_total", "counter",
+	         "Incoming set fetches.", atoms["get_incoming_sets"]);
+	prom_one(out, pfx + "get_incoming_links_total", "counter",
+	         "Links returned by incoming set fetches.",
+	         atoms["get_incoming_links"]);
+
+	const ipfs::Json& pub = st["publish"];
+	prom_one(out, pfx + "publish_requests_total", "counter",
+	         "IPNS publication requests.", pub["requests"]);
+	prom_one(out, pfx + "publishes_total", "counter",
+	         "IPNS publications made.", pub["publishes"]);
+	prom_one(out, pfx + "publish_skips_total", "counter",
+	         "IPNS publication requests collapsed or skipped.",
+	         pub["skips"]);
+	prom_one(out, pfx + "publish_fails_total", "counter",
+	         "IPNS publications that failed.", pub["fails"]);
+
+	// Write queue counters, with the lane as a label.
+	const ipfs::Json& wq = st["write_queue"];
+	const ipfs::Json& lanes = wq["lanes"];
+	struct { const char* key; const char* name; const char* type;
+	         const char* help; } wqs[] = {
+		{"items", "write_queue_items_total", "counter",
+		 "Atoms placed on the write queue."},
+		{"duplicates", "write_queue_duplicates_total", "counter",
+		 "Duplicate atoms dropped from the write queue."},
+		{"flushes", "write_queue_flushes_total", "counter",
+		 "Write queue flushes."},
+		{"drains", "write_queue_drains_total", "counter",
+		 "Write queue drains."},
+		{"size", "write_queue_size", "gauge",
+		 "Atoms waiting on the write queue."},
+		{"busy_writers", "write_queue_busy_writers", "gauge",
+		 "Writer threads currently busy."},
+		{"stalling", "write_queue_stalling", "gauge",
+		 "1 if writers are stalled above the high watermark."}};
+	for (const auto& w : wqs)
+	{
+		prom_head(out, pfx + w.name, w.type, w.help);
+		for (auto it = lanes.begin(); it != lanes.end(); it++)
+			prom_line(out, pfx + w.name, "lane=\"" + it.key() + "\"",
+			          it.value()[w.key]);
+	}
+	prom_one(out, pfx + "write_queue_bulk_borrows_total", "counter",
+	         "Bulk atoms stored by idle interactive writers.",
+	         wq["bulk_borrows"]);
+	prom_one(out, pfx + "write_queue_bytes", "gauge",
+	         "Estimated bytes on the write queue (if accounted).",
+	         wq["bytes"]["queued"]);
+	prom_one(out, pfx + "write_queue_byte_stalls_total", "counter",
+	         "Writer stalls on the byte high watermark.",
+	         wq["bytes"]["stalls"]);
+
+	const ipfs::Json& wal = st["wal"];
+	prom_one(out, pfx + "wal_appends_total", "counter",
+	         "Atoms appended to the write-ahead log.", wal["appends"]);
+	prom_one(out, pfx + "wal_committed_total", "counter",
+	         "Logged atoms committed to IPFS.", wal["committed"]);
+	prom_one(out, pfx + "wal_pending", "gauge",
+	         "Logged atoms not yet committed.", wal["pending"]);
+	prom_one(out, pfx + "wal_failures_total", "counter",
+	         "Write-ahead log batches that failed to commit.",
+	         wal["failures"]);
+
+	const ipfs::Json& filt = st["filter"];
+	prom_one(out, pfx + "filter_keys", "gauge",
+	         "Names in the membership filter.", filt["keys"]);
+	prom_one(out, pfx + "filter_memory_bytes", "gauge",
+	         "Memory used by the membership filter.", filt["memory_bytes"]);
+	prom_one(out, pfx + "filter_estimated_fp_rate", "gauge",
+	         "Expected false-positive rate of the membership filter.",
+	         filt["estimated_fp_rate"]);
+	prom_one(out, pfx + "filter_negatives_total", "counter",
+	         "Lookups answered locally as absent.", filt["negatives"]);
+	prom_one(out, pfx + "filter_false_positives_total", "counter",
+	         "Lookups passed by the filter, but not found.",
+	         filt["false_positives"]);
+
+	const ipfs::Json& snap = st["snapshot"];
+	prom_one(out, pfx + "snapshot_cached_blocks", "gauge",
+	         "Blocks kept by a read-only snapshot.", snap["cached_blocks"]);
+	prom_one(out, pfx + "snapshot_hits_total", "counter",
+	         "Snapshot reads answered from kept blocks.", snap["hits"]);
+	prom_one(out, pfx + "snapshot_misses_total", "counter",
+	         "Snapshot reads that fetched a block.", snap["misses"]);
+
+	const ipfs::Json& pend = st["pending"];
+	prom_one(out, pfx + "pending_atoms", "gauge",
+	         "Atoms involved in stores not yet made.", pend["atoms"]);
+	prom_one(out, pfx + "overlay_hits_total", "counter",
+	         "Reads answered from pending stores.", pend["overlay_hits"]);
+	prom_one(out, pfx + "fence_waits_total", "counter",
+	         "Per-atom fences that had to wait.", pend["fence_waits"]);
+
+	const ipfs::Json& pool = st["conn_pool"];
+	prom_one(out, pfx + "conn_pool_free", "gauge",
+	         "Idle daemon connections.", pool["free"]);
+	prom_one(out, pfx + "conn_pool_size", "gauge",
+	         "Total daemon connections.", pool["size"]);
+
+	const ipfs::Json& vals = st["values"];
+	prom_one(out, pfx + "value_blocks_put_total", "counter",
+	         "Value blocks uploaded to the daemon.", vals["blocks_put"]);
+	prom_one(out, pfx + "value_blocks_reused_total", "counter",
+	         "Value blocks found already uploaded.", vals["blocks_reused"]);
+	prom_one(out, pfx + "value_blocks_fetched_total", "counter",
+	         "Value blocks read back.", vals["blocks_fetched"]);
+	prom_one(out, pfx + "values_unchanged_total", "counter",
+	         "Values stored again without being encoded.", vals["unchanged"]);
+
+	const ipfs::Json& cmp = st["compression"];
+	prom_one(out, pfx + "compressed_values_total", "counter",
+	         "Value payloads stored compressed.", cmp["compressed"]);
+	prom_one(out, pfx + "compress_in_bytes_total", "counter",
+	         "Bytes of Value payloads, before compression.", cmp["bytes_in"]);
+	prom_one(out, pfx + "compress_out_bytes_total", "counter",
+	         "Bytes of Value payloads, after compression.", cmp["bytes_out"]);
+	prom_one(out, pfx + "compress_seconds_total", "counter",
+	         "Time spent compressing Values.",
+	         cmp["compress_usec"].get<size_t>() * 1.0e-6);
+	prom_one(out, pfx + "expand_seconds_total", "counter",
+	         "Time spent expanding Values.",
+	         cmp["expand_usec"].get<size_t>() * 1.0e-6);
+
+	const ipfs::Json& jobs = st["jobs"];
+	prom_one(out, pfx + "async_jobs_queued", "gauge",
+	         "Future-returning fetches waiting for a thread.", jobs["queued"]);
+	prom_one(out, pfx + "async_jobs_total", "counter",
+	         "Future-returning fetches submitted.", jobs["submitted"]);
+	prom_one(out, pfx + "bulk_jobs_running", "gauge",
+	         "Background bulk loads and stores in progress.",
+	         st["bulk_jobs"]["running"]);
+
+	const ipfs::Json& shr = st["shared"];
+	prom_one(out, pfx + "shared_blocks", "gauge",
+	         "Blocks cached for all AtomSpaces on the daemon.", shr["blocks"]);
+	prom_one(out, pfx + "shared_block_hits_total", "counter",
+	         "Block fetches answered from the shared cache.",
+	         shr["block_hits"]);
+	prom_one(out, pfx + "shared_block_misses_total", "counter",
+	         "Block fetches that went to the daemon.", shr["block_misses"]);
+	prom_one(out, pfx + "shared_guid_hits_total", "counter",
+	         "Atom stores that found the GUID already known.",
+	         shr["guid_hits"]);
+	prom_one(out, pfx + "shard_misses_total", "counter",
+	         "Block fetches that had to search the daemons.",
+	         st["sharding"]["misses"]);
+
+	prom_head(out, pfx + "shard_calls_total", "counter",
+	          "Daemon calls, per daemon that the AtomSpace is split across.");
+	for (const ipfs::Json& sh : st["sharding"]["shards"])
+		prom_line(out, pfx + "shard_calls_total",
+		          "endpoint=\"" + sh["endpoint"].get<std::string>() + "\"",
+		          sh["calls"]);
+
+	// Per-endpoint counters, with the endpoint as a label.
+	const ipfs::Json& rpcs = st["rpc"];
+	struct { const char* key; const char* name; const char* help; } ctrs[] = {
+		{"calls", "rpc_calls_total", "Daemon calls, per endpoint."},
+		{"errors", "rpc_errors_total", "Daemon calls that failed."},
+		{"bytes_sent", "rpc_sent_bytes_total", "Payload bytes sent."},
+		{"bytes_received", "rpc_received_bytes_total",
+		 "Payload bytes received."}};
+	for (const auto& c : ctrs)
+	{
+		prom_head(out, pfx + c.name, "counter", c.help);
+		for (auto it = rpcs.begin(); it != rpcs.end(); it++)
+			prom_line(out, pfx + c.name, "rpc=\"" + it.key() + "\"",
+			          it.value()[c.key]);
+	}
+
+	// Latencies, as summaries in seconds.
+	auto summary = [&](const std::string& name, const std::string& label,
+	                   const ipfs::Json& h)
+	{
+		std::string sep = (0 < label.size()) ? label + "," : "";
+		const char* qs[][2] = {{"0.5", "p50"}, {"0.9", "p90"},
+		                       {"0.99", "p99"}, {"0.999", "p999"}};
+		for (const auto& q : qs)
+			prom_line(out, name, sep + "quantile=\"" + q[0] + "\"",
+			          h[q[1]].get<double>() * 1.0e-6);
+		prom_line(out, name + "_sum", label, h["sum"].get<double>() * 1.0e-6);
+		prom_line(out, name + "_count", label, h["count"]);
+	};
+
+	prom_head(out, pfx + "rpc_latency_seconds", "summary",
+	          "Daemon call latency, per endpoint.");
+	for (auto it = rpcs.begin(); it != rpcs.end(); it++)
+		summary(pfx + "rpc_latency_seconds", "rpc=\"" + it.key() + "\"",
+		        it.value()["latency_usec"]);
+
+	prom_head(out, pfx + "write_queue_wait_seconds", "summary",
+	          "Time an atom waits on the write queue, per lane.");
+	for (auto it = lanes.begin(); it != lanes.end(); it++)
+		summary(pfx + "write_queue_wait_seconds", "lane=\"" + it.key() + "\"",
+		        it.value()["queue_wait_usec"]);
+
+	prom_head(out, pfx + "write_queue_store_seconds", "summary",
+	          "Time taken to store a dequeued atom, per lane.");
+	for (auto it = lanes.begin(); it != lanes.end(); it++)
+		summary(pfx + "write_queue_store_seconds", "lane=\"" + it.key() + "\"",
+		        it.value()["store_usec"]);
+
+	prom_head(out, pfx + "fence_wait_seconds", "summary",
+	          "Time spent waiting at per-atom fences.");
+	summary(pfx + "fence_wait_seconds", "", pend["fence_wait_usec"]);
+
+	prom_head(out, pfx + "conn_pool_wait_seconds", "summary",
+	          "Time spent waiting for a daemon connection.");
+	summary(pfx + "conn_pool_wait_seconds", "", pool["wait_usec"]);
+
+	return out.str();
+}
+
+/* ============================= END OF FILE ================= */
@@ -0,0 +1,136 @@
+/*
+ * IPFSTrace.cc
+ * Span tracing, dumped in the Chrome trace-event format.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <unistd.h>
+
+#include <fstream>
+
+#include <ipfs/client.h>
+#include <opencog/util/exceptions.h>
+
+#include "IPFSTrace.h"
+
+using namespace opencog;
+
+typedef std::chrono::steady_clock Clock;
+
+/* ================================================================ */
+
+SpanTracer::SpanTracer(void) :
+	_enabled(false), _max_events(0), _dropped(0), _epoch(Clock::now())
+{
+}
+
+/// Discard any previously recorded spans, and start recording.
+void SpanTracer::start(size_t max_events)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	_events.clear();
+	_max_events = max_events;
+	_dropped = 0;
+	_epoch = Clock::now();
+	_enabled = true;
+}
+
+/// Stop recording. The spans recorded so far are kept, until the
+/// next start().
+void SpanTracer::stop(void)
+{
+	_enabled = false;
+}
+
+void SpanTracer::record(const char* name, const char* cat,
+                        std::string&& arg,
+                        Clock::time_point begin, Clock::time_point end)
+{
+	int tid = thread_id();
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (_max_events <= _events.size())
+	{
+		_dropped++;
+		return;
+	}
+
+	// If tracing was restarted while this span was open, the span
+	// began before the new epoch; clip it there.
+	if (begin < _epoch) begin = _epoch;
+	if (end < begin) end = begin;
+
+	Event ev;
+	ev.name = name;
+	ev.cat = cat;
+	ev.arg = std::move(arg);
+	ev.ts = std::chrono::duration_cast<std::chrono::microseconds>(
+		begin - _epoch).count();
+	ev.dur = std::chrono::duration_cast<std::chrono::microseconds>(
+		end - begin).count();
+	ev.tid = tid;
+	_events.emplace_back(std::move(ev));
+}
+
+size_t SpanTracer::size(void)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	return _events.size();
+}
+
+int SpanTracer::thread_id(void)
+{
+	static std::atomic<int> next_id(1);
+	static thread_local int id = next_id++;
+	return id;
+}
+
+/**
+ * Write the recorded spans to `filename`, as a Chrome trace-event
+ * JSON file. Each span is a "complete" (ph="X") event; the span
+ * argument, if any, is given as `args.atom`.
+ */
+void SpanTracer::dump(const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (not out.is_open())
+		throw IOException(TRACE_INFO,
+			"Unable to open trace file %s", filename.c_str());
+
+	int pid = getpid();
+	std::lock_guard<std::mutex> lck(_mtx);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const Event& ev : _events)
+	{
+		ipfs::Json jev = {
+			{"name", ev.name},
+			{"cat", ev.cat},
+			{"ph", "X"},
+			{"ts", ev.ts},
+			{"dur", ev.dur},
+			{"pid", pid},
+			{"tid", ev.tid}};
+		if (0 < ev.arg.size())
+			jev["args"] = {{"atom", ev.arg}};
+
+		if (not first) out << ",\n";
+		first = false;
+		out << jev.dump();
+	}
+	out << "\n],\"otherData\":{\"dropped_events\":" << _dropped << "}}\n";
+	if (out.fail())
+		throw IOException(TRACE_INFO,
+			"Unable to write trace file %s", filename.c_str());
+}
+
+/* ================================================================ */
+
+TraceSpan::~TraceSpan()
+{
+	if (not _on) return;
+	_tracer.record(_name, _cat, std::move(_arg), _start, Clock::now());
+}
+
+/* ============================= END OF FILE ================= */
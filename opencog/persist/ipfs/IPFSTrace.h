@@ -0,0 +1,133 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/IPFSTrace.h
+ *
+ * FUNCTION:
+ * Span tracing, dumped in the Chrome trace-event format.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_IPFS_TRACE_H
+#define _OPENCOG_IPFS_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencog/atoms/base/Atom.h>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * Records timed spans, so that the time spent storing or fetching a
+ * deeply-nested Atom can be attributed to the individual steps and
+ * daemon calls that it turned into, on whichever thread they ran.
+ *
+ * Tracing is off by default. When off, opening a span costs a single
+ * relaxed atomic load. When on, each span is recorded when it closes;
+ * spans on the same thread nest according to their start and end
+ * times. The recorded spans can be written out as a Chrome
+ * trace-event file, which can be viewed with `chrome://tracing` or
+ * https://ui.perfetto.dev
+ *
+ * At most `max_events` spans are kept; any beyond that are counted,
+ * but dropped.
+ */
+class SpanTracer
+{
+	public:
+		struct Event
+		{
+			const char* name;
+			const char* cat;
+			std::string arg;
+			uint64_t ts;   // usecs since start()
+			uint64_t dur;  // usecs
+			int tid;
+		};
+
+	private:
+		std::atomic<bool> _enabled;
+		std::mutex _mtx;
+		std::vector<Event> _events;
+		size_t _max_events;
+		std::atomic<size_t> _dropped;
+		std::chrono::steady_clock::time_point _epoch;
+
+	public:
+		SpanTracer(void);
+
+		void start(size_t max_events = 1000000);
+		void stop(void);
+		bool enabled(void) const
+		{ return _enabled.load(std::memory_order_relaxed); }
+
+		void record(const char* name, const char* cat, std::string&& arg,
+		            std::chrono::steady_clock::time_point begin,
+		            std::chrono::steady_clock::time_point end);
+		size_t size(void);
+		size_t dropped(void) const { return _dropped; }
+		void dump(const std::string& filename);
+
+		/// A small integer naming the calling thread; stable for
+		/// the life of the thread.
+		static int thread_id(void);
+};
+
+/**
+ * A span, open for the lifetime of this object. The argument, if any,
+ * usually names the Atom or the daemon path being worked on. A Handle
+ * argument is only converted to a string if tracing is enabled.
+ */
+class TraceSpan
+{
+	private:
+		SpanTracer& _tracer;
+		bool _on;
+		const char* _name;
+		const char* _cat;
+		std::string _arg;
+		std::chrono::steady_clock::time_point _start;
+
+	public:
+		TraceSpan(SpanTracer& tr, const char* name, const char* cat) :
+			_tracer(tr), _on(tr.enabled()), _name(name), _cat(cat)
+		{
+			if (_on) _start = std::chrono::steady_clock::now();
+		}
+
+		TraceSpan(SpanTracer& tr, const char* name, const char* cat,
+		          const std::string& arg) :
+			TraceSpan(tr, name, cat)
+		{
+			if (_on) _arg = arg;
+		}
+
+		TraceSpan(SpanTracer& tr, const char* name, const char* cat,
+		          const Handle& h) :
+			TraceSpan(tr, name, cat)
+		{
+			if (_on and h) _arg = h->to_short_string();
+		}
+
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+		~TraceSpan();
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_IPFS_TRACE_H
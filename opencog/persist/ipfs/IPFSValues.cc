@@ -41,16 +41,139 @@ ipfs::Json IPFSAtomStorage::encodeValuesToJSON(const Handle& atom)
 	return jvals;
 }
 
+/// Put each of the values on the Atom into a block of its own, and
+/// return links to them, keyed by the GUID of the key. The names of
+/// the keys are returned in `names`, so that inline copies of the
+/// same values can be dropped.
+ipfs::Json IPFSAtomStorage::encodeValuesToLinks(const Handle& atom,
+                                                std::vector<std::string>& names)
+{
+	ipfs::Json jvals;
+	size_t shard = atom_shard(encodeAtomToStr(atom));
+	HandleSet keys = atom->getKeys();
+	for (const Handle& key: keys)
+	{
+		if (key == tvpred)
+		{
+			TruthValuePtr tv(atom->getTruthValue());
+			if (tv->isDefaultTV()) continue;
+		}
+		ValuePtr pap = atom->getValue(key);
+		std::string cid;
+		if (recall_value_cid(atom, key, pap, cid))
+			_num_values_unchanged++;
+		else
+		{
+			cid = put_value_block(encodeValueToStr(pap), shard);
+			remember_value_cid(atom, key, pap, cid);
+		}
+		jvals[get_atom_guid(key)] = {{"/", cid}};
+		names.push_back(encodeAtomToStr(key));
+	}
+	return jvals;
+}
+
+/// Put the encoded value into a block, unless an identical one has
+/// been put before. Return the CID of the block. The block goes to
+/// the same daemon as the Atom holding the value.
+std::string IPFSAtomStorage::put_value_block(const std::string& payload,
+                                             size_t shard)
+{
+	IPFSCid digest(IPFSCid::of_bytes(payload));
+	std::string cid(_shards[shard]->shared->get_value_cid(digest));
+	if (0 < cid.size())
+	{
+		_num_value_blocks_reused++;
+		return cid;
+	}
+
+	ipfs::Json block = {{"value", payload}};
+	cid = dag_put(block, shard);
+	_num_value_blocks_put++;
+	_shared->put_block(cid, block);
+	_shards[shard]->shared->record_value_cid(digest, cid);
+	return cid;
+}
+
+/// Return the encoded value held in the block.
+std::string IPFSAtomStorage::fetch_value_block(const std::string& cid)
+{
+	ipfs::Json block;
+	if (_read_only)
+		block = snapshot_fetch(cid);
+	else if (_shared->get_block(cid, block))
+		_num_shared_block_hits++;
+	else
+	{
+		_num_shared_block_misses++;
+		block = dag_get(cid);
+		_shared->put_block(cid, block);
+	}
+	_num_value_blocks_fetched++;
+
+	// It can be used again, by Atoms on the daemon that has it.
+	std::string payload = block["value"];
+	int shard = sharded() ? block_shard(cid) : 0;
+	if (not _read_only and 0 <= shard)
+		_shards[shard]->shared->record_value_cid(IPFSCid::of_bytes(payload), cid);
+	return payload;
+}
+
+/// Copy the CID of the block last put for the key on the atom into
+/// `cid`, and return true, if the atom still holds the same Value.
+bool IPFSAtomStorage::recall_value_cid(const Handle& atom, const Handle& key,
+                                       const ValuePtr& pap, std::string& cid)
+{
+	std::lock_guard<std::mutex> lck(_stored_value_mutex);
+	auto pa = _stored_values.find(atom);
+	if (_stored_values.end() == pa) return false;
+	auto pk = pa->second.find(key);
+	if (pa->second.end() == pk) return false;
+
+	// An expired pointer never compares equal to a live Value.
+	if (pk->second.value.lock() != pap) return false;
+	cid = pk->second.cid;
+	return true;
+}
+
+void IPFSAtomStorage::remember_value_cid(const Handle& atom, const Handle& key,
+                                         const ValuePtr& pap,
+                                         const std::string& cid)
+{
+	std::lock_guard<std::mutex> lck(_stored_value_mutex);
+	_stored_values[atom][key] = {pap, cid};
+}
+
+/// Forget the Values stored for the atoms; all of them, if the
+/// list is empty.
+void IPFSAtomStorage::forget_stored_values(const HandleSeq& atoms)
+{
+	std::lock_guard<std::mutex> lck(_stored_value_mutex);
+	if (atoms.empty()) _stored_values.clear();
+	for (const Handle& h : atoms) _stored_values.erase(h);
+}
+
 /* ================================================================== */
 
 /// Store ALL of the values associated with the atom.
 void IPFSAtomStorage::store_atom_values(const Handle& atom)
 {
+	TraceSpan span(_tracer, "store_atom_values", "atom", atom);
+
 	// No publication of Values, if there's no AtomSpace key.
 	if (0 == _keyname.size()) return;
 
 	bool have_values = false;
 
+	// Value blocks go out first, so that the daemon is not
+	// called with the json lock held.
+	ipfs::Json jvals;
+	std::vector<std::string> names;
+	if (_value_blocks)
+		jvals = encodeValuesToLinks(atom, names);
+	else
+		jvals = encodeValuesToJSON(atom);
+
 	// Atomic update of cached json
 	ipfs::Json jatom;
 	{
@@ -61,7 +184,6 @@ void IPFSAtomStorage::store_atom_values(const Handle& atom)
 		else
 			jatom = pj->second;
 
-		ipfs::Json jvals = encodeValuesToJSON(atom);
 		if (0 < jvals.size())
 		{
 			have_values = true;
@@ -79,6 +201,10 @@ void IPFSAtomStorage::store_atom_values(const Handle& atom)
 				for (const auto& [jkey, jvalue]: jvals.items())
 					new_vals[jkey] = jvalue;
 
+				// The links replace any inline copies.
+				for (const std::string& name : names)
+					new_vals.erase(name);
+
 				jatom["values"] = new_vals;
 			}
 			_json_map[atom] = jatom;
@@ -88,12 +214,7 @@ void IPFSAtomStorage::store_atom_values(const Handle& atom)
 	if (not have_values) return;
 
 	// Store the thing in IPFS
-	ipfs::Json result;
-	ipfs::Client* conn = conn_pool.pop();
-	conn->DagPut(jatom, &result);
-	conn_pool.push(conn);
-
-	std::string atoid = result["Cid"]["/"];
+	std::string atoid = dag_put(jatom, atom_shard(encodeAtomToStr(atom)));
 	// std::cout << "Valued Atom: " << encodeAtomToStr(atom)
 	//          << " CID: " << atoid << std::endl;
 
@@ -111,7 +232,7 @@ void IPFSAtomStorage::store_atom_values(const Handle& atom)
 	// XXX TODO this can be speeded up by caching the keys in C++
 	std::string atonam = _keyname + encodeAtomToStr(atom);
 	std::string atokey;
-	conn = conn_pool.pop();
+	ipfs::Client* conn = _shared->conn_pool.pop();
 	conn->KeyFind(atonam, &atokey);
 	if (0 == atokey.size())
 	{
@@ -143,7 +264,7 @@ void IPFSAtomStorage::store_atom_values(const Handle& atom)
 		std::cerr << "Failed to publish Atom Values: "
 		          << ex.what() << std::endl;
 	}
-	conn_pool.push(conn);
+	_shared->conn_pool.push(conn);
 #endif // LATER_WHEN_IPNS_WORKS
 }
 /* ================================================================== */
@@ -158,17 +279,24 @@ void IPFSAtomStorage::get_atom_values(Handle& atom, const ipfs::Json& jatom)
 	ipfs::Json jvals = *pvals;
 	// std::cout << "Jatom vals: " << jvals.dump(2) << std::endl;
 
+	// Inline values are keyed by the key itself; values in blocks of
+	// their own, by the GUID of the key. An Atom may have both.
 	for (const auto& [jkey, jvalue]: jvals.items())
 	{
 		// std::cout << "KV Pair: " << jkey << " "<<jvalue<< std::endl;
-		atom->setValue(decodeStrAtom(jkey), decodeStrValue(jvalue));
+		if (jvalue.is_string())
+			atom->setValue(decodeStrAtom(jkey), decodeStrValue(jvalue));
+		else
+			atom->setValue(guid_to_atom(jkey),
+			               decodeStrValue(fetch_value_block(jvalue["/"])));
 	}
 }
 
 /* ================================================================ */
 
-ValuePtr IPFSAtomStorage::decodeStrValue(const std::string& stv)
+ValuePtr IPFSAtomStorage::decodeStrValue(const std::string& stored)
 {
+	const std::string& stv = expand_value(stored);
 	size_t pos = stv.find("(LinkValue");
 	if (std::string::npos != pos)
 	{
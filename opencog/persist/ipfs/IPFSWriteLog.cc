@@ -0,0 +1,372 @@
+/*
+ * IPFSWriteLog.cc
+ * Local write-ahead log, for crash-safe asynchronous stores.
+ *
+ * When the log is open, an asynchronous `storeAtom()` appends the Atom,
+ * and all of the Values on it, to a local file, and returns. This is
+ * fast, and is not held up by the IPFS daemon. A committer thread
+ * pushes the logged Atoms to IPFS in large batches, through the usual
+ * write-back queue. After each batch has been stored, the CID of the
+ * AtomSpace, and the sequence number of the last record in the batch,
+ * are written to a checkpoint file. If the process dies, the log is
+ * replayed from the checkpoint, the next time that it is opened.
+ *
+ * File layout: the log at PATH holds one JSON record per line:
+ *    {"atom":"(ConceptNode \"foo\")","seq":42,"values":{...}}
+ * The checkpoint at PATH.ckpt holds
+ *    {"cid":"Qm...","seq":41}
+ * and is replaced atomically, by renaming a temp file over it. The log
+ * is truncated whenever every record in it has been committed.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linas@linas.org>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include <opencog/util/Logger.h>
+
+#include "IPFSAtomStorage.h"
+
+using namespace opencog;
+
+// The largest number of Atoms pushed to IPFS in one batch.
+#define WAL_BATCH 4096
+
+/* ================================================================ */
+
+/**
+ * Open (or create) the write-ahead log at `path`. If the log holds
+ * records that were never committed, e.g. because the process
+ * crashed, they are replayed: the AtomSpace CID is reset to the last
+ * checkpoint, and the remaining records are queued for storage.
+ *
+ * If `sync` is set, the log is flushed to disk (with fdatasync) on
+ * every append. Otherwise, appends survive a process crash, but maybe
+ * not a power failure.
+ */
+void IPFSAtomStorage::open_wal(const std::string& path, bool sync)
+{
+	check_writable("open a write-ahead log");
+	if (_wal_enabled)
+		throw RuntimeException(TRACE_INFO,
+			"Write-ahead log %s is already open", _wal_path.c_str());
+
+	// Anything queued before now goes out the old way.
+	flushStoreQueue();
+
+	std::unique_lock<std::mutex> lck(_wal_mutex);
+	_wal_path = path;
+	_wal_sync = sync;
+	_wal_next_seq = 1;
+	_wal_committed_seq = 0;
+	_wal_stalled = false;
+	_wal_pending.clear();
+	wal_replay();
+
+	_wal_keep_going = true;
+	_wal_committer = std::thread(wal_commit_thread, this);
+	_wal_enabled = true;
+	lck.unlock();
+	_wal_cv.notify_all();
+}
+
+/**
+ * Wait for everything in the log to be committed, and close it.
+ * If the committer is stalled on an error, the uncommitted records
+ * are left in the log, to be replayed the next time it is opened.
+ *
+ * The log is marked closed under the lock that appends take, so a
+ * store that races with the close is either appended before it, and
+ * committed, or goes straight to the write queue.
+ */
+void IPFSAtomStorage::close_wal(void)
+{
+	{
+		std::unique_lock<std::mutex> lck(_wal_mutex);
+		if (not _wal_enabled) return;
+		_wal_enabled = false;
+		wal_wait_committed(lck);
+		_wal_keep_going = false;
+	}
+	_wal_cv.notify_all();
+	if (_wal_committer.joinable()) _wal_committer.join();
+
+	std::lock_guard<std::mutex> lck(_wal_mutex);
+	_wal_pending.clear();
+	if (0 <= _wal_fd) close(_wal_fd);
+	_wal_fd = -1;
+}
+
+/// Wait until every record appended so far is committed, or until
+/// the committer stalls on an error. The lock must be held.
+void IPFSAtomStorage::wal_wait_committed(std::unique_lock<std::mutex>& lck)
+{
+	uint64_t want = _wal_next_seq - 1;
+	_wal_cv.wait(lck, [&] {
+		return want <= _wal_committed_seq or _wal_stalled; });
+}
+
+/* ================================================================ */
+
+/// Append one Atom, and its Values, to the log. Called from
+/// `storeAtom()`, in place of queueing the Atom for storage. The
+/// lane is remembered, so that the committer queues the Atom there.
+/// Returns false if the log has been closed in the meantime; the
+/// caller must then queue the Atom itself.
+///
+/// If the append, or the sync, fails, the log is cut back to where
+/// it was, so that no torn or unsynced record is left for a replay
+/// to trip over, and the error is thrown.
+bool IPFSAtomStorage::wal_append(const Handle& h, WriteLane lane)
+{
+	ipfs::Json rec;
+	rec["atom"] = encodeAtomToStr(h);
+	rec["values"] = encodeValuesToJSON(h);
+
+	std::unique_lock<std::mutex> lck(_wal_mutex);
+	if (not _wal_enabled) return false;
+
+	uint64_t seq = _wal_next_seq;
+	rec["seq"] = seq;
+	std::string line = rec.dump() + "\n";
+
+	off_t start = lseek(_wal_fd, 0, SEEK_END);
+	auto fail = [&](const char* what) {
+		int err = errno;
+		if (0 <= start and ftruncate(_wal_fd, start))
+			logger().warn("Unable to truncate write-ahead log %s\n",
+			              _wal_path.c_str());
+		throw IOException(TRACE_INFO, "Unable to %s write-ahead log %s: %s",
+			what, _wal_path.c_str(), strerror(err));
+	};
+
+	const char* p = line.c_str();
+	size_t left = line.size();
+	while (0 < left)
+	{
+		ssize_t n = write(_wal_fd, p, left);
+		if (n < 0 and EINTR == errno) continue;
+		if (n <= 0) fail("append to");
+		p += n;
+		left -= n;
+	}
+	if (_wal_sync and fdatasync(_wal_fd)) fail("sync");
+
+	_wal_next_seq++;
+	_wal_pending.push_back({seq, h, lane});
+	_wal_appends++;
+	lck.unlock();
+	_wal_cv.notify_all();
+	return true;
+}
+
+/// Read the checkpoint and the log, and queue up every record that
+/// was not yet committed. A torn record at the end of the log (from
+/// a crash in the middle of an append) is discarded. Called with the
+/// WAL lock held.
+void IPFSAtomStorage::wal_replay(void)
+{
+	std::ifstream ckpt(_wal_path + ".ckpt");
+	if (ckpt.is_open())
+	{
+		ipfs::Json jck = ipfs::Json::parse(ckpt);
+		_wal_committed_seq = jck["seq"];
+
+		// Resume from the committed state.
+		reset_atomspace_cid(jck["cid"]);
+	}
+	_wal_next_seq = _wal_committed_seq + 1;
+
+	off_t good_end = 0;
+	std::ifstream in(_wal_path);
+	std::string line;
+	while (in.is_open() and std::getline(in, line))
+	{
+		if (in.eof()) break;  // No trailing newline: a torn record.
+
+		ipfs::Json rec;
+		try
+		{
+			rec = ipfs::Json::parse(line);
+		}
+		catch (const std::exception& ex)
+		{
+			break;
+		}
+		good_end += line.size() + 1;
+
+		uint64_t seq = rec["seq"];
+		if (seq < _wal_next_seq) continue;
+
+		Handle h(decodeStrAtom(rec["atom"]));
+		get_atom_values(h, rec);
+
+		// The lane is not logged; a replay is a bulk load.
+		_wal_pending.push_back({seq, h, LANE_BULK});
+		_wal_next_seq = seq + 1;
+		_wal_replayed++;
+	}
+
+	_wal_fd = open(_wal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (_wal_fd < 0)
+		throw IOException(TRACE_INFO,
+			"Unable to open write-ahead log %s: %s",
+			_wal_path.c_str(), strerror(errno));
+
+	// Cut off any torn record, so that new appends follow
+	// the last good one.
+	off_t end = lseek(_wal_fd, 0, SEEK_END);
+	if (good_end < end and ftruncate(_wal_fd, good_end))
+		throw IOException(TRACE_INFO,
+			"Unable to truncate write-ahead log %s: %s",
+			_wal_path.c_str(), strerror(errno));
+
+	if (0 < _wal_pending.size())
+		logger().info("Replaying %zu records from write-ahead log %s\n",
+		              _wal_pending.size(), _wal_path.c_str());
+}
+
+/// Make `cid` the current AtomSpace. The cached per-atom JSON and
+/// CIDs refer to some other version of the AtomSpace, so they must go.
+void IPFSAtomStorage::reset_atomspace_cid(const std::string& cid)
+{
+	std::lock_guard<std::mutex> clck(_atomspace_cid_mutex);
+	refresh_root();
+	if (0 == cid.size() or cid == _atomspace_cid) return;
+
+	set_atomspace_root(cid);
+	{
+		std::lock_guard<std::mutex> jlck(_json_mutex);
+		_json_map.clear();
+	}
+	std::lock_guard<std::mutex> alck(_atom_cid_mutex);
+	_atom_cid_map.clear();
+	invalidate_filter();
+}
+
+/// Replace the file at `path` with `text`, so that a crash leaves
+/// either the old contents or the new, and never a mix.
+void IPFSAtomStorage::write_file_atomically(const std::string& path,
+                                            const std::string& text)
+{
+	std::string tmp = path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		throw IOException(TRACE_INFO,
+			"Unable to write checkpoint %s: %s",
+			tmp.c_str(), strerror(errno));
+	bool ok = ((ssize_t) text.size() == write(fd, text.c_str(), text.size()));
+	ok = ok and (0 == fsync(fd));
+	ok = (0 == close(fd)) and ok;
+	if (not ok or rename(tmp.c_str(), path.c_str()))
+		throw IOException(TRACE_INFO,
+			"Unable to write checkpoint %s: %s",
+			tmp.c_str(), strerror(errno));
+
+	// The rename is durable only once the directory is synced.
+	std::string dir(path);
+	int dfd = open(dirname(&dir[0]), O_RDONLY | O_DIRECTORY);
+	ok = (0 <= dfd) and (0 == fsync(dfd));
+	int err = errno;
+	if (0 <= dfd) close(dfd);
+	if (not ok)
+		throw IOException(TRACE_INFO,
+			"Unable to sync the directory of checkpoint %s: %s",
+			path.c_str(), strerror(err));
+}
+
+/// Record that everything up to and including `seq` is in the
+/// AtomSpace with the given CID.
+void IPFSAtomStorage::wal_checkpoint(uint64_t seq, const std::string& cid)
+{
+	ipfs::Json jck = {{"seq", seq}, {"cid", cid}};
+	write_file_atomically(_wal_path + ".ckpt", jck.dump() + "\n");
+}
+
+/* ================================================================ */
+
+/// Push logged Atoms to IPFS, a batch at a time. A batch is committed
+/// only if every Atom in it was stored; if not, the committer stalls,
+/// keeping the records, until `flushStoreQueue()` reports the error
+/// and lets it try again.
+void IPFSAtomStorage::wal_commit_thread(IPFSAtomStorage* self)
+{
+	std::unique_lock<std::mutex> lck(self->_wal_mutex);
+	while (true)
+	{
+		self->_wal_cv.wait(lck, [self] {
+			return not self->_wal_keep_going or
+				(not self->_wal_stalled and 0 < self->_wal_pending.size()); });
+
+		if (self->_wal_stalled or 0 == self->_wal_pending.size())
+		{
+			if (not self->_wal_keep_going) break;
+			continue;
+		}
+
+		size_t n = std::min(self->_wal_pending.size(), (size_t) WAL_BATCH);
+		std::vector<std::pair<Handle, WriteLane>> batch;
+		batch.reserve(n);
+		for (size_t i = 0; i < n; i++)
+			batch.push_back({self->_wal_pending[i].atom,
+			                 self->_wal_pending[i].lane});
+		uint64_t last = self->_wal_pending[n-1].seq;
+		lck.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		bool ok = true;
+		try
+		{
+			for (const auto& pr : batch)
+				self->queue_store(pr.first, pr.second);
+			self->_write_queue.barrier();
+			self->_bulk_queue.barrier();
+			if (self->_async_write_queue_exception) ok = false;
+
+			if (ok)
+			{
+				self->wal_checkpoint(last, self->atomspace_root());
+			}
+		}
+		catch (...)
+		{
+			ok = false;
+			self->_async_write_queue_exception = std::current_exception();
+		}
+
+		lck.lock();
+		if (ok)
+		{
+			self->_wal_pending.erase(self->_wal_pending.begin(),
+			                         self->_wal_pending.begin() + n);
+			self->_wal_committed_seq = last;
+			self->_wal_batches++;
+			self->_wal_committed += n;
+			self->_wal_commit_latency.record_since(start);
+
+			// Everything is in IPFS, and checkpointed; the log
+			// can start over. Appends hold this lock, so none can
+			// be lost here.
+			if (0 == self->_wal_pending.size() and
+			    ftruncate(self->_wal_fd, 0))
+				logger().warn("Unable to truncate write-ahead log %s\n",
+				              self->_wal_path.c_str());
+		}
+		else
+		{
+			self->_wal_stalled = true;
+			self->_wal_failures++;
+		}
+		self->_wal_cv.notify_all();
+	}
+}
+
+/* ============================= END OF FILE ================= */
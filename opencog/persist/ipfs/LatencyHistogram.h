@@ -0,0 +1,142 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/LatencyHistogram.h
+ *
+ * FUNCTION:
+ * Lock-free, log-linear latency histogram.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_LATENCY_HISTOGRAM_H
+#define _OPENCOG_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * HDR-style histogram of latencies, in microseconds.
+ *
+ * Values are binned by power-of-two magnitude, and each magnitude is
+ * split into 16 linear sub-buckets, so that every bin is accurate to
+ * within about 6%. Values from one microsecond up to about 19 hours
+ * are covered; larger values land in the last bin.
+ *
+ * Recording is a handful of relaxed atomic increments, with no locks,
+ * so it can be done on every daemon call, from any thread. Reading out
+ * percentiles walks all of the bins, and is meant for reporting only.
+ */
+class LatencyHistogram
+{
+	public:
+		static const int SUB_BITS = 4;
+		static const int SUB_BUCKETS = 1 << SUB_BITS;
+		static const int MAGNITUDES = 36;
+		static const int NUM_BUCKETS = SUB_BUCKETS * (MAGNITUDES - SUB_BITS + 1);
+
+	private:
+		std::atomic<uint64_t> _counts[NUM_BUCKETS];
+		std::atomic<uint64_t> _total;
+		std::atomic<uint64_t> _sum;
+		std::atomic<uint64_t> _max;
+
+		static int bucket_of(uint64_t usec)
+		{
+			if (usec < (uint64_t) SUB_BUCKETS) return (int) usec;
+			int mag = 63 - __builtin_clzll(usec);
+			if (MAGNITUDES <= mag) return NUM_BUCKETS - 1;
+			int shift = mag - SUB_BITS;
+			int sub = (int) ((usec >> shift) & (SUB_BUCKETS - 1));
+			return (shift + 1) * SUB_BUCKETS + sub;
+		}
+
+		/// The largest value that lands in the given bucket.
+		static uint64_t bucket_top(int idx)
+		{
+			if (idx < SUB_BUCKETS) return idx;
+			int shift = idx / SUB_BUCKETS - 1;
+			uint64_t sub = idx % SUB_BUCKETS;
+			return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+		}
+
+	public:
+		LatencyHistogram(void) { reset(); }
+		LatencyHistogram(const LatencyHistogram&) = delete;
+		LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+		void reset(void)
+		{
+			for (int i = 0; i < NUM_BUCKETS; i++)
+				_counts[i].store(0, std::memory_order_relaxed);
+			_total = 0;
+			_sum = 0;
+			_max = 0;
+		}
+
+		void record(uint64_t usec)
+		{
+			_counts[bucket_of(usec)].fetch_add(1, std::memory_order_relaxed);
+			_total.fetch_add(1, std::memory_order_relaxed);
+			_sum.fetch_add(usec, std::memory_order_relaxed);
+			uint64_t prev = _max.load(std::memory_order_relaxed);
+			while (prev < usec and
+			       not _max.compare_exchange_weak(prev, usec,
+			                                      std::memory_order_relaxed))
+				;
+		}
+
+		/// Record the time elapsed since `start`.
+		void record_since(std::chrono::steady_clock::time_point start)
+		{
+			record(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start).count());
+		}
+
+		uint64_t count(void) const { return _total.load(); }
+		uint64_t sum(void) const { return _sum.load(); }
+		uint64_t max(void) const { return _max.load(); }
+		double mean(void) const
+		{
+			uint64_t n = _total.load();
+			return (0 == n) ? 0.0 : ((double) _sum.load()) / n;
+		}
+
+		/// Return the latency (in usecs) below which the fraction `q`
+		/// of all recorded values fall; `q` is in the range [0,1].
+		uint64_t percentile(double q) const
+		{
+			uint64_t n = _total.load();
+			if (0 == n) return 0;
+			uint64_t want = (uint64_t) (q * n);
+			if (n <= want) want = n - 1;
+
+			uint64_t seen = 0;
+			for (int i = 0; i < NUM_BUCKETS; i++)
+			{
+				seen += _counts[i].load(std::memory_order_relaxed);
+				if (want < seen)
+				{
+					uint64_t top = bucket_top(i);
+					uint64_t mx = _max.load();
+					return (top < mx) ? top : mx;
+				}
+			}
+			return _max.load();
+		}
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_LATENCY_HISTOGRAM_H
@@ -0,0 +1,150 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/MembershipFilter.h
+ *
+ * FUNCTION:
+ * Counting Bloom filter, over the names in the AtomSpace directory.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_MEMBERSHIP_FILTER_H
+#define _OPENCOG_MEMBERSHIP_FILTER_H
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/**
+ * Counting Bloom filter of strings. If `maybe_contains()` returns
+ * false, the string was definitely never added (or has since been
+ * removed); if it returns true, the string is probably present.
+ *
+ * Each slot is an eight-bit counter, so that strings can be removed
+ * as well as added. A counter that reaches 255 sticks there, and is
+ * never decremented; this can only cause false positives, never false
+ * negatives.
+ *
+ * The filter is sized for a given number of strings, and a target
+ * false-positive rate. It keeps working when over-full, but the
+ * false-positive rate climbs; `false_positive_rate()` estimates it,
+ * from the current fill. Not thread-safe; callers must lock.
+ */
+class MembershipFilter
+{
+	private:
+		static const uint8_t MAX_COUNT = 255;
+
+		std::vector<uint8_t> _counters;
+		size_t _num_hashes;
+		size_t _capacity;
+		size_t _count;
+
+		/// Two independent 64-bit hashes: FNV-1a, and a splitmix64
+		/// finalization of it. Probes are h1 + i*h2 (double hashing).
+		static void hash2(const std::string& key, uint64_t& h1, uint64_t& h2)
+		{
+			uint64_t h = 0xcbf29ce484222325ULL;
+			for (unsigned char c : key)
+			{
+				h ^= c;
+				h *= 0x100000001b3ULL;
+			}
+			h1 = h;
+
+			h += 0x9e3779b97f4a7c15ULL;
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+			h2 = (h ^ (h >> 31)) | 1;
+		}
+
+	public:
+		MembershipFilter(void) : _num_hashes(0), _capacity(0), _count(0) {}
+
+		/// Empty the filter, and size it for `capacity` strings at the
+		/// given false-positive rate.
+		void reset(size_t capacity, double fp_rate = 0.01)
+		{
+			if (capacity < 1) capacity = 1;
+			double ln2 = std::log(2.0);
+			size_t m = (size_t) std::ceil(
+				-((double) capacity) * std::log(fp_rate) / (ln2 * ln2));
+			if (m < 64) m = 64;
+			_num_hashes = (size_t) std::round(((double) m) / capacity * ln2);
+			if (_num_hashes < 1) _num_hashes = 1;
+
+			_counters.assign(m, 0);
+			_capacity = capacity;
+			_count = 0;
+		}
+
+		void add(const std::string& key)
+		{
+			uint64_t h1, h2;
+			hash2(key, h1, h2);
+			size_t m = _counters.size();
+			for (size_t i = 0; i < _num_hashes; i++)
+			{
+				uint8_t& c = _counters[(h1 + i * h2) % m];
+				if (c < MAX_COUNT) c++;
+			}
+			_count++;
+		}
+
+		/// Remove a string. It must have been added; removing a string
+		/// that never was can cause false negatives.
+		void remove(const std::string& key)
+		{
+			uint64_t h1, h2;
+			hash2(key, h1, h2);
+			size_t m = _counters.size();
+			for (size_t i = 0; i < _num_hashes; i++)
+			{
+				uint8_t& c = _counters[(h1 + i * h2) % m];
+				if (0 < c and c < MAX_COUNT) c--;
+			}
+			if (0 < _count) _count--;
+		}
+
+		bool maybe_contains(const std::string& key) const
+		{
+			if (0 == _counters.size()) return true;
+			uint64_t h1, h2;
+			hash2(key, h1, h2);
+			size_t m = _counters.size();
+			for (size_t i = 0; i < _num_hashes; i++)
+				if (0 == _counters[(h1 + i * h2) % m]) return false;
+			return true;
+		}
+
+		size_t size(void) const { return _count; }
+		size_t capacity(void) const { return _capacity; }
+		size_t num_hashes(void) const { return _num_hashes; }
+		size_t memory_bytes(void) const { return _counters.size(); }
+
+		/// The expected false-positive rate, at the current fill:
+		/// (1 - e^(-kn/m))^k
+		double false_positive_rate(void) const
+		{
+			if (0 == _counters.size()) return 1.0;
+			double k = _num_hashes;
+			double fill = 1.0 - std::exp(-k * _count / _counters.size());
+			return std::pow(fill, k);
+		}
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_MEMBERSHIP_FILTER_H
@@ -0,0 +1,742 @@
+/*
+ * MockIPFSDaemon.cc
+ * In-process stand-in for the IPFS daemon HTTP API.
+ *
+ * Just enough of HTTP/1.1 and of the IPFS `/api/v0` endpoints to keep
+ * the AtomSpace driver happy. Each connection gets its own thread;
+ * connections are kept alive, the way libcurl likes them.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <opencog/persist/ipfs/IPFSHash.h>
+
+#include "MockIPFSDaemon.h"
+
+using namespace opencog;
+
+/* ================================================================ */
+// Content addressing. SHA-256, and base58 encoding of the resulting
+// multihash, so that the CID's look like CIDv0. The same code spells
+// out the CIDs in the storage driver; see IPFSHash.h
+
+/// Return a CIDv0-style string: base58 of the sha2-256 multihash.
+static std::string make_cid(const std::string& content)
+{
+	uint8_t mh[34];
+	mh[0] = 0x12;  // sha2-256
+	mh[1] = 0x20;  // 32 bytes long
+	IPFSHash::sha256(content, &mh[2]);
+	return IPFSHash::base58(mh, sizeof(mh));
+}
+
+/* ================================================================ */
+// HTTP utilities.
+
+static std::string url_decode(const std::string& s)
+{
+	std::string out;
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		if ('+' == s[i]) out.push_back(' ');
+		else if ('%' == s[i] and i+2 < s.size())
+		{
+			out.push_back((char) std::stoi(s.substr(i+1, 2), nullptr, 16));
+			i += 2;
+		}
+		else out.push_back(s[i]);
+	}
+	return out;
+}
+
+static std::string to_lower(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+	return s;
+}
+
+/// Read from the socket until the buffer holds at least `need` bytes.
+static bool fill(int fd, std::string& buf, size_t need)
+{
+	char tmp[16384];
+	while (buf.size() < need)
+	{
+		ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+		if (n <= 0) return false;
+		buf.append(tmp, n);
+	}
+	return true;
+}
+
+/// Read from the socket until the buffer contains `delim`.
+static size_t fill_until(int fd, std::string& buf, const char* delim,
+                         size_t from = 0)
+{
+	char tmp[16384];
+	while (true)
+	{
+		size_t pos = buf.find(delim, from);
+		if (std::string::npos != pos) return pos;
+		ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+		if (n <= 0) return std::string::npos;
+		buf.append(tmp, n);
+	}
+}
+
+static bool send_all(int fd, const std::string& msg)
+{
+	size_t off = 0;
+	while (off < msg.size())
+	{
+		ssize_t n = send(fd, msg.data() + off, msg.size() - off, MSG_NOSIGNAL);
+		if (n <= 0) return false;
+		off += n;
+	}
+	return true;
+}
+
+/// Pull the content of the first part out of a multipart/form-data
+/// body. If the body is not multipart, return it unchanged.
+static std::string first_part(const std::string& content_type,
+                              const std::string& body)
+{
+	size_t bpos = content_type.find("boundary=");
+	if (std::string::npos == bpos) return body;
+
+	std::string boundary = content_type.substr(bpos + sizeof("boundary=") - 1);
+	if (0 < boundary.size() and '"' == boundary[0])
+		boundary = boundary.substr(1, boundary.find('"', 1) - 1);
+	boundary = "--" + boundary;
+
+	size_t start = body.find(boundary);
+	if (std::string::npos == start) return body;
+	start = body.find("\r\n\r\n", start);
+	if (std::string::npos == start) return body;
+	start += 4;
+	size_t end = body.find("\r\n" + boundary, start);
+	if (std::string::npos == end) end = body.size();
+	return body.substr(start, end - start);
+}
+
+/* ================================================================ */
+// Constructors
+
+MockIPFSDaemon::MockIPFSDaemon(const MockIPFSConfig& cfg) :
+	_config(cfg), _port(cfg.port), _listen_fd(-1), _running(false), _next_conn(0),
+	_rng(cfg.seed)
+{
+	_num_requests = 0;
+	_num_failures = 0;
+	_bytes_in = 0;
+	_bytes_out = 0;
+
+	// Every daemon has a "self" key.
+	_keys["self"] = make_key_id("self");
+}
+
+MockIPFSDaemon::~MockIPFSDaemon()
+{
+	stop();
+}
+
+void MockIPFSDaemon::start(void)
+{
+	if (_running) return;
+
+	_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (_listen_fd < 0)
+		throw std::runtime_error("mock-ipfsd: cannot create socket");
+
+	int one = 1;
+	setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(_config.port);
+	if (bind(_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 or
+	    listen(_listen_fd, 128) < 0)
+	{
+		close(_listen_fd);
+		_listen_fd = -1;
+		throw std::runtime_error("mock-ipfsd: cannot bind to port " +
+		                         std::to_string(_config.port));
+	}
+
+	socklen_t alen = sizeof(addr);
+	getsockname(_listen_fd, (struct sockaddr*) &addr, &alen);
+	_port = ntohs(addr.sin_port);
+
+	_running = true;
+	_acceptor = std::thread(&MockIPFSDaemon::accept_loop, this);
+}
+
+void MockIPFSDaemon::stop(void)
+{
+	if (not _running) return;
+	_running = false;
+
+	// Unblock accept() and all of the recv()'s.
+	shutdown(_listen_fd, SHUT_RDWR);
+	close(_listen_fd);
+	_acceptor.join();
+	_listen_fd = -1;
+
+	std::unordered_map<size_t, std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lck(_conn_mutex);
+		for (int fd : _conn_fds) shutdown(fd, SHUT_RDWR);
+		threads.swap(_conn_threads);
+		_conn_done.clear();
+	}
+	for (auto& pr : threads) pr.second.join();
+}
+
+size_t MockIPFSDaemon::get_num_blocks(void)
+{
+	std::lock_guard<std::mutex> lck(_store_mutex);
+	return _dag_blocks.size() + _pb_blocks.size();
+}
+
+void MockIPFSDaemon::set_latency(unsigned int latency_usec,
+                                 unsigned int jitter_usec)
+{
+	std::lock_guard<std::mutex> lck(_rng_mutex);
+	_config.latency_usec = latency_usec;
+	_config.jitter_usec = jitter_usec;
+}
+
+void MockIPFSDaemon::set_failure_rate(double rate)
+{
+	std::lock_guard<std::mutex> lck(_rng_mutex);
+	_config.failure_rate = rate;
+}
+
+/* ================================================================ */
+// Connection handling
+
+void MockIPFSDaemon::accept_loop(void)
+{
+	while (_running)
+	{
+		int fd = accept(_listen_fd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (_running) continue;
+			break;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		std::lock_guard<std::mutex> lck(_conn_mutex);
+		reap_connections();
+		size_t id = _next_conn++;
+		_conn_fds.push_back(fd);
+		_conn_threads.emplace(id,
+			std::thread(&MockIPFSDaemon::serve, this, fd, id));
+	}
+}
+
+/// Join the threads of the connections that have closed, so that a
+/// long-running daemon does not pile them up. Called with the
+/// connection lock held; the threads are past their last use of it.
+void MockIPFSDaemon::reap_connections(void)
+{
+	for (size_t id : _conn_done)
+	{
+		auto it = _conn_threads.find(id);
+		if (_conn_threads.end() == it) continue;
+		it->second.join();
+		_conn_threads.erase(it);
+	}
+	_conn_done.clear();
+}
+
+/// Serve HTTP requests on one connection, until the client hangs up.
+void MockIPFSDaemon::serve(int fd, size_t id)
+{
+	std::string buf;
+	while (_running)
+	{
+		size_t hend = fill_until(fd, buf, "\r\n\r\n");
+		if (std::string::npos == hend) break;
+
+		std::string head = buf.substr(0, hend);
+		buf.erase(0, hend + 4);
+
+		// Request line
+		size_t eol = head.find("\r\n");
+		std::string reqline = head.substr(0, eol);
+		size_t sp1 = reqline.find(' ');
+		size_t sp2 = reqline.find(' ', sp1 + 1);
+		if (std::string::npos == sp1 or std::string::npos == sp2) break;
+		std::string target = reqline.substr(sp1 + 1, sp2 - sp1 - 1);
+
+		// Headers
+		std::map<std::string, std::string> headers;
+		size_t pos = (std::string::npos == eol) ? head.size() : eol + 2;
+		while (pos < head.size())
+		{
+			size_t end = head.find("\r\n", pos);
+			if (std::string::npos == end) end = head.size();
+			std::string line = head.substr(pos, end - pos);
+			size_t colon = line.find(':');
+			if (std::string::npos != colon)
+			{
+				std::string val = line.substr(colon + 1);
+				val.erase(0, val.find_first_not_of(" \t"));
+				headers[to_lower(line.substr(0, colon))] = val;
+			}
+			pos = end + 2;
+		}
+
+		if (to_lower(headers["expect"]) == "100-continue")
+			send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n");
+
+		// Body. A length that isn't a number leaves no way to find
+		// the next request, so the connection is closed.
+		std::string body;
+		bool have_body = true;
+		try
+		{
+			if (to_lower(headers["transfer-encoding"]) == "chunked")
+			{
+				while (have_body)
+				{
+					size_t lend = fill_until(fd, buf, "\r\n");
+					if (std::string::npos == lend) { have_body = false; break; }
+					size_t chunk = std::stoul(buf.substr(0, lend), nullptr, 16);
+					buf.erase(0, lend + 2);
+					if (not fill(fd, buf, chunk + 2)) { have_body = false; break; }
+					body.append(buf, 0, chunk);
+					buf.erase(0, chunk + 2);
+					if (0 == chunk) break;
+				}
+			}
+			else if (headers.count("content-length"))
+			{
+				size_t clen = std::stoul(headers["content-length"]);
+				have_body = fill(fd, buf, clen);
+				if (have_body)
+				{
+					body = buf.substr(0, clen);
+					buf.erase(0, clen);
+				}
+			}
+		}
+		catch (const std::exception& ex)
+		{
+			std::string reply = Json({{"Message",
+				std::string("mock-ipfsd: bad length: ") + ex.what()},
+				{"Code", 0}, {"Type", "error"}}).dump();
+			std::string resp = "HTTP/1.1 400 Bad Request"
+				"\r\nContent-Type: application/json"
+				"\r\nContent-Length: " + std::to_string(reply.size()) +
+				"\r\nConnection: close\r\n\r\n" + reply;
+			_num_requests++;
+			_bytes_out += resp.size();
+			send_all(fd, resp);
+			break;
+		}
+		if (not have_body) break;
+		_bytes_in += head.size() + body.size();
+
+		// Query string
+		std::string path = target;
+		std::multimap<std::string, std::string> params;
+		size_t qpos = target.find('?');
+		if (std::string::npos != qpos)
+		{
+			path = target.substr(0, qpos);
+			std::string query = target.substr(qpos + 1);
+			size_t start = 0;
+			while (start <= query.size())
+			{
+				size_t amp = query.find('&', start);
+				if (std::string::npos == amp) amp = query.size();
+				std::string kv = query.substr(start, amp - start);
+				size_t eq = kv.find('=');
+				if (std::string::npos != eq)
+					params.insert({url_decode(kv.substr(0, eq)),
+					               url_decode(kv.substr(eq + 1))});
+				else if (0 < kv.size())
+					params.insert({url_decode(kv), ""});
+				start = amp + 1;
+			}
+		}
+
+		int status = 200;
+		std::string reply;
+		if (inject(path))
+		{
+			status = 500;
+			reply = Json({{"Message", "mock-ipfsd: injected failure"},
+			              {"Code", 0}, {"Type", "error"}}).dump();
+			_num_failures++;
+		}
+		else
+		{
+			try
+			{
+				reply = dispatch(path, params,
+				                 first_part(headers["content-type"], body),
+				                 status);
+			}
+			catch (const std::exception& ex)
+			{
+				status = 500;
+				reply = Json({{"Message", ex.what()},
+				              {"Code", 0}, {"Type", "error"}}).dump();
+			}
+		}
+		_num_requests++;
+
+		bool keep_alive = to_lower(headers["connection"]) != "close";
+		std::string resp = "HTTP/1.1 " + std::to_string(status) +
+			(200 == status ? " OK" : (404 == status ?
+			                 " Not Found" : " Internal Server Error")) +
+			"\r\nContent-Type: application/json" +
+			"\r\nContent-Length: " + std::to_string(reply.size()) +
+			(keep_alive ? "" : "\r\nConnection: close") +
+			"\r\n\r\n" + reply;
+		_bytes_out += resp.size();
+		if (not send_all(fd, resp) or not keep_alive) break;
+	}
+
+	std::lock_guard<std::mutex> lck(_conn_mutex);
+	_conn_fds.erase(std::remove(_conn_fds.begin(), _conn_fds.end(), fd),
+	                _conn_fds.end());
+	close(fd);
+	_conn_done.push_back(id);
+}
+
+/// Sleep for the configured latency, and then decide whether this
+/// request should fail. Returns true if it should.
+bool MockIPFSDaemon::inject(const std::string& path)
+{
+	unsigned int usec;
+	bool fail;
+	{
+		std::lock_guard<std::mutex> lck(_rng_mutex);
+		usec = _config.latency_usec;
+		if (0 < _config.jitter_usec)
+			usec += std::uniform_int_distribution<unsigned int>(
+				0, _config.jitter_usec)(_rng);
+		if (std::string::npos != path.find("/name/"))
+			usec += _config.ipns_latency_usec;
+		fail = (0.0 < _config.failure_rate) and
+			std::uniform_real_distribution<double>(0.0, 1.0)(_rng) <
+				_config.failure_rate;
+	}
+	if (0 < usec)
+		std::this_thread::sleep_for(std::chrono::microseconds(usec));
+	return fail;
+}
+
+/* ================================================================ */
+// Block store
+
+std::string MockIPFSDaemon::put_dag(const Json& node)
+{
+	std::string cid = make_cid("dag:" + node.dump());
+	std::lock_guard<std::mutex> lck(_store_mutex);
+	_dag_blocks[cid] = node;
+	return cid;
+}
+
+/// Protobuf nodes are kept as {"Data": string, "Links": [...]},
+/// with links sorted by name, as the real daemon does.
+std::string MockIPFSDaemon::put_pb(const Json& node)
+{
+	Json pb = node;
+	if (not pb.contains("Links") or pb["Links"].is_null())
+		pb["Links"] = Json::array();
+	if (not pb.contains("Data")) pb["Data"] = "";
+	std::stable_sort(pb["Links"].begin(), pb["Links"].end(),
+		[](const Json& a, const Json& b) {
+			return a["Name"].get<std::string>() < b["Name"].get<std::string>(); });
+
+	std::string cid = make_cid("pb:" + pb.dump());
+	std::lock_guard<std::mutex> lck(_store_mutex);
+	_pb_blocks[cid] = pb;
+	return cid;
+}
+
+/// Render a protobuf node the way `dag get` does.
+MockIPFSDaemon::Json MockIPFSDaemon::pb_to_dag(const Json& pb) const
+{
+	Json links = Json::array();
+	for (const Json& lnk : pb["Links"])
+		links.push_back({{"Cid", {{"/", lnk["Hash"]}}},
+		                 {"Name", lnk["Name"]}, {"Size", lnk["Size"]}});
+	return {{"data", pb["Data"]}, {"links", links}};
+}
+
+/// Render a protobuf node the way `object get` does.
+MockIPFSDaemon::Json MockIPFSDaemon::pb_to_object(const Json& pb) const
+{
+	return {{"Data", pb["Data"]}, {"Links", pb["Links"]}};
+}
+
+/// Resolve an IPFS path: a CID, optionally followed by slash-separated
+/// link names (for protobuf nodes) or field names (for json nodes).
+/// Link names may themselves contain slashes (Atom names can), so the
+/// longest matching link name wins.
+bool MockIPFSDaemon::resolve(const std::string& ipath, Json& out)
+{
+	std::string path = ipath;
+	if (0 == path.compare(0, 6, "/ipfs/")) path = path.substr(6);
+	while (0 < path.size() and '/' == path.back()) path.pop_back();
+
+	size_t slash = path.find('/');
+	std::string cid = path.substr(0, slash);
+	std::string rest = (std::string::npos == slash) ? "" : path.substr(slash + 1);
+
+	std::lock_guard<std::mutex> lck(_store_mutex);
+	while (true)
+	{
+		auto pit = _pb_blocks.find(cid);
+		auto dit = _dag_blocks.find(cid);
+		if (_pb_blocks.end() == pit and _dag_blocks.end() == dit)
+			return false;
+
+		if (0 == rest.size())
+		{
+			out = (_pb_blocks.end() != pit) ? pb_to_dag(pit->second) : dit->second;
+			return true;
+		}
+
+		if (_pb_blocks.end() != pit)
+		{
+			// Find the longest link name that is a prefix of the rest.
+			const Json* best = nullptr;
+			size_t best_len = 0;
+			for (const Json& lnk : pit->second["Links"])
+			{
+				const std::string& name = lnk["Name"].get_ref<const std::string&>();
+				if (name.size() < best_len or name.size() > rest.size()) continue;
+				if (rest.compare(0, name.size(), name)) continue;
+				if (name.size() < rest.size() and '/' != rest[name.size()]) continue;
+				best = &lnk;
+				best_len = name.size();
+			}
+			if (nullptr == best) return false;
+			cid = (*best)["Hash"];
+			rest = (best_len < rest.size()) ? rest.substr(best_len + 1) : "";
+			continue;
+		}
+
+		// Walk down into the json, following IPLD links.
+		Json node = dit->second;
+		while (0 < rest.size())
+		{
+			size_t sl = rest.find('/');
+			std::string field = rest.substr(0, sl);
+			rest = (std::string::npos == sl) ? "" : rest.substr(sl + 1);
+
+			if (node.is_array())
+			{
+				size_t idx = std::stoul(field);
+				if (node.size() <= idx) return false;
+				node = node[idx];
+			}
+			else if (node.is_object() and node.contains(field))
+				node = node[field];
+			else
+				return false;
+
+			if (node.is_object() and 1 == node.size() and node.contains("/"))
+				break;
+		}
+		if (node.is_object() and 1 == node.size() and node.contains("/"))
+		{
+			cid = node["/"];
+			continue;
+		}
+		out = node;
+		return true;
+	}
+}
+
+std::string MockIPFSDaemon::make_key_id(const std::string& name)
+{
+	return make_cid("key:" + name);
+}
+
+/* ================================================================ */
+// The API endpoints.
+
+static const std::string& get_arg(
+	const std::multimap<std::string, std::string>& params,
+	const std::string& key, size_t n = 0)
+{
+	auto range = params.equal_range(key);
+	for (auto it = range.first; it != range.second; it++, n--)
+		if (0 == n) return it->second;
+	throw std::runtime_error("argument \"" + key + "\" is required");
+}
+
+std::string MockIPFSDaemon::dispatch(
+	const std::string& path,
+	const std::multimap<std::string, std::string>& params,
+	const std::string& body,
+	int& status)
+{
+	static const std::string api = "/api/v0/";
+	if (path.compare(0, api.size(), api))
+	{
+		status = 404;
+		return "404 page not found";
+	}
+	std::string cmd = path.substr(api.size());
+
+	if ("dag/put" == cmd)
+	{
+		std::string cid = put_dag(Json::parse(body));
+		return Json({{"Cid", {{"/", cid}}}}).dump();
+	}
+
+	if ("dag/get" == cmd)
+	{
+		Json node;
+		if (not resolve(get_arg(params, "arg"), node))
+			throw std::runtime_error("merkledag: not found");
+		return node.dump();
+	}
+
+	if ("add" == cmd)
+	{
+		// Each file becomes a protobuf leaf node. Only one file per
+		// request is supported; that's all the driver ever sends.
+		std::string cid = put_pb({{"Data", body}});
+		return Json({{"Name", cid}, {"Hash", cid},
+		             {"Size", std::to_string(body.size())}}).dump() + "\n";
+	}
+
+	if ("object/get" == cmd)
+	{
+		std::string cid = get_arg(params, "arg");
+		std::lock_guard<std::mutex> lck(_store_mutex);
+		auto pit = _pb_blocks.find(cid);
+		if (_pb_blocks.end() == pit)
+			throw std::runtime_error("merkledag: not found");
+		return pb_to_object(pit->second).dump();
+	}
+
+	if ("object/put" == cmd)
+	{
+		Json obj = Json::parse(body);
+		std::string cid = put_pb(obj);
+		return Json({{"Hash", cid}, {"Links", obj["Links"]}}).dump();
+	}
+
+	if ("object/patch/add-link" == cmd or "object/patch/rm-link" == cmd)
+	{
+		std::string root = get_arg(params, "arg", 0);
+		std::string name = get_arg(params, "arg", 1);
+		Json pb;
+		{
+			std::lock_guard<std::mutex> lck(_store_mutex);
+			auto pit = _pb_blocks.find(root);
+			if (_pb_blocks.end() == pit)
+				throw std::runtime_error("merkledag: not found");
+			pb = pit->second;
+		}
+
+		Json links = Json::array();
+		bool found = false;
+		for (const Json& lnk : pb["Links"])
+		{
+			if (lnk["Name"] == name) found = true;
+			else links.push_back(lnk);
+		}
+
+		if ("object/patch/rm-link" == cmd)
+		{
+			if (not found) throw std::runtime_error("no link by that name");
+		}
+		else
+		{
+			std::string ref = get_arg(params, "arg", 2);
+			size_t size = 0;
+			{
+				std::lock_guard<std::mutex> lck(_store_mutex);
+				auto dit = _dag_blocks.find(ref);
+				auto pit = _pb_blocks.find(ref);
+				if (_dag_blocks.end() != dit) size = dit->second.dump().size();
+				else if (_pb_blocks.end() != pit) size = pit->second.dump().size();
+				else throw std::runtime_error("merkledag: not found");
+			}
+			links.push_back({{"Name", name}, {"Hash", ref}, {"Size", size}});
+		}
+		pb["Links"] = links;
+		std::string cid = put_pb(pb);
+		return Json({{"Hash", cid}, {"Links", nullptr}}).dump();
+	}
+
+	if ("key/list" == cmd)
+	{
+		Json keys = Json::array();
+		std::lock_guard<std::mutex> lck(_store_mutex);
+		for (const auto& kv : _keys)
+			keys.push_back({{"Name", kv.first}, {"Id", kv.second}});
+		return Json({{"Keys", keys}}).dump();
+	}
+
+	if ("key/gen" == cmd)
+	{
+		std::string name = get_arg(params, "arg");
+		std::lock_guard<std::mutex> lck(_store_mutex);
+		if (_keys.count(name))
+			throw std::runtime_error("key with name '" + name + "' already exists");
+		std::string id = make_key_id(name);
+		_keys[name] = id;
+		return Json({{"Name", name}, {"Id", id}}).dump();
+	}
+
+	if ("name/publish" == cmd)
+	{
+		std::string value = get_arg(params, "arg");
+		if (0 != value.compare(0, 6, "/ipfs/")) value = "/ipfs/" + value;
+		std::string key = "self";
+		if (params.count("key")) key = get_arg(params, "key");
+
+		std::lock_guard<std::mutex> lck(_store_mutex);
+		auto kit = _keys.find(key);
+		if (_keys.end() == kit)
+			throw std::runtime_error("no key by the given name was found");
+		_names[kit->second] = value;
+		return Json({{"Name", kit->second}, {"Value", value}}).dump();
+	}
+
+	if ("name/resolve" == cmd)
+	{
+		std::string name = get_arg(params, "arg");
+		if (0 == name.compare(0, 6, "/ipns/")) name = name.substr(6);
+
+		std::lock_guard<std::mutex> lck(_store_mutex);
+		auto nit = _names.find(name);
+		if (_names.end() == nit)
+			throw std::runtime_error("could not resolve name");
+		return Json({{"Path", nit->second}}).dump();
+	}
+
+	status = 404;
+	return "404 page not found";
+}
+
+/* ============================= END OF FILE ================= */
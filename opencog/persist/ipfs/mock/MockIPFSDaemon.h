@@ -0,0 +1,139 @@
+/*
+ * FILE:
+ * opencog/persist/ipfs/mock/MockIPFSDaemon.h
+ *
+ * FUNCTION:
+ * In-process stand-in for the IPFS daemon HTTP API.
+ *
+ * HISTORY:
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ *
+ * LICENSE:
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#ifndef _OPENCOG_MOCK_IPFS_DAEMON_H
+#define _OPENCOG_MOCK_IPFS_DAEMON_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace opencog
+{
+/** \addtogroup grp_persist
+ *  @{
+ */
+
+/// Knobs for the mock daemon. All latencies are in microseconds.
+/// The injected latency is applied to every request; the IPNS latency
+/// is added on top of that, for `name/publish` and `name/resolve`
+/// only, so that the slowness of the real IPNS can be emulated.
+struct MockIPFSConfig
+{
+	int port = 0;                    // Zero means "pick a free port".
+	unsigned int latency_usec = 0;   // Fixed per-request latency.
+	unsigned int jitter_usec = 0;    // Uniform random extra latency.
+	unsigned int ipns_latency_usec = 0;
+	double failure_rate = 0.0;       // Fraction of requests that fail.
+	unsigned int seed = 42;          // RNG seed, for repeatable runs.
+};
+
+/**
+ * A lightweight, in-memory, single-process stand-in for the IPFS
+ * daemon HTTP API. It implements just those endpoints that the
+ * AtomSpace driver uses:
+ *
+ *    add, dag/get, dag/put, object/get, object/put,
+ *    object/patch/add-link, object/patch/rm-link,
+ *    key/list, key/gen, name/publish, name/resolve
+ *
+ * Blocks are content-addressed with SHA-256, and are handed out as
+ * CIDv0-style base58 strings, so that identical content always gets
+ * the same CID, just as with the real thing. Nothing is persisted;
+ * all content vanishes when the daemon is stopped.
+ *
+ * This is meant for unit tests and benchmarks, so that they can run
+ * without a real `ipfs daemon`, and without its IPNS delays. Latency
+ * and failures can be injected, to make throughput and tail-latency
+ * experiments repeatable.
+ */
+class MockIPFSDaemon
+{
+	private:
+		typedef nlohmann::json Json;
+
+		MockIPFSConfig _config;
+		int _port;
+		int _listen_fd;
+		std::atomic<bool> _running;
+		std::thread _acceptor;
+
+		// Each connection is served by a thread of its own. Threads
+		// whose client has hung up are joined when the next
+		// connection is accepted.
+		std::mutex _conn_mutex;
+		size_t _next_conn;
+		std::unordered_map<size_t, std::thread> _conn_threads;
+		std::vector<size_t> _conn_done;
+		std::vector<int> _conn_fds;
+		void reap_connections(void);
+
+		std::mutex _rng_mutex;
+		std::mt19937 _rng;
+
+		// The block store. Protobuf (unixfs) objects are kept
+		// separately from the IPLD (json) objects, as they are
+		// rendered differently.
+		std::mutex _store_mutex;
+		std::unordered_map<std::string, Json> _dag_blocks;
+		std::unordered_map<std::string, Json> _pb_blocks;
+		std::map<std::string, std::string> _keys;   // name -> id
+		std::map<std::string, std::string> _names;  // id -> /ipfs/cid
+
+		void accept_loop(void);
+		void serve(int, size_t);
+		bool inject(const std::string&);
+
+		std::string put_dag(const Json&);
+		std::string put_pb(const Json&);
+		Json pb_to_dag(const Json&) const;
+		Json pb_to_object(const Json&) const;
+		bool resolve(const std::string&, Json&);
+		std::string make_key_id(const std::string&);
+
+		std::string dispatch(const std::string&,
+		                     const std::multimap<std::string, std::string>&,
+		                     const std::string&, int&);
+
+	public:
+		std::atomic<size_t> _num_requests;
+		std::atomic<size_t> _num_failures;
+		std::atomic<size_t> _bytes_in;
+		std::atomic<size_t> _bytes_out;
+
+		MockIPFSDaemon(const MockIPFSConfig& = MockIPFSConfig());
+		MockIPFSDaemon(const MockIPFSDaemon&) = delete;
+		MockIPFSDaemon& operator=(const MockIPFSDaemon&) = delete;
+		~MockIPFSDaemon();
+
+		void start(void);
+		void stop(void);
+		int get_port(void) const { return _port; }
+		size_t get_num_blocks(void);
+
+		void set_latency(unsigned int latency_usec, unsigned int jitter_usec);
+		void set_failure_rate(double);
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_MOCK_IPFS_DAEMON_H
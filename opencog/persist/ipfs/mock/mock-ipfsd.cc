@@ -0,0 +1,73 @@
+/*
+ * mock-ipfsd.cc
+ * Run the mock IPFS daemon as a stand-alone process.
+ *
+ * Usage:
+ *    mock-ipfsd [-p port] [-l latency-usec] [-j jitter-usec]
+ *               [-n ipns-latency-usec] [-f failure-rate] [-s seed]
+ *
+ * The default port is 5001, the same as the real `ipfs daemon`, so
+ * that the unit tests and examples can be pointed at it unchanged.
+ * Stop it with control-C; it prints request counts on the way out.
+ *
+ * Copyright (c) 2019 Linas Vepstas <linasvepstas@gmail.com>
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "MockIPFSDaemon.h"
+
+using namespace opencog;
+
+static volatile sig_atomic_t keep_going = 1;
+
+static void on_signal(int)
+{
+	keep_going = 0;
+}
+
+int main(int argc, char* argv[])
+{
+	MockIPFSConfig cfg;
+	cfg.port = 5001;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "p:l:j:n:f:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': cfg.port = atoi(optarg); break;
+			case 'l': cfg.latency_usec = atoi(optarg); break;
+			case 'j': cfg.jitter_usec = atoi(optarg); break;
+			case 'n': cfg.ipns_latency_usec = atoi(optarg); break;
+			case 'f': cfg.failure_rate = atof(optarg); break;
+			case 's': cfg.seed = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-l latency-usec] "
+				        "[-j jitter-usec] [-n ipns-latency-usec] "
+				        "[-f failure-rate] [-s seed]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	MockIPFSDaemon daemon(cfg);
+	daemon.start();
+	printf("mock-ipfsd: API server listening on /ip4/127.0.0.1/tcp/%d\n",
+	       daemon.get_port());
+	fflush(stdout);
+
+	while (keep_going) pause();
+
+	daemon.stop();
+	printf("mock-ipfsd: served %zu requests, %zu injected failures, "
+	       "%zu blocks\n", (size_t) daemon._num_requests,
+	       (size_t) daemon._num_failures, daemon.get_num_blocks());
+	return 0;
+}
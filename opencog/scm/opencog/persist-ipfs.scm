@@ -12,9 +12,15 @@
 	"opencog_persist_ipfs_init")
 
 (export ipfs-clear-stats ipfs-close ipfs-open ipfs-stats
-	ipfs-atom-cid ipfs-fetch-atom ipfs-load-atomspace
+	ipfs-atom-cid ipfs-fetch-atom ipfs-fetch-atoms ipfs-load-atomspace
+	ipfs-bulk-load ipfs-bulk-store ipfs-bulk-status ipfs-bulk-cancel
+	ipfs-bulk-wait
 	ipfs-atomspace-cid ipns-atomspace-cid
-	ipfs-publish-atomspace ipfs-resolve-atomspace)
+	ipfs-publish-atomspace ipfs-resolve-atomspace
+	ipfs-publish-options ipfs-stats-json ipfs-stats-prometheus
+	ipfs-trace-start ipfs-trace-stop ipfs-trace-dump
+	ipfs-open-wal ipfs-close-wal ipfs-set-write-lane
+	ipfs-open-checkpoint ipfs-close-checkpoint)
 
 (set-procedure-property! ipfs-clear-stats 'documentation
 "
@@ -40,14 +46,47 @@
      ipfs:///KEY-NAME
      ipfs://HOSTNAME/KEY-NAME
      ipfs://HOSTNAME:PORT/KEY-NAME
+     ipfs://HOST1:PORT1,HOST2:PORT2,.../KEY-NAME
 
   If no hostname is specified, its assumed to be 'localhost'. If no port
   is specified, its assumed to be 5001.
 
+  Naming several daemons splits the AtomSpace across all of them: each
+  Atom goes to one of them, picked by hashing its name, and each daemon
+  keeps the directory of its own Atoms, so that stores to different
+  daemons run in parallel. The first daemon named holds the top-level
+  directory and the IPNS key. Later opens must name the same number of
+  daemons, in the same order. A bulk load reads every shard in turn, so
+  it also works through any daemon that can reach all of their blocks.
+
+  A KEY-NAME of the form ipfs/CID opens the AtomSpace with that CID as a
+  read-only snapshot. Stores and deletes throw an error; reads are cached
+  for as long as the connection is open, and may come from many threads.
+
+  Options may follow a question mark, separated by ampersands:
+     async=1          Look up, or generate, the IPNS key in the
+                      background; only IPNS operations wait for it.
+     keytype=ed25519  Type of a newly generated key: rsa (the default)
+                      or ed25519, which is much faster to generate.
+     keysize=2048     Size of a newly generated RSA key, in bits.
+     values=blocks    Put each Value in a block of its own, so that
+                      changing one Value does not upload the others.
+     async_threads=4  Threads that serve the C++ future-returning
+                      fetches (fetch_atom_async() and friends).
+     outgoing=links   Write outgoing sets as IPLD links, so that the
+                      daemon can follow them (to pin or export a
+                      subgraph, or to resolve paths through it).
+     compress=1024    Compress Values of at least this many bytes,
+                      if built with zstd. Off by default, since a
+                      build without zstd can't read them back.
+     level=3          The zstd compression level.
+
   Examples of use with valid URL's:
      (ipfs-open \"ipfs:///atomspace-test\")
      (ipfs-open \"ipfs://localhost/atomspace-test\")
      (ipfs-open \"ipfs://localhost:5001/atomspace-test\")
+     (ipfs-open \"ipfs:///atomspace-test?async=1&keytype=ed25519\")
+     (ipfs-open \"ipfs://host1:5001,host2:5001/atomspace-test\")
 ")
 
 (set-procedure-property! ipfs-stats 'documentation
@@ -56,6 +95,127 @@
     This will cause some database performance statistics to be printed
     to the stdout of the server. These statistics can be quite arcane
     and are useful primarily to the developers of the database backend.
+
+    The report ends with a table of IPFS daemon calls, one row per
+    HTTP API endpoint: the number of calls and failures, the average,
+    median, 99th and 99.9th percentile and maximum latencies in
+    microseconds, and the bytes sent and received. Use
+    `(ipfs-clear-stats)` to reset these before a measurement.
+")
+
+(set-procedure-property! ipfs-stats-json 'documentation
+"
+ ipfs-stats-json - return performance statistics, as a JSON string.
+    Returns a snapshot of all of the counters, gauges and latency
+    histograms reported by `(ipfs-stats)`, as a single JSON object.
+    Counters are cumulative since the last `(ipfs-clear-stats)`;
+    latencies are in microseconds. This is cheap enough to poll
+    once a second.
+")
+
+(set-procedure-property! ipfs-stats-prometheus 'documentation
+"
+ ipfs-stats-prometheus - return performance statistics, as a string
+    in the Prometheus text exposition format. This is the same
+    snapshot as `(ipfs-stats-json)`; latencies are reported as
+    summaries, in seconds. Serve it from any HTTP endpoint that
+    a Prometheus server scrapes.
+")
+
+(set-procedure-property! ipfs-trace-start 'documentation
+"
+ ipfs-trace-start - start recording trace spans.
+    Every store, fetch, delete and bulk operation, and every call
+    to the IPFS daemon, is recorded as a timed span, together with
+    the thread it ran on and the Atom or path it worked on. Any
+    previously recorded spans are discarded. Up to a million spans
+    are kept; later ones are dropped. Tracing slows things down a
+    little; stop it with `(ipfs-trace-stop)`.
+")
+
+(set-procedure-property! ipfs-trace-stop 'documentation
+"
+ ipfs-trace-stop - stop recording trace spans.
+    The spans recorded so far are kept, and can be written out
+    with `(ipfs-trace-dump FILE)`.
+")
+
+(set-procedure-property! ipfs-trace-dump 'documentation
+"
+ ipfs-trace-dump FILE - write the recorded spans to FILE.
+    The file is in the Chrome trace-event JSON format. Load it
+    into `chrome://tracing` or https://ui.perfetto.dev to see the
+    nested spans, per thread, on a timeline.
+
+    For example:
+       (ipfs-trace-start)
+       (store-atom (List (Concept \"a\") (Concept \"b\")))
+       (barrier)
+       (ipfs-trace-stop)
+       (ipfs-trace-dump \"/tmp/ipfs-trace.json\")
+")
+
+(set-procedure-property! ipfs-open-wal 'documentation
+"
+ ipfs-open-wal PATH SYNC - log asynchronous stores to a local file.
+    After this, `(store-atom ATOM)` appends ATOM and its Values to the
+    write-ahead log at PATH, and returns at once. A background thread
+    stores the logged Atoms in IPFS, in large batches, and records a
+    checkpoint (in PATH.ckpt) after each batch. `(barrier)` waits
+    for everything logged so far to be committed.
+
+    If the process dies before the log is committed, the uncommitted
+    Atoms are not lost: the next `(ipfs-open-wal PATH SYNC)` resumes
+    from the AtomSpace CID of the last checkpoint, and stores them.
+
+    If SYNC is #t, the log is flushed to disk on every append; this
+    also protects against power loss, but is slower.
+
+    For example:
+       (ipfs-open \"ipfs:///atomspace-test\")
+       (ipfs-open-wal \"/var/tmp/atomspace-test.wal\" #f)
+")
+
+(set-procedure-property! ipfs-close-wal 'documentation
+"
+ ipfs-close-wal - commit and close the write-ahead log.
+    Waits until every logged Atom is stored, and stops logging.
+    `(ipfs-close)` does this automatically.
+")
+
+(set-procedure-property! ipfs-open-checkpoint 'documentation
+"
+ ipfs-open-checkpoint PATH INTERVAL - make bulk stores resumable.
+    After this, `(store-atomspace)` and `(ipfs-bulk-store)` record
+    each Atom that they store in a journal at PATH, and write the
+    AtomSpace CID to a checkpoint (in PATH.ckpt) after every INTERVAL
+    Atoms, and when they stop early. If a bulk store dies part way,
+    the next `(ipfs-open-checkpoint PATH INTERVAL)` resumes from the
+    checkpointed AtomSpace CID, and the next bulk store skips every
+    Atom that was already stored. Once a bulk store runs to the end,
+    the journal is emptied.
+
+    For example:
+       (ipfs-open \"ipfs:///atomspace-test\")
+       (ipfs-open-checkpoint \"/var/tmp/atomspace-test.jnl\" 10000)
+       (store-atomspace)
+")
+
+(set-procedure-property! ipfs-close-checkpoint 'documentation
+"
+ ipfs-close-checkpoint - checkpoint the journal, and close it.
+    `(ipfs-close)` does this automatically.
+")
+
+(set-procedure-property! ipfs-set-write-lane 'documentation
+"
+ ipfs-set-write-lane LANE - pick the write lane for this thread.
+    LANE is either \"interactive\" (the default) or \"bulk\".
+    Asynchronous stores made from this thread are queued in the
+    given lane. The two lanes have their own writer threads, so
+    that a big bulk load does not hold up interactive updates.
+    `(ipfs-stats)` reports the queue depth and latency of each lane.
+    Bulk stores of the whole AtomSpace always use the bulk lane.
 ")
 
 (set-procedure-property! ipfs-atom-cid 'documentation
@@ -84,6 +244,20 @@
      See also `ipfs-atom-cid` for the inverse operation.
 ")
 
+(set-procedure-property! ipfs-fetch-atoms 'documentation
+"
+ ipfs-fetch-atoms ATOM-LIST - Fetch many Atoms, and their Values, at once.
+
+     Returns a list of those Atoms in ATOM-LIST that are in the
+     AtomSpace, with their Values, in the same order. Atoms that
+     are not found are left out. This is much faster than fetching
+     them one at a time: the AtomSpace directory is read only once,
+     and the Atoms are fetched concurrently.
+
+     For example:
+        `(ipfs-fetch-atoms (list (Concept \"a\") (Concept \"b\")))`
+")
+
 (set-procedure-property! ipfs-load-atomspace 'documentation
 "
  ipfs-load-atomspace PATH - Load all Atoms from the PATH into the AtomSpace.
@@ -99,6 +273,49 @@
    IPFS CID to be loaded.
 
    See also `ipfs-fetch-atom` for loading individual atoms.
+   See `ipfs-bulk-load` to load in the background.
+")
+
+(set-procedure-property! ipfs-bulk-load 'documentation
+"
+ ipfs-bulk-load PATH - Load all Atoms from the PATH, in the background.
+    This is the same as `ipfs-load-atomspace`, except that it returns
+    at once, with a job number. Pass the job number to
+    `ipfs-bulk-status` to follow its progress, to `ipfs-bulk-cancel`
+    to stop it, or to `ipfs-bulk-wait` to wait for it to finish.
+")
+
+(set-procedure-property! ipfs-bulk-store 'documentation
+"
+ ipfs-bulk-store - Store all Atoms in the AtomSpace, in the background.
+    Returns at once, with a job number, as for `ipfs-bulk-load`.
+    The Atoms are stored in batches of 100, in the bulk write lane;
+    each batch is fully written before the next is started.
+    Atoms added to the AtomSpace after the call are not stored.
+")
+
+(set-procedure-property! ipfs-bulk-status 'documentation
+"
+ ipfs-bulk-status JOB - Return the progress of a bulk job, as a JSON
+    string. It gives the `state` (running, finished, cancelled or
+    failed), the number of Atoms `done` out of the `total`, the
+    `atoms_per_sec`, an `eta_sec` while running, and the `bytes`
+    sent to, and received from, the daemon since the job started.
+    The byte count includes any other traffic from this AtomSpace.
+")
+
+(set-procedure-property! ipfs-bulk-cancel 'documentation
+"
+ ipfs-bulk-cancel JOB - Stop a bulk job, after its current batch.
+    A cancelled store leaves the AtomSpace CID (`ipfs-atomspace-cid`)
+    naming all of the Atoms stored so far; a cancelled load leaves
+    the Atoms loaded so far in the AtomSpace. Returns at once; use
+    `ipfs-bulk-wait` to wait for the job to stop.
+")
+
+(set-procedure-property! ipfs-bulk-wait 'documentation
+"
+ ipfs-bulk-wait JOB - Wait for a bulk job to finish, or to stop.
 ")
 
 (set-procedure-property! ipfs-atomspace-cid 'documentation
@@ -139,6 +356,25 @@
      for current status.
 ")
 
+(set-procedure-property! ipfs-publish-options 'documentation
+"
+ ipfs-publish-options LIFETIME TTL INTERVAL - Configure IPNS publication.
+     LIFETIME and TTL are duration strings, such as \"4h\" or \"30s\",
+     giving the lifetime and the time-to-live of the published IPNS
+     record. INTERVAL is the minimum number of seconds between two
+     successive publications; calls to `(ipfs-publish-atomspace)` made
+     during that interval are collapsed into a single publication of
+     the latest AtomSpace CID. An empty string, or a negative INTERVAL,
+     leaves that setting unchanged.
+
+     For example:
+        `(ipfs-publish-options \"24h\" \"1m\" 300)`
+
+     The number of publications, the number of requests that were
+     collapsed, and the publication latency are reported by
+     `(ipfs-stats)`.
+")
+
 (set-procedure-property! ipfs-resolve-atomspace 'documentation
 "
  ipfs-resolve-atomspace - Perform IPNS resolution to get the